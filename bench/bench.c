@@ -0,0 +1,438 @@
+/**
+ * @file bench.c
+ * @brief Benchmark suite for the shell's hot paths, with machine-readable results.
+ *
+ * Usage: ShellProject_bench [--quick] [--shell path] [--output file] [--filter substring] [--ballast MiB]
+ *
+ * Measures parse_input on realistic lines, builtin dispatch, launching /bin/true serially through
+ * posix_spawn and fork + exec and in the background, pipelines of cat stages moving 1 GiB, and a 10000
+ * line batch file run serially and in parallel by the shell given with --shell. --quick shrinks every case
+ * so the suite fits in a test run. The results are written as one JSON document, to stdout or to the
+ * output file, with a line per case on stderr for people; comparing two documents between releases shows
+ * regressions.
+ */
+#include "builtins.h"
+#include "execution.h"
+#include "spawner.h"
+#include <getopt.h>
+#include <time.h>
+
+#define FULL_ITERATIONS 100000   /**< Samples of the in-process cases. */
+#define FULL_SPAWNS 2000         /**< Launches per spawn case. */
+#define FULL_PIPELINE_MIB 1024   /**< Data pushed through each pipeline. */
+#define FULL_BATCH_LINES 10000   /**< Lines of the batch file. */
+#define QUICK_DIVISOR 20         /**< --quick divides the sizes above by this. */
+#define DISPATCH_BATCH 256       /**< Builtin lookups timed together, as one is shorter than a clock read. */
+#define PIPELINE_RUNS 3          /**< Runs of each pipeline. */
+#define BATCH_RUNS 3             /**< Runs of each batch file. */
+
+/**
+ * @struct BenchConfig
+ * @brief Sizes and selection of the cases to run.
+ */
+typedef struct
+{
+    int iterations;         /**< Samples of the in-process cases. */
+    int spawns;             /**< Launches per spawn case. */
+    size_t pipeline_mib;    /**< Data pushed through each pipeline, in MiB. */
+    int batch_lines;        /**< Lines of the batch file. */
+    const char* shell;      /**< Shell binary for the batch cases, or NULL to skip them. */
+    const char* filter;     /**< Only cases whose name contains this run, or NULL for all. */
+} BenchConfig;
+
+static cJSON* results = NULL;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static int compare_doubles(const void* a, const void* b)
+{
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static bool selected(const BenchConfig* config, const char* name)
+{
+    return config->filter == NULL || strstr(name, config->filter) != NULL;
+}
+
+/**
+ * @brief Adds a case's latency distribution and throughput to the results, and prints a summary line.
+ *
+ * @param samples Latency of each operation in nanoseconds; sorted in place.
+ * @param count Number of samples.
+ * @param elapsed_ns Wall time of the whole case.
+ * @param work Amount of work done in that time, in work_unit.
+ * @param work_unit Unit of the throughput, per second.
+ */
+static void report(const char* name, double* samples, int count, double elapsed_ns, double work,
+                   const char* work_unit)
+{
+    qsort(samples, (size_t)count, sizeof(double), compare_doubles);
+    double total = 0;
+    for (int i = 0; i < count; i++)
+    {
+        total += samples[i];
+    }
+    double throughput = elapsed_ns > 0 ? work / (elapsed_ns / 1e9) : 0;
+    cJSON* result = cJSON_CreateObject();
+    cJSON_AddStringToObject(result, "name", name);
+    cJSON_AddNumberToObject(result, "samples", count);
+    cJSON_AddNumberToObject(result, "mean_ns", total / count);
+    cJSON_AddNumberToObject(result, "p50_ns", samples[count / 2]);
+    cJSON_AddNumberToObject(result, "p90_ns", samples[(count * 90) / 100]);
+    cJSON_AddNumberToObject(result, "p99_ns", samples[(count * 99) / 100]);
+    cJSON_AddNumberToObject(result, "max_ns", samples[count - 1]);
+    cJSON_AddNumberToObject(result, "throughput", throughput);
+    cJSON_AddStringToObject(result, "throughput_unit", work_unit);
+    cJSON_AddItemToArray(results, result);
+    fprintf(stderr, "%-28s n=%-7d mean=%.0fns p50=%.0fns p99=%.0fns max=%.0fns %.4g %s/s\n", name, count,
+            total / count, samples[count / 2], samples[(count * 99) / 100], samples[count - 1], throughput,
+            work_unit);
+}
+
+static void bench_parse(const BenchConfig* config, double* samples)
+{
+    static const char* const lines[] = {
+        "ls -la /usr/share/doc",
+        "grep -rn 'TODO: fix' src include | sort | uniq -c | sort -rn > todo.txt",
+        "echo \"build finished in $SECONDS seconds\" >> build.log 2> errors.log",
+        "tar czf backup.tar.gz --exclude '*.o' project/ &",
+        "cat access.log | awk '{print $1}' | sort | uniq -c | sort -rn | head -20",
+        "set_metrics cpu_usage memory_usage disk_io network_rx",
+    };
+    size_t num_lines = sizeof(lines) / sizeof(lines[0]);
+    size_t bytes = 0;
+    double start = now_ns();
+    for (int i = 0; i < config->iterations; i++)
+    {
+        const char* line = lines[(size_t)i % num_lines];
+        ParsedCommand parsed_cmd;
+        double before = now_ns();
+        parse_input(line, &parsed_cmd);
+        samples[i] = now_ns() - before;
+        cleanup_parsed_command(&parsed_cmd);
+        bytes += strlen(line);
+    }
+    report("parse_input", samples, config->iterations, now_ns() - start, (double)bytes, "bytes");
+}
+
+static void bench_builtin_dispatch(const BenchConfig* config, double* samples)
+{
+    // Every builtin, plus the kind of external commands that make up most lines and must miss.
+    static const char* const names[] = {
+#define BUILTIN(name) #name,
+#include "builtins.def"
+#undef BUILTIN
+        "ls",
+        "grep",
+        "make",
+        "git",
+    };
+    size_t num_names = sizeof(names) / sizeof(names[0]);
+    int rounds = config->iterations / DISPATCH_BATCH > 0 ? config->iterations / DISPATCH_BATCH : 1;
+    size_t found = 0;
+    double start = now_ns();
+    for (int i = 0; i < rounds; i++)
+    {
+        double before = now_ns();
+        for (size_t j = 0; j < DISPATCH_BATCH; j++)
+        {
+            found += find_builtin(names[j % num_names]) != NULL;
+        }
+        samples[i] = (now_ns() - before) / DISPATCH_BATCH;
+    }
+    double elapsed = now_ns() - start;
+    if (found == 0)
+    {
+        fprintf(stderr, "builtin dispatch found no builtin\n");
+    }
+    report("builtin_dispatch", samples, rounds, elapsed, (double)rounds * DISPATCH_BATCH, "lookups");
+}
+
+static void bench_spawn_serial(const BenchConfig* config, double* samples, const char* name,
+                               pid_t (*launch)(char* const argv[], const SpawnOptions* options))
+{
+    char* argv[] = {"/bin/true", NULL};
+    SpawnOptions options;
+    spawn_options_init(&options);
+    double start = now_ns();
+    for (int i = 0; i < config->spawns; i++)
+    {
+        double before = now_ns();
+        pid_t pid = launch(argv, &options);
+        if (pid < 0)
+        {
+            exit(EXIT_FAILURE);
+        }
+        waitpid(pid, NULL, 0);
+        samples[i] = now_ns() - before;
+    }
+    report(name, samples, config->spawns, now_ns() - start, config->spawns, "launches");
+}
+
+/**
+ * @brief Launches every child before reaping any, as a line of '&' commands does; samples are launch times.
+ */
+static void bench_spawn_background(const BenchConfig* config, double* samples)
+{
+    char* argv[] = {"/bin/true", NULL};
+    SpawnOptions options;
+    spawn_options_init(&options);
+    double start = now_ns();
+    for (int i = 0; i < config->spawns; i++)
+    {
+        double before = now_ns();
+        if (spawn_command(argv, &options) < 0)
+        {
+            exit(EXIT_FAILURE);
+        }
+        samples[i] = now_ns() - before;
+    }
+    while (waitpid(-1, NULL, 0) > 0 || errno == EINTR)
+    {
+    }
+    report("spawn_background", samples, config->spawns, now_ns() - start, config->spawns, "launches");
+}
+
+/**
+ * @brief Runs a pipeline of cat stages through the shell's own pipeline code, fed from /dev/zero.
+ */
+static void bench_pipeline(const BenchConfig* config, int cats)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "pipeline_%d_cat", cats);
+    if (!selected(config, name))
+    {
+        return;
+    }
+    char line[256];
+    int length = snprintf(line, sizeof(line), "head -c %zu /dev/zero", config->pipeline_mib << 20);
+    for (int i = 0; i < cats; i++)
+    {
+        length += snprintf(line + length, sizeof(line) - (size_t)length, " | cat");
+    }
+    snprintf(line + length, sizeof(line) - (size_t)length, " > /dev/null");
+
+    double samples[PIPELINE_RUNS];
+    double start = now_ns();
+    for (int run = 0; run < PIPELINE_RUNS; run++)
+    {
+        ParsedCommand parsed_cmd;
+        if (parse_input(line, &parsed_cmd) == -1)
+        {
+            exit(EXIT_FAILURE);
+        }
+        double before = now_ns();
+        if (execute_command(&parsed_cmd) != 0)
+        {
+            fprintf(stderr, "%s failed\n", line);
+            exit(EXIT_FAILURE);
+        }
+        samples[run] = now_ns() - before;
+        cleanup_parsed_command(&parsed_cmd);
+    }
+    report(name, samples, PIPELINE_RUNS, now_ns() - start, (double)PIPELINE_RUNS * (double)(config->pipeline_mib << 20),
+           "bytes");
+}
+
+/**
+ * @brief Writes a batch file mixing external commands and builtins, and returns its path.
+ */
+static char* write_batch_file(int lines)
+{
+    static char path[] = "/tmp/shell-bench-XXXXXX";
+    int fd = mkstemp(path);
+    FILE* file = fd == -1 ? NULL : fdopen(fd, "w");
+    if (file == NULL)
+    {
+        perror("Failed to create the batch file");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < lines; i++)
+    {
+        switch (i % 4)
+        {
+        case 0:
+            fprintf(file, "true\n");
+            break;
+        case 1:
+            fprintf(file, "echo line %d > /dev/null\n", i);
+            break;
+        case 2:
+            fprintf(file, "/bin/echo line %d > /dev/null\n", i);
+            break;
+        default:
+            fprintf(file, "true | true\n");
+            break;
+        }
+    }
+    fclose(file);
+    return path;
+}
+
+/**
+ * @brief Runs the shell on a batch file, with its output discarded, and returns the wall time.
+ */
+static double run_shell(const char* shell, const char* jobs, const char* batch_file)
+{
+    double start = now_ns();
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("fork failed");
+        exit(EXIT_FAILURE);
+    }
+    else if (pid == 0)
+    {
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        if (jobs)
+        {
+            execl(shell, shell, "--no-monitor", "-j", jobs, batch_file, (char*)NULL);
+        }
+        else
+        {
+            execl(shell, shell, "--no-monitor", batch_file, (char*)NULL);
+        }
+        _exit(127);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) == 127)
+    {
+        fprintf(stderr, "%s could not run the batch file\n", shell);
+        exit(EXIT_FAILURE);
+    }
+    return now_ns() - start;
+}
+
+static void bench_batch(const BenchConfig* config, const char* name, const char* jobs, const char* batch_file)
+{
+    if (!selected(config, name))
+    {
+        return;
+    }
+    double samples[BATCH_RUNS];
+    double start = now_ns();
+    for (int run = 0; run < BATCH_RUNS; run++)
+    {
+        samples[run] = run_shell(config->shell, jobs, batch_file);
+    }
+    report(name, samples, BATCH_RUNS, now_ns() - start, (double)BATCH_RUNS * config->batch_lines, "lines");
+}
+
+int main(int argc, char* argv[])
+{
+    static const struct option long_options[] = {
+        {"quick", no_argument, NULL, 'q'},         {"shell", required_argument, NULL, 's'},
+        {"output", required_argument, NULL, 'o'},  {"filter", required_argument, NULL, 'f'},
+        {"ballast", required_argument, NULL, 'b'}, {NULL, 0, NULL, 0}};
+    BenchConfig config = {FULL_ITERATIONS, FULL_SPAWNS, FULL_PIPELINE_MIB, FULL_BATCH_LINES, NULL, NULL};
+    const char* output = NULL;
+    size_t ballast_mib = 0;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'q':
+            config.iterations /= QUICK_DIVISOR;
+            config.spawns /= QUICK_DIVISOR;
+            config.pipeline_mib /= QUICK_DIVISOR;
+            config.batch_lines /= QUICK_DIVISOR;
+            break;
+        case 's':
+            config.shell = optarg;
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        case 'f':
+            config.filter = optarg;
+            break;
+        case 'b':
+            ballast_mib = (size_t)atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [--quick] [--shell path] [--output file] [--filter substring] [--ballast MiB]\n",
+                    argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Heap touched before measuring, standing in for a shell that has grown: fork copies its page tables.
+    char* ballast = malloc((ballast_mib << 20) + 1);
+    int max_samples = config.iterations > config.spawns ? config.iterations : config.spawns;
+    double* samples = malloc((size_t)max_samples * sizeof(double));
+    results = cJSON_CreateArray();
+    if (!ballast || !samples || !results)
+    {
+        perror("malloc failed");
+        return EXIT_FAILURE;
+    }
+    memset(ballast, 1, ballast_mib << 20);
+
+    if (selected(&config, "parse_input"))
+    {
+        bench_parse(&config, samples);
+    }
+    if (selected(&config, "builtin_dispatch"))
+    {
+        bench_builtin_dispatch(&config, samples);
+    }
+    if (selected(&config, "spawn_serial_posix_spawn"))
+    {
+        bench_spawn_serial(&config, samples, "spawn_serial_posix_spawn", spawn_command);
+    }
+    if (selected(&config, "spawn_serial_fork_exec"))
+    {
+        bench_spawn_serial(&config, samples, "spawn_serial_fork_exec", fork_command);
+    }
+    if (selected(&config, "spawn_background"))
+    {
+        bench_spawn_background(&config, samples);
+    }
+    bench_pipeline(&config, 1);
+    bench_pipeline(&config, 4);
+    bench_pipeline(&config, 8);
+    if (config.shell)
+    {
+        char* batch_file = write_batch_file(config.batch_lines);
+        char jobs[16];
+        snprintf(jobs, sizeof(jobs), "%ld", sysconf(_SC_NPROCESSORS_ONLN));
+        bench_batch(&config, "batch_serial", NULL, batch_file);
+        bench_batch(&config, "batch_parallel", jobs, batch_file);
+        unlink(batch_file);
+    }
+
+    cJSON* document = cJSON_CreateObject();
+    cJSON_AddStringToObject(document, "suite", "ShellProject_bench");
+    cJSON_AddBoolToObject(document, "quick", config.iterations < FULL_ITERATIONS);
+    cJSON_AddNumberToObject(document, "ballast_mib", (double)ballast_mib);
+    cJSON_AddNumberToObject(document, "timestamp", (double)time(NULL));
+    cJSON_AddItemToObject(document, "results", results);
+    char* json_string = cJSON_Print(document);
+    FILE* out = output ? fopen(output, "w") : stdout;
+    if (json_string == NULL || out == NULL)
+    {
+        perror("Failed to write the results");
+        return EXIT_FAILURE;
+    }
+    fprintf(out, "%s\n", json_string);
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+    free(json_string);
+    cJSON_Delete(document);
+    free(samples);
+    free(ballast);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,159 @@
+/**
+ * @file startup_bench.c
+ * @brief Measures the shell's time to first prompt and fails if it regresses.
+ *
+ * Usage: ShellProject_startup_bench <shell> [iterations] [max_p50_ms] [shell options...]
+ *
+ * The shell is started interactively on pipes, and the time until its prompt ("$ ") shows up on stdout is
+ * recorded; closing stdin then makes it exit. The exit status is non-zero when the median exceeds the
+ * budget, so the benchmark doubles as a test that metric discovery never delays the prompt.
+ */
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_ITERATIONS 20  /**< Shell startups measured. */
+#define DEFAULT_MAX_P50_MS 100 /**< Budget for the median time to first prompt. */
+#define PROMPT_MARKER "$ "      /**< End of the shell's prompt. */
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+static int compare_doubles(const void* a, const void* b)
+{
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Starts the shell once and returns the milliseconds until its first prompt, or -1 on failure.
+ */
+static double time_to_prompt(char* const shell_argv[])
+{
+    int input[2];
+    int output[2];
+    if (pipe(input) == -1 || pipe(output) == -1)
+    {
+        perror("pipe failed");
+        return -1;
+    }
+    double start = now_ms();
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("fork failed");
+        return -1;
+    }
+    else if (pid == 0)
+    {
+        dup2(input[0], STDIN_FILENO);
+        dup2(output[1], STDOUT_FILENO);
+        close(input[0]);
+        close(input[1]);
+        close(output[0]);
+        close(output[1]);
+        execv(shell_argv[0], shell_argv);
+        perror("execv failed");
+        _exit(127);
+    }
+    close(input[0]);
+    close(output[1]);
+
+    // Keep the tail of the previous read so a marker split across reads is still found.
+    char buffer[4096 + sizeof(PROMPT_MARKER)];
+    size_t kept = 0;
+    double elapsed = -1;
+    ssize_t bytes;
+    while ((bytes = read(output[0], buffer + kept, sizeof(buffer) - kept - 1)) != 0)
+    {
+        if (bytes == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+        size_t length = kept + (size_t)bytes;
+        buffer[length] = '\0';
+        if (strstr(buffer, PROMPT_MARKER))
+        {
+            elapsed = now_ms() - start;
+            break;
+        }
+        kept = length < sizeof(PROMPT_MARKER) - 1 ? length : sizeof(PROMPT_MARKER) - 1;
+        memmove(buffer, buffer + length - kept, kept);
+    }
+    close(input[1]);
+    close(output[0]);
+    if (elapsed < 0)
+    {
+        kill(pid, SIGKILL);
+    }
+    waitpid(pid, NULL, 0);
+    return elapsed;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <shell> [iterations] [max_p50_ms] [shell options...]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    int iterations = argc > 2 ? atoi(argv[2]) : DEFAULT_ITERATIONS;
+    double max_p50 = argc > 3 ? atof(argv[3]) : DEFAULT_MAX_P50_MS;
+    if (iterations <= 0 || max_p50 <= 0)
+    {
+        fprintf(stderr, "Usage: %s <shell> [iterations] [max_p50_ms] [shell options...]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // The shell's argv: its path followed by whatever options come after the budget.
+    char** shell_argv = calloc((size_t)argc, sizeof(char*));
+    double* samples = malloc((size_t)iterations * sizeof(double));
+    if (!shell_argv || !samples)
+    {
+        perror("malloc failed");
+        return EXIT_FAILURE;
+    }
+    shell_argv[0] = argv[1];
+    for (int i = 4; i < argc; i++)
+    {
+        shell_argv[i - 3] = argv[i];
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    for (int i = 0; i < iterations; i++)
+    {
+        samples[i] = time_to_prompt(shell_argv);
+        if (samples[i] < 0)
+        {
+            fprintf(stderr, "%s exited without showing a prompt\n", argv[1]);
+            return EXIT_FAILURE;
+        }
+    }
+    qsort(samples, (size_t)iterations, sizeof(double), compare_doubles);
+    double p50 = samples[iterations / 2];
+    printf("time to first prompt: iterations=%d min=%.2fms p50=%.2fms max=%.2fms budget=%.0fms\n", iterations,
+           samples[0], p50, samples[iterations - 1], max_p50);
+
+    free(samples);
+    free(shell_argv);
+    if (p50 > max_p50)
+    {
+        fprintf(stderr, "median time to first prompt exceeds the %.0f ms budget\n", max_p50);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,83 @@
+/**
+ * @file arena.h
+ * @brief Header file for the bump-pointer arena allocator.
+ *
+ * This header file declares a small arena allocator used for short-lived data such as the tokens and
+ * command tree of a single input line. Allocations are carved out of large blocks and are never freed
+ * individually; resetting the arena releases everything at once in constant time while keeping the
+ * blocks around for the next line.
+ *
+ * @date 17/10/2026
+ * @author 1v6n
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_BLOCK_SIZE 4096 /**< Default size of an arena block. */
+
+/**
+ * @struct ArenaBlock
+ * @brief A chunk of memory that allocations are carved from.
+ */
+typedef struct ArenaBlock
+{
+    struct ArenaBlock* next; /**< Next block in the chain. */
+    size_t size;             /**< Usable bytes in the block. */
+    size_t used;             /**< Bytes handed out so far. */
+    max_align_t data[];      /**< Block storage. */
+} ArenaBlock;
+
+/**
+ * @struct Arena
+ * @brief A chain of blocks plus the block currently being filled.
+ */
+typedef struct
+{
+    ArenaBlock* first;   /**< First block of the chain. */
+    ArenaBlock* current; /**< Block new allocations come from. */
+} Arena;
+
+/**
+ * @brief Initializes an empty arena. No memory is allocated until the first allocation.
+ *
+ * @param arena Pointer to the arena.
+ */
+void arena_init(Arena* arena);
+
+/**
+ * @brief Allocates memory from the arena, aligned for any type.
+ *
+ * @param arena Pointer to the arena.
+ * @param size Number of bytes to allocate.
+ * @return Pointer to the memory, or NULL if a new block could not be allocated.
+ */
+void* arena_alloc(Arena* arena, size_t size);
+
+/**
+ * @brief Copies a string of known length into the arena and NUL-terminates it.
+ *
+ * @param arena Pointer to the arena.
+ * @param str The string to copy.
+ * @param len Number of bytes to copy.
+ * @return Pointer to the copy, or NULL on allocation failure.
+ */
+char* arena_strndup(Arena* arena, const char* str, size_t len);
+
+/**
+ * @brief Releases every allocation at once, keeping the blocks for reuse.
+ *
+ * @param arena Pointer to the arena.
+ */
+void arena_reset(Arena* arena);
+
+/**
+ * @brief Frees all blocks owned by the arena.
+ *
+ * @param arena Pointer to the arena.
+ */
+void arena_destroy(Arena* arena);
+
+#endif // ARENA_H
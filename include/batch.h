@@ -0,0 +1,34 @@
+/**
+ * @file batch.h
+ * @brief Header file for the parallel batch file executor.
+ *
+ * This header file declares the executor behind `-j N`. Independent lines of a batch file run
+ * concurrently, at most N at a time, while their output is captured and printed in the order of the file.
+ * A line reading `barrier` waits for everything started before it, and builtins run in the shell itself,
+ * in order, since they may change its state. Lines ending in '&' are started by the shell too, through the
+ * scheduler, without waiting for them. A `quit` line ends the batch like the end of the file does.
+ *
+ * @date 17/10/2026
+ * @author 1v6n
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "global.h"
+
+#define BATCH_BARRIER "barrier" /**< Batch file line that waits for every line started before it. */
+
+/**
+ * @brief Runs the lines of a batch file with at most max_jobs of them in flight.
+ *
+ * Once every line has finished, a summary with the exit status and duration of each line is printed to
+ * standard error.
+ *
+ * @param fd Descriptor the batch file is read from.
+ * @param max_jobs Maximum number of lines running at once.
+ * @return 0 if every line succeeded, 1 otherwise.
+ */
+int run_batch_parallel(int fd, int max_jobs);
+
+#endif // BATCH_H
@@ -0,0 +1,26 @@
+/**
+ * @file builtins.h
+ * @brief Header file for the builtin command table.
+ *
+ * This header file declares the lookup of builtin commands. The table is built from builtins.def, and
+ * names are resolved through a perfect hash generated from the same list at build time: one hash, one
+ * slot and one string comparison, whatever the number of builtins.
+ *
+ * @date 17/10/2026
+ * @author 1v6n
+ */
+
+#ifndef BUILTINS_H
+#define BUILTINS_H
+
+#include "global.h"
+
+/**
+ * @brief Finds a builtin command by name.
+ *
+ * @param command The command name.
+ * @return The builtin's table entry, or NULL if the command is not a builtin.
+ */
+const CommandHandler* find_builtin(const char* command);
+
+#endif // BUILTINS_H
@@ -0,0 +1,47 @@
+/**
+ * @file command_hash.h
+ * @brief Header file for the command path hash table.
+ *
+ * This header file declares the functions behind the shell's command hash, which maps command names to
+ * the absolute paths they resolve to in PATH. Entries are filled on first lookup, so repeated commands are
+ * exec'ed directly instead of probing every PATH directory. The whole table is flushed when PATH changes,
+ * and an entry is dropped when the file it points to is no longer executable.
+ *
+ * @date 17/10/2026
+ * @author 1v6n
+ */
+
+#ifndef COMMAND_HASH_H
+#define COMMAND_HASH_H
+
+#include "global.h"
+
+/**
+ * @brief Resolves a command name to an executable path, consulting the hash table first.
+ *
+ * Names containing a slash are returned unchanged and never cached.
+ *
+ * @param name The command name.
+ * @return The resolved path, owned by the table and valid until the next flush, or NULL if not found.
+ */
+const char* command_hash_lookup(const char* name);
+
+/**
+ * @brief Resolves a command in PATH and stores it in the table, replacing any existing entry.
+ *
+ * @param name The command name.
+ * @return 0 on success, -1 if the command was not found.
+ */
+int command_hash_add(const char* name);
+
+/**
+ * @brief Removes every entry from the table.
+ */
+void command_hash_clear(void);
+
+/**
+ * @brief Prints the table entries with their hit counts, followed by the lookup statistics.
+ */
+void command_hash_print(void);
+
+#endif // COMMAND_HASH_H
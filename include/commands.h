@@ -82,22 +82,109 @@ void handle_man(ParsedCommand* parsed_cmd);
 void handle_stop_monitor(ParsedCommand* parsed_cmd);
 
 /**
- * @brief Retrieves metrics from a FIFO and interacts with the monitoring process.
+ * @brief Handles the 'hash' command: lists the command hash, adds entries to it, or clears it with -r.
+ *
+ * @param parsed_cmd Pointer to the parsed command structure.
+ */
+void handle_hash(ParsedCommand* parsed_cmd);
+
+/**
+ * @brief Handles the 'config show' command, printing the live configuration and when it was loaded.
+ *
+ * @param parsed_cmd Pointer to the parsed command structure.
+ */
+void handle_config(ParsedCommand* parsed_cmd);
+
+/**
+ * @brief Handles the 'jobs' command, listing background and stopped jobs.
+ *
+ * With -l the process IDs of each job are listed too; with -v the resources each job has used, then those
+ * of the last finished jobs.
+ *
+ * @param parsed_cmd Pointer to the parsed command structure.
+ */
+void handle_jobs(ParsedCommand* parsed_cmd);
+
+/**
+ * @brief Handles the 'fg' command, running a background or stopped job in the foreground.
+ *
+ * @param parsed_cmd Pointer to the parsed command structure.
+ */
+void handle_fg(ParsedCommand* parsed_cmd);
+
+/**
+ * @brief Handles the 'bg' command, continuing a stopped job in the background.
+ *
+ * @param parsed_cmd Pointer to the parsed command structure.
+ */
+void handle_bg(ParsedCommand* parsed_cmd);
+
+/**
+ * @brief Handles the 'kill' command, sending a signal to jobs or processes.
+ *
+ * @param parsed_cmd Pointer to the parsed command structure.
+ */
+void handle_kill(ParsedCommand* parsed_cmd);
+
+/**
+ * @brief Handles the 'wait' command, waiting for a job or for every background job to finish.
+ *
+ * @param parsed_cmd Pointer to the parsed command structure.
+ */
+void handle_wait(ParsedCommand* parsed_cmd);
+
+/**
+ * @brief Handles the 'sched' command, showing the background job scheduler's state or setting how many
+ * background jobs may run at once.
+ *
+ * @param parsed_cmd Pointer to the parsed command structure.
+ */
+void handle_sched(ParsedCommand* parsed_cmd);
+
+/**
+ * @brief Handles the 'stats' command, printing the shell's latency histograms and counters, or clearing
+ * them with 'stats reset'.
+ *
+ * @param parsed_cmd Pointer to the parsed command structure.
+ */
+void handle_stats(ParsedCommand* parsed_cmd);
+
+/**
+ * @brief Applies the configuration in `root`, as loaded at startup or reloaded from the file: adopts its
+ * interval and pushes the interval and metrics to a running monitor.
+ */
+void apply_config(void);
+
+/**
+ * @brief Starts discovering the available metrics in the background.
+ *
+ * The monitor is run as a job that lists its metrics; when it finishes, or is killed after timeout_ms,
+ * the metrics file is loaded and the keys missing from the configuration filled in. The shell does not wait
+ * for any of it.
  *
  * @param fifo_path Path to the FIFO file.
  * @param monitor_path Path to the monitor executable.
+ * @param timeout_ms How long the monitor may take before it is killed.
  */
-void retrive_metrics(const char* fifo_path, const char* monitor_path);
+void retrive_metrics(const char* fifo_path, const char* monitor_path, unsigned int timeout_ms);
 
 /**
- * @brief Creates a configuration file with specified interval and metrics.
+ * @brief Waits for a metric discovery started by retrive_metrics, if one is still running.
+ */
+void wait_for_metric_discovery(void);
+
+/**
+ * @brief Makes sure the available metrics are known before they are listed or sampled.
  *
- * @param config_file Path to the configuration file.
- * @param interval The update interval in seconds.
- * @param metrics Array of metric names.
- * @param num_metrics The number of metrics.
+ * Discovery is started here on first use when startup skipped it, as under --no-monitor, so the built-in
+ * sampler's metrics are offered when there is no monitor binary. Waits for the discovery to finish.
  */
-void create_config_file(const char* config_file, int interval, char** metrics, size_t num_metrics);
+void require_metrics(void);
+
+/**
+ * @brief Kills a metric discovery that is still running and reaps it.
+ */
+void cancel_metric_discovery(void);
 
 /**
  * @brief Displays the status of the current monitoring process.
@@ -106,6 +193,14 @@ void create_config_file(const char* config_file, int interval, char** metrics, s
  */
 void handle_status_monitor(ParsedCommand* parsed_cmd);
 
+/**
+ * @brief Handles the 'history' command, printing a metric's samples or rollups over a time range from the
+ * shell's time series, or listing the metrics that have one.
+ *
+ * @param parsed_cmd Pointer to the parsed command structure.
+ */
+void handle_history(ParsedCommand* parsed_cmd);
+
 /**
  * @brief Initializes metrics from the status file.
  *
@@ -0,0 +1,107 @@
+/**
+ * @file config.h
+ * @brief Header file for the shell's configuration file.
+ *
+ * This header file declares the functions that keep config.json in step with the shell's settings. The
+ * settings are changed in place in the `root` cJSON tree, and the file is rewritten at most once per
+ * CONFIG_WRITE_DELAY_MS however many changes arrive in between. Every write goes to a temporary file that is
+ * synced and renamed over config.json, so readers see either the old or the new file and never a truncated
+ * one. Each written file carries a "version" number that grows by one per write, so a reader that remembers
+ * the last version it parsed can skip files it has already seen.
+ *
+ * The file is also watched with inotify, so edits made by hand or by another shell are loaded as they
+ * happen. A change is only reparsed when the file's size, modification time and contents hash say it is
+ * really different from what the shell last read or wrote.
+ *
+ * @date 17/10/2026
+ * @author 1v6n
+ */
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include "global.h"
+#include <time.h>
+
+#define CONFIG_WRITE_DELAY_MS 200 /**< Window in which configuration changes are coalesced into one write. */
+
+/**
+ * @brief Called after a changed configuration file has been loaded into `root`.
+ */
+typedef void (*ConfigReloadHandler)(void);
+
+/**
+ * @brief Loads the configuration file into `root`, or starts an empty configuration if it is missing.
+ *
+ * Loading keeps the file's version number, so later writes continue from it and settings that do not
+ * change do not cause a rewrite.
+ *
+ * The path is made absolute here, so reads, writes and the inotify watch all keep using the same file
+ * when the shell changes directory.
+ *
+ * @param config_file Path to the configuration file.
+ * @return 0 on success, -1 if the file exists but could not be read or parsed.
+ */
+int config_init(const char* config_file);
+
+/**
+ * @brief Watches the configuration file and reloads it from the event loop whenever its contents change.
+ *
+ * @param on_reload Function called after each reload, or NULL.
+ * @return 0 on success, -1 on failure.
+ */
+int config_watch(ConfigReloadHandler on_reload);
+
+/**
+ * @brief Loads the configuration file again if it differs from what the shell last read or wrote.
+ *
+ * A newer file replaces `root` and discards changes still waiting to be written.
+ *
+ * @return 1 if a new configuration was loaded, 0 if the file has not changed, -1 on failure.
+ */
+int config_reload(void);
+
+/**
+ * @brief Sets the monitor interval in the configuration and schedules a write if it changed.
+ *
+ * @param interval The update interval in seconds.
+ */
+void config_set_interval(int interval);
+
+/**
+ * @brief Sets the metric list in the configuration and schedules a write if it changed.
+ *
+ * @param metrics Array of metric names.
+ * @param num_metrics The number of metrics.
+ */
+void config_set_metrics(char** metrics, size_t num_metrics);
+
+/**
+ * @brief Writes pending configuration changes now instead of at the end of the write window.
+ *
+ * @return 0 if nothing was pending or the file was written, -1 on failure.
+ */
+int config_flush(void);
+
+/**
+ * @brief Returns the path of the configuration file.
+ *
+ * @return The absolute path resolved by config_init, or CONFIG_FILE before it.
+ */
+const char* config_file_path(void);
+
+/**
+ * @brief Returns when the configuration was last loaded from the file.
+ *
+ * @return The load time, 0 if the configuration has never been loaded from the file.
+ */
+time_t config_loaded_at(void);
+
+/**
+ * @brief Returns the version of the configuration, which is the version of the last file written.
+ *
+ * @return The version number, 0 if no configuration has been loaded or written.
+ */
+unsigned long config_version(void);
+
+#endif // CONFIG_H
@@ -0,0 +1,136 @@
+/**
+ * @file event_loop.h
+ * @brief Header file for the shell's epoll-based event loop.
+ *
+ * This header file declares the event loop that drives the shell. Every source of work (the input fd,
+ * the signalfd carrying SIGCHLD and the job control signals, timerfds and inotify watches on the monitor
+ * channels) is registered here with a handler, and a single epoll_wait dispatches whichever is ready.
+ * Descriptors epoll cannot watch, such as regular batch files, are treated as always ready.
+ *
+ * While a foreground job runs, the loop is re-entered with input sources paused so signals, timers and
+ * monitor events keep being handled without reading the next command.
+ *
+ * @date 17/10/2026
+ * @author 1v6n
+ */
+
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include "global.h"
+#include <sys/epoll.h>
+
+#define EVENT_LOOP_INPUT 0x1 /**< Source flag: command input, paused while a foreground job runs. */
+
+/**
+ * @brief Callback invoked when a registered descriptor is ready.
+ *
+ * @param fd The ready descriptor.
+ * @param events The epoll events reported for it.
+ * @param data The pointer given at registration.
+ */
+typedef void (*EventHandler)(int fd, uint32_t events, void* data);
+
+/**
+ * @brief Creates the event loop.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int event_loop_init(void);
+
+/**
+ * @brief Tells whether the event loop has been created.
+ *
+ * @return True if event_loop_init succeeded.
+ */
+bool event_loop_active(void);
+
+/**
+ * @brief Registers a descriptor with the loop.
+ *
+ * @param fd The descriptor to watch.
+ * @param events The epoll events of interest (EPOLLIN, ...).
+ * @param flags Source flags such as EVENT_LOOP_INPUT.
+ * @param handler The callback to invoke when the descriptor is ready.
+ * @param data Pointer passed back to the callback.
+ * @return 0 on success, -1 on failure.
+ */
+int event_loop_add(int fd, uint32_t events, int flags, EventHandler handler, void* data);
+
+/**
+ * @brief Unregisters a descriptor. The descriptor itself is not closed.
+ *
+ * @param fd The descriptor to remove.
+ */
+void event_loop_remove(int fd);
+
+/**
+ * @brief Creates a timerfd and registers it with the loop.
+ *
+ * The loop consumes the expiration count before calling the handler.
+ *
+ * @param interval_ms Delay before the first expiration, in milliseconds.
+ * @param periodic Whether the timer keeps firing every interval_ms.
+ * @param handler The callback to invoke on expiration.
+ * @param data Pointer passed back to the callback.
+ * @return The timer descriptor, or -1 on failure.
+ */
+int event_loop_add_timer(unsigned int interval_ms, bool periodic, EventHandler handler, void* data);
+
+/**
+ * @brief Re-arms or disarms a timer created with event_loop_add_timer.
+ *
+ * @param timer_fd The timer descriptor.
+ * @param interval_ms Delay before the next expiration in milliseconds, 0 to disarm.
+ * @param periodic Whether the timer keeps firing every interval_ms.
+ * @return 0 on success, -1 on failure.
+ */
+int event_loop_set_timer(int timer_fd, unsigned int interval_ms, bool periodic);
+
+/**
+ * @brief Unregisters and closes a timer.
+ *
+ * @param timer_fd The timer descriptor.
+ */
+void event_loop_remove_timer(int timer_fd);
+
+/**
+ * @brief Waits for events once and dispatches them.
+ *
+ * @param timeout_ms Maximum time to wait in milliseconds, -1 to wait indefinitely.
+ * @return The number of events dispatched, or -1 on failure.
+ */
+int event_loop_run_once(int timeout_ms);
+
+/**
+ * @brief Dispatches events until event_loop_stop is called.
+ */
+void event_loop_run(void);
+
+/**
+ * @brief Makes event_loop_run return after the current dispatch.
+ */
+void event_loop_stop(void);
+
+/**
+ * @brief Dispatches events, with input sources paused, until a condition holds.
+ *
+ * @param done Predicate checked before every wait.
+ * @param arg Argument passed to the predicate.
+ */
+void event_loop_wait_until(bool (*done)(void* arg), void* arg);
+
+/**
+ * @brief Tells how many event_loop_wait_until calls are in progress.
+ *
+ * @return 0 when the loop is idle at the top level.
+ */
+int event_loop_depth(void);
+
+/**
+ * @brief Forgets the loop in a forked child, so the child neither touches the parent's epoll set nor waits
+ * on it.
+ */
+void event_loop_detach(void);
+
+#endif // EVENT_LOOP_H
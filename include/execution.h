@@ -18,16 +18,45 @@
 /**
  * @brief Executes a parsed command, handling internal, background, and external commands.
  *
+ * A foreground command prefixed with 'time' reports its wall time, CPU time, peak RSS, context switches and
+ * page faults on standard error when it finishes. A background one is accounted like any other job, in
+ * `jobs -v` and the session summary, and goes through the scheduler, which may queue it (see scheduler.h).
+ * A line prefixed with 'prio <nice>' runs at that nice value.
+ *
+ * @param parsed_cmd Pointer to the parsed command structure.
+ * @return The exit status of a foreground command, 0 for internal and background commands.
+ */
+int execute_command(ParsedCommand* parsed_cmd);
+
+/**
+ * @brief Executes a parsed command like execute_command, but starts a background one right away.
+ *
  * @param parsed_cmd Pointer to the parsed command structure.
+ * @return The exit status of a foreground command, 0 for internal and background commands.
  */
-void execute_command(ParsedCommand* parsed_cmd);
+int launch_command(ParsedCommand* parsed_cmd);
+
+/**
+ * @brief Parses and executes one line of input, then reports the background jobs that finished meanwhile.
+ *
+ * @param line The line; its newline, if any, is stripped in place.
+ * @return The exit status of the command, 0 for a blank line, 2 if the line does not parse.
+ */
+int execute_line(char* line);
 
 /**
  * @brief Executes a series of commands connected by pipes.
  *
+ * All stages are forked up front into a single process group so they run concurrently, and are reaped
+ * together once the last one has been started. Builtin stages of a foreground pipeline run in the shell
+ * itself once the external stages are running, with standard output swapped onto their pipe; background
+ * pipelines fork them instead. Foreground pipelines report their wall time and exit status; background
+ * pipelines are registered as a job under the group id.
+ *
  * @param parsed_cmd Pointer to the parsed command structure.
+ * @return The exit status of the last stage, or 0 for a background pipeline.
  */
-void execute_piped_commands(ParsedCommand* parsed_cmd);
+int execute_piped_commands(ParsedCommand* parsed_cmd);
 
 /**
  * @brief Handles the execution of internal shell commands.
@@ -37,18 +66,20 @@ void execute_piped_commands(ParsedCommand* parsed_cmd);
 void handle_internal_command(ParsedCommand* parsed_cmd);
 
 /**
- * @brief Redirects output to a specified file and stores the original stdout.
+ * @brief Applies a command's output ('>' or '>>') and error ('2>') redirections, storing the originals.
  *
- * @param output_file Path to the output file.
- * @param original_stdout Pointer to store the original stdout file descriptor.
+ * @param parsed_cmd Pointer to the parsed command structure.
+ * @param original_stdout Pointer to store the original stdout file descriptor, left untouched if unused.
+ * @param original_stderr Pointer to store the original stderr file descriptor, left untouched if unused.
  */
-void handle_file_redirection(const char* output_file, int* original_stdout);
+void handle_file_redirection(const ParsedCommand* parsed_cmd, int* original_stdout, int* original_stderr);
 
 /**
- * @brief Resets the file redirection to the original stdout.
+ * @brief Resets the file redirections to the original stdout and stderr.
  *
- * @param original_stdout The original stdout file descriptor.
+ * @param original_stdout The original stdout file descriptor, or -1.
+ * @param original_stderr The original stderr file descriptor, or -1.
  */
-void reset_file_redirection(int original_stdout);
+void reset_file_redirection(int original_stdout, int original_stderr);
 
 #endif // EXECUTION_H
@@ -14,27 +14,34 @@
 #ifndef GLOBALS_H
 #define GLOBALS_H
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /**< Exposes the Linux-specific process and descriptor APIs (pipe2, environ, ...). */
+#endif
+
+#include "arena.h"
 #include <cjson/cJSON.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <signal.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
-#define MAX_ARGS 64                               /**< Maximum number of arguments for a command. */
-#define MAX_PIPES 10                              /**< Maximum number of pipes supported. */
+#define MAX_ARGS 64                               /**< Capacity of the metric name tables. */
 #define INPUT_BUFFER_SIZE 1024                    /**< Size of the input buffer. */
 #define MAX_PATH 1024                             /**< Maximum path length. */
 #define BUFFER_SIZE 256                           /**< Size of a general buffer. */
-#define MAX_JOBS 100                              /**< Maximum number of concurrent jobs. */
+#define PLACEMENT_LABEL_SIZE 32                   /**< Bytes of a job's placement label, terminator included. */
 #define METRICS_FILE "/tmp/monitor_metrics"       /**< Path to the file where metrics are stored. */
 #define CONFIG_FILE "config.json"                 /**< Path to the configuration file. */
+#define DISCOVERY_TIMEOUT_MS 2000                 /**< How long startup metric discovery may take. */
 #define DEFAULT_INTERVAL 5                        /**< Default interval for monitoring. */
 #define FIFO_PATH "/tmp/monitor_fifo"             /**< Path to the FIFO used for inter-process communication. */
 #define MONITOR_PATH "./submodule/so_i_24_1v6n_2" /**< Path to the monitor executable. */
@@ -44,42 +51,137 @@
 #define COLOR_PROMPT "\x1b[32m"                   /**< Green color for the $ symbol*/
 #define COLOR_RESET "\x1b[0m"                     /**< Reset to default color*/
 
+/**
+ * @enum JobState
+ * @brief Lifecycle state of a job.
+ */
+typedef enum
+{
+    JOB_RUNNING, /**< At least one process of the job is still running. */
+    JOB_STOPPED, /**< Every process not reaped yet is stopped. */
+    JOB_DONE,    /**< Every process has exited and been reaped. */
+    JOB_QUEUED   /**< Waiting for the scheduler to start it; no process exists yet. */
+} JobState;
+
+/**
+ * @struct JobUsage
+ * @brief Resources used by the processes of a job, as reported by wait4 when each of them is reaped.
+ */
+typedef struct
+{
+    double wall_seconds;       /**< Time from launch until the last process was reaped. */
+    double user_seconds;       /**< User CPU time, children of the job's processes included. */
+    double system_seconds;     /**< System CPU time, children of the job's processes included. */
+    long max_rss_kb;           /**< Largest peak resident set size of any process, in KiB. */
+    long voluntary_switches;   /**< Context switches made while waiting for a resource. */
+    long involuntary_switches; /**< Context switches forced by the scheduler. */
+    long minor_faults;         /**< Page faults served without I/O. */
+    long major_faults;         /**< Page faults that needed I/O. */
+} JobUsage;
+
 /**
  * @struct Job
  * @brief Structure representing a job in the shell.
+ *
+ * A job is one command line: a single process or every stage of a pipeline. Slots in the job table are
+ * reused, and a job_id of 0 marks a free slot.
  */
-typedef struct
+typedef struct Job
 {
-    int job_id;                      /**< Job identifier. */
-    pid_t pid;                       /**< Process ID of the job. */
-    char command[INPUT_BUFFER_SIZE]; /**< Command string associated with the job. */
+    int job_id;                                       /**< Job identifier, 0 for a free slot. */
+    pid_t pid;                                        /**< Process ID of the job (the group leader for pipelines). */
+    pid_t pgid;                                       /**< Process group of the job, 0 if it shares the shell's. */
+    const char* command;                              /**< Interned command string associated with the job. */
+    pid_t* pids;                                      /**< Process IDs of every process in the job. */
+    int num_processes;                                /**< Number of entries in pids. */
+    int running_processes;                            /**< Processes not reaped yet. */
+    int stopped_processes;                            /**< Processes reported stopped and not continued since. */
+    int status;                                       /**< Wait status of the last process of the job. */
+    JobState state;                                   /**< Current state. */
+    bool is_background;                               /**< Whether the job is reported rather than waited for. */
+    bool stop_reported;                               /**< Whether the user was told the job stopped. */
+    bool scheduled;                                   /**< Whether the job counts against the scheduler's limit. */
+    char placement[PLACEMENT_LABEL_SIZE];             /**< CPUs or node the job was placed on, empty if none. */
+    struct timespec started;                          /**< When the job was registered. */
+    JobUsage usage;                                   /**< Resources used by the processes reaped so far. */
+    void (*on_complete)(struct Job* job, void* data); /**< Called when the job finishes, or NULL. */
+    void* on_complete_data;                           /**< Argument passed to on_complete. */
 } Job;
 
 /**
- * @brief Array of jobs representing active jobs.
+ * @brief Table of job slots, grown on demand.
  */
-extern Job jobs[MAX_JOBS]; /**< Array representing active jobs. */
+extern Job* jobs; /**< Table of job slots. */
 
 /**
  * @brief Number of active jobs.
  */
 extern int job_count; /**< Count of active jobs. */
 
+struct ParsedCommand;
+struct Placement;
+
 /**
- * @struct ParsedCommand
- * @brief Structure representing a parsed command.
+ * @brief Function running a builtin command.
+ */
+typedef void (*BuiltinHandler)(struct ParsedCommand* parsed_cmd);
+
+/**
+ * @enum BuiltinPipeMode
+ * @brief How a builtin runs as a stage of a pipeline.
+ */
+typedef enum
+{
+    BUILTIN_PIPE_IN_SHELL, /**< Only reports: a foreground pipeline runs it in the shell, writing into the pipe. */
+    BUILTIN_PIPE_FORKED,   /**< Runs in a forked copy of the shell, so its effects stay there. */
+    BUILTIN_PIPE_REFUSED   /**< Acts on the shell's jobs, monitor, settings or life, so it cannot be piped. */
+} BuiltinPipeMode;
+
+/**
+ * @struct CommandStage
+ * @brief Structure representing one command of a pipeline.
  */
 typedef struct
 {
-    char* command;          /**< Base command. */
-    char* args[MAX_ARGS];   /**< Arguments list. */
-    char* input_file;       /**< Input redirection file, if any. */
-    char* output_file;      /**< Output redirection file, if any. */
-    int is_background;      /**< Background execution flag. */
-    int is_piped;           /**< Piped command flag. */
-    int is_internal;        /**< Internal command flag. */
-    int num_pipes;          /**< Number of pipes. */
-    char* pipes[MAX_PIPES]; /**< Array of piped commands. */
+    char** args;               /**< NULL-terminated arguments list. */
+    int argc;                  /**< Number of arguments. */
+    char* input_file;          /**< Input redirection file, if any. */
+    char* output_file;         /**< Output redirection file, if any. */
+    int append_output;         /**< Whether output_file is appended to ('>>') rather than truncated. */
+    char* error_file;          /**< Standard error redirection file ('2>'), if any. */
+    int is_internal;           /**< Internal command flag. */
+    BuiltinHandler builtin;    /**< Handler of the stage's builtin, resolved by the parser; NULL otherwise. */
+    BuiltinPipeMode pipe_mode; /**< How the builtin runs when the stage is part of a pipeline. */
+} CommandStage;
+
+/**
+ * @struct ParsedCommand
+ * @brief Structure representing a parsed command line.
+ *
+ * Every pointer refers to memory in the arena the line was parsed into, so the whole structure is
+ * released at once by resetting that arena. The top-level command, args and redirection fields mirror
+ * the first stage (and the last stage's output), which is all a simple command needs.
+ */
+typedef struct ParsedCommand
+{
+    char* text;                        /**< The command line as typed, without the trailing '&'. */
+    char* command;                     /**< Base command. */
+    char** args;                       /**< Arguments list of the first stage. */
+    char* input_file;                  /**< Input redirection file of the first stage, if any. */
+    char* output_file;                 /**< Output redirection file of the last stage, if any. */
+    int append_output;                 /**< Whether output_file is opened for appending. */
+    char* error_file;                  /**< Standard error redirection file of the first stage, if any. */
+    int is_background;                 /**< Background execution flag. */
+    int is_piped;                      /**< Piped command flag. */
+    int is_internal;                   /**< Internal command flag. */
+    int is_timed;                      /**< Whether the line started with the 'time' keyword. */
+    int has_priority;                  /**< Whether the line started with the 'prio' keyword. */
+    int priority;                      /**< Nice value given after 'prio'. */
+    const struct Placement* placement; /**< Where to run, from 'pin' or the scheduler; NULL to inherit. */
+    BuiltinHandler builtin;            /**< Handler of the command's builtin, resolved by the parser; NULL otherwise. */
+    int num_pipes;                     /**< Number of pipes. */
+    CommandStage* stages;              /**< The num_pipes + 1 stages of the pipeline. */
+    Arena* arena;                      /**< Arena holding the parsed line. */
 } ParsedCommand;
 
 /**
@@ -88,18 +190,21 @@ typedef struct
  */
 typedef struct
 {
-    const char* command;             /**< Command name. */
-    void (*handler)(ParsedCommand*); /**< Handler function pointer. */
+    const char* command;       /**< Command name. */
+    BuiltinHandler handler;    /**< Handler function pointer. */
+    BuiltinPipeMode pipe_mode; /**< How it runs as a pipeline stage. */
 } CommandHandler;
 
-extern const char* fifo_path;    /**< Path to the FIFO for inter-process communication. */
-extern const char* monitor_path; /**< Path to the monitor executable. */
-extern cJSON* root;              /**< Root JSON object for configuration. */
-extern int interval;             /**< Interval for monitoring updates. */
-extern char* metrics[MAX_ARGS];  /**< Array of metric names. */
-extern size_t num_metrics;       /**< Number of selected metrics. */
-extern pid_t foreground_pid;     /**< Process ID of the foreground process. */
-extern Job jobs[MAX_JOBS];       /**< Array representing the active jobs. */
-extern int job_count;            /**< Count of active jobs. */
+extern const char* fifo_path;        /**< Path to the FIFO for inter-process communication. */
+extern const char* monitor_path;     /**< Path to the monitor executable. */
+extern cJSON* root;                  /**< Root JSON object for configuration. */
+extern int interval;                 /**< Interval for monitoring updates. */
+extern char* metrics[MAX_ARGS];      /**< Array of metric names. */
+extern size_t num_metrics;           /**< Number of selected metrics. */
+extern pid_t foreground_pgid;        /**< Process group ID of the foreground job. */
+extern unsigned int interrupt_count; /**< Number of SIGINTs the shell has received. */
+extern Job* jobs;                    /**< Table of job slots. */
+extern size_t job_capacity;          /**< Number of slots in the job table. */
+extern int job_count;                /**< Count of active jobs. */
 
 #endif // GLOBALS_H
@@ -17,17 +17,217 @@
 #include "global.h"
 
 /**
- * @brief Adds a new job to the job list.
+ * @brief Reaps every exited child, and notes stopped and continued ones, in the job each belongs to.
+ *
+ * Called when the event loop's signalfd reports SIGCHLD. Lookups go through a PID index, so the cost per
+ * child does not depend on the number of jobs. Queued background jobs are then started in the scheduler
+ * slots that freed up.
+ */
+void reap_children(void);
+
+/**
+ * @brief Registers a job made of one or more processes.
+ *
+ * Children are only reaped from the event loop or from wait_for_job, so registering right after the
+ * launch cannot miss an early exit. The returned pointer is valid until the job is removed or another
+ * job is created.
+ *
+ * @param pids Process IDs of the job; the first one is used as the job's PID.
+ * @param num_processes Number of processes.
+ * @param command The command string associated with the job.
+ * @param is_background Whether the job runs in the background.
+ * @return The new job, or NULL if it could not be tracked.
+ */
+Job* create_job(const pid_t* pids, int num_processes, const char* command, bool is_background);
+
+/**
+ * @brief Adds a new single-process background job to the job list.
  *
  * @param pid The process ID of the new job.
  * @param command The command string associated with the job.
+ * @return The new job, or NULL if it could not be tracked.
+ */
+Job* add_job(pid_t pid, const char* command);
+
+/**
+ * @brief Registers a background job that has no process yet, for the scheduler to start later.
+ *
+ * @param command The command string associated with the job.
+ * @return The new job, in the JOB_QUEUED state, or NULL if it could not be tracked.
+ */
+Job* create_queued_job(const char* command);
+
+/**
+ * @brief Makes the next create_job call start a queued job in its own slot, keeping its ID, instead of
+ * taking a new one. The job then counts against the scheduler's limit.
+ *
+ * @param job The queued job, or NULL to cancel a reservation the launch did not use.
+ */
+void job_reserve_slot(const Job* job);
+
+/**
+ * @brief Sets the nice value of every process of a job, through its process group when it has one.
+ *
+ * @param job The job.
+ * @param nice The nice value, from -20 to 19; lowering it needs CAP_SYS_NICE.
+ * @return 0 on success, -1 on failure with errno set.
+ */
+int set_job_priority(const Job* job, int nice);
+
+/**
+ * @brief Registers a callback to run as soon as every process of a job has been reaped.
+ *
+ * The callback runs from the reaper, typically inside the event loop, and the job is removed right after
+ * it returns, so such a job must not also be passed to wait_for_job.
+ *
+ * @param job The job to watch.
+ * @param callback Function called with the finished job; its status is still available.
+ * @param data Argument passed to the callback.
+ */
+void job_on_complete(Job* job, void (*callback)(Job* job, void* data), void* data);
+
+/**
+ * @brief Finds the job a process belongs to.
+ *
+ * @param pid The process ID to look up.
+ * @return The job, or NULL if the process is not part of a running job.
+ */
+Job* find_job_by_pid(pid_t pid);
+
+/**
+ * @brief Removes a job from the job list, releasing its slot.
+ *
+ * @param job The job to remove.
+ */
+void remove_job(Job* job);
+
+/**
+ * @brief Reaps children into the job table until a condition holds.
+ *
+ * With the event loop running, signals, timers and monitor events keep being served meanwhile; without
+ * it (e.g. in the unit tests) children are reaped with a blocking waitpid.
+ *
+ * @param done Predicate checked after every reaped child, typically on the state of some jobs.
+ * @param arg Argument passed to the predicate.
+ */
+void wait_for_jobs_until(bool (*done)(void* arg), void* arg);
+
+/**
+ * @brief Waits until every process of a job has exited, then removes the job.
+ *
+ * If the job stops instead, it is kept as a stopped background job and reported as such.
+ *
+ * @param job The job to wait for.
+ * @return The exit status of the job's last process, or 128 plus the stop signal if it stopped.
+ */
+int wait_for_job(Job* job);
+
+/**
+ * @brief Puts the shell in its own process group in control of the terminal, if standard input is one.
+ *
+ * Every job then runs in a process group of its own, which is handed the terminal while it runs in the
+ * foreground, so Ctrl-C and Ctrl-Z reach the whole job directly. Without a terminal, job control stays
+ * off and the shell forwards the signals it receives to the foreground job instead.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int init_job_control(void);
+
+/**
+ * @brief Sends a signal to every process of a job, through its process group when it has one.
+ *
+ * @param job The job to signal.
+ * @param sig The signal number.
+ * @return 0 on success, -1 on failure.
+ */
+int signal_job(const Job* job, int sig);
+
+/**
+ * @brief Makes a process group the terminal's foreground group, when the shell has job control.
+ *
+ * @param pgid The process group; nothing is done if it is not positive.
+ */
+void give_terminal_to(pid_t pgid);
+
+/**
+ * @brief Hands the terminal to a job and waits for it to finish or stop, then takes the terminal back.
+ *
+ * A job that stops stays in the job table as a stopped background job.
+ *
+ * @param job The job to run in the foreground.
+ * @param resume Whether to continue the job first if it is stopped.
+ * @param usage Receives the resources the job used, up to the stop if it stopped, or NULL.
+ * @return The exit status of the job, or 128 plus the stop signal if it stopped.
+ */
+int run_job_in_foreground(Job* job, bool resume, JobUsage* usage);
+
+/**
+ * @brief Lets a job run on in the background, continuing it if it is stopped.
+ *
+ * @param job The job to continue.
+ */
+void continue_job_in_background(Job* job);
+
+/**
+ * @brief Finds a job from a job specification.
+ *
+ * @param spec "%n" for job n, "%+", "%%" or NULL for the current job, or a process ID.
+ * @return The job, or NULL if there is no such job.
  */
-void add_job(pid_t pid, char* command);
+Job* find_job(const char* spec);
 
 /**
- * @brief Reaps completed background jobs and removes them from the job list.
+ * @brief Returns the name of a job's state as shown by the jobs builtin.
+ *
+ * @param job The job.
+ * @return "Running", "Stopped", "Queued" or "Done".
+ */
+const char* job_state_name(const Job* job);
+
+/**
+ * @brief Tells whether a job is the current job, the one fg and bg act on by default.
+ *
+ * @param job The job.
+ * @return true if the job is the current job.
+ */
+bool job_is_current(const Job* job);
+
+/**
+ * @brief Prints a resource usage line to standard error.
+ *
+ * @param label Label printed in brackets at the start of the line, e.g. "Time".
+ * @param usage The usage to print.
+ */
+void print_job_usage(const char* label, const JobUsage* usage);
+
+/**
+ * @brief Returns the resources a job has used so far, with the wall time up to now for a running job.
+ *
+ * CPU time, faults and switches are only known for processes already reaped, as the kernel reports them
+ * when a process is waited for.
+ *
+ * @param job The job.
+ * @param usage Receives the usage.
+ */
+void job_usage_so_far(const Job* job, JobUsage* usage);
+
+/**
+ * @brief Prints the usage of the last finished jobs, oldest first.
+ */
+void print_job_history(void);
+
+/**
+ * @brief Prints the resources used by every job of the session, and the jobs that used the most CPU, to
+ * standard error. Prints nothing if no job has finished.
+ */
+void print_session_summary(void);
+
+/**
+ * @brief Reports completed background jobs and removes them from the job list, and reports newly stopped jobs.
+ *
+ * @return The number of jobs reported.
  */
-void reap_completed_jobs(void);
+int reap_completed_jobs(void);
 
 /**
  * @brief Cleans up all active jobs by terminating them and exits the program.
@@ -0,0 +1,139 @@
+/**
+ * @file metrics_shm.h
+ * @brief Shared-memory ring buffer the monitor publishes its samples into.
+ *
+ * The shell creates the ring with shm_open, unlinks it at once and hands the descriptor to the monitor
+ * in the MONITOR_METRICS_FD environment variable. The monitor is the only writer; readers copy records
+ * out without locks and retry when the ring's sequence counter shows they raced with a write (a seqlock).
+ * Like monitor_protocol.h, this header only depends on the C library so the monitor can include it.
+ *
+ * @date 17/10/2026
+ * @author 1v6n
+ */
+
+#ifndef METRICS_SHM_H
+#define METRICS_SHM_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define METRICS_SHM_ENV "MONITOR_METRICS_FD" /**< Environment variable naming the ring's descriptor. */
+#define METRICS_RING_MAGIC 0x4d455452u       /**< "METR", marks an initialized ring. */
+#define METRICS_RING_CAPACITY 4096           /**< Records kept in the ring; a power of two. */
+#define METRICS_MAX_NAMES 64                 /**< Metrics a ring can name. */
+#define METRICS_NAME_SIZE 48                 /**< Bytes per metric name, terminator included. */
+
+/**
+ * @struct MetricRecord
+ * @brief One sample of one metric.
+ */
+typedef struct
+{
+    uint64_t timestamp_ns; /**< CLOCK_REALTIME time of the sample, in nanoseconds. */
+    uint32_t metric_id;    /**< Index of the metric in the ring's name table. */
+    uint32_t reserved;     /**< Padding, always 0. */
+    double value;          /**< The sampled value. */
+} MetricRecord;
+
+/**
+ * @struct MetricsRing
+ * @brief Fixed layout of the shared mapping.
+ */
+typedef struct
+{
+    uint32_t magic;                                       /**< METRICS_RING_MAGIC once initialized. */
+    uint32_t num_names;                                   /**< Entries used in names. */
+    _Atomic uint64_t sequence;                            /**< Seqlock counter, odd while a write is in progress. */
+    uint64_t head;                                        /**< Records written since creation. */
+    char names[METRICS_MAX_NAMES][METRICS_NAME_SIZE];     /**< Metric names, indexed by metric_id. */
+    MetricRecord latest[METRICS_MAX_NAMES];               /**< Last sample of every metric. */
+    MetricRecord records[METRICS_RING_CAPACITY];          /**< The ring itself, slot head % capacity is next. */
+} MetricsRing;
+
+/**
+ * @struct MetricsSnapshot
+ * @brief A consistent copy of a ring's name table and latest samples.
+ */
+typedef struct
+{
+    uint32_t num_names;                               /**< Entries used in names and latest. */
+    uint64_t head;                                    /**< Records written when the copy was taken. */
+    char names[METRICS_MAX_NAMES][METRICS_NAME_SIZE]; /**< Metric names. */
+    MetricRecord latest[METRICS_MAX_NAMES];           /**< Last sample of every metric; timestamp 0 if none. */
+} MetricsSnapshot;
+
+/**
+ * @brief Creates an anonymous ring: the shared memory object is unlinked as soon as it is mapped.
+ *
+ * @param fd Where to store the descriptor to hand to the writer; it is close-on-exec.
+ * @return The read-write mapping, or NULL on failure.
+ */
+MetricsRing* metrics_ring_create(int* fd);
+
+/**
+ * @brief Maps a ring created by another process, for writing.
+ *
+ * @param fd Descriptor received from the creator.
+ * @return The mapping, or NULL on failure.
+ */
+MetricsRing* metrics_ring_attach(int fd);
+
+/**
+ * @brief Unmaps a ring.
+ *
+ * @param ring The mapping to release; NULL is ignored.
+ */
+void metrics_ring_unmap(MetricsRing* ring);
+
+/**
+ * @brief Replaces the name table (writer only) and forgets the latest samples.
+ *
+ * @param ring The ring.
+ * @param list Comma-separated metric names; blanks around names are skipped.
+ */
+void metrics_ring_set_names(MetricsRing* ring, const char* list);
+
+/**
+ * @brief Appends samples to the ring in one write section (writer only).
+ *
+ * @param ring The ring.
+ * @param records The samples; records with an unknown metric_id are skipped.
+ * @param count Number of samples.
+ */
+void metrics_ring_publish(MetricsRing* ring, const MetricRecord* records, size_t count);
+
+/**
+ * @brief Copies the name table and latest samples.
+ *
+ * @param ring The ring.
+ * @param snapshot Where to store the copy.
+ * @return 0 on success, -1 if the writer kept the ring busy.
+ */
+int metrics_ring_snapshot(const MetricsRing* ring, MetricsSnapshot* snapshot);
+
+/**
+ * @brief Copies the most recent samples, oldest first.
+ *
+ * @param ring The ring.
+ * @param records Where to store the samples.
+ * @param count Maximum number of samples to copy.
+ * @return The number of samples copied, -1 if the writer kept the ring busy.
+ */
+ssize_t metrics_ring_last(const MetricsRing* ring, MetricRecord* records, size_t count);
+
+/**
+ * @brief Copies the samples written since a cursor, oldest first, and advances the cursor past them.
+ *
+ * Samples the writer has already overwritten are skipped.
+ *
+ * @param ring The ring.
+ * @param cursor Number of records already consumed; start at 0.
+ * @param records Where to store the samples.
+ * @param count Maximum number of samples to copy.
+ * @return The number of samples copied, -1 if the writer kept the ring busy; the cursor is then unchanged.
+ */
+ssize_t metrics_ring_since(const MetricsRing* ring, uint64_t* cursor, MetricRecord* records, size_t count);
+
+#endif // METRICS_SHM_H
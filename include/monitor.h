@@ -0,0 +1,85 @@
+/**
+ * @file monitor.h
+ * @brief Header file for supervising the monitor process.
+ *
+ * This header file declares the functions that start the monitor as a child of the shell, talk to it
+ * over its control socket (see monitor_protocol.h), and stop it. The monitor is tracked as a job, so its
+ * exit is reaped and reported like any other background job.
+ *
+ * @date 17/10/2026
+ * @author 1v6n
+ */
+
+#ifndef MONITOR_H
+#define MONITOR_H
+
+#include "global.h"
+#include "metrics_shm.h"
+#include "monitor_protocol.h"
+
+/**
+ * @brief Starts the monitor as a supervised child holding one end of a control socket.
+ *
+ * The child also inherits the metrics ring, created on the first start, and finds both descriptors in
+ * its environment (MONITOR_CONTROL_FD and MONITOR_METRICS_FD). If path is not executable, the shell's
+ * built-in sampler publishes into the ring instead, and the other monitor functions drive it in-process.
+ *
+ * @param path Path of the monitor executable.
+ * @return 0 on success, -1 on failure or if a monitor is already running.
+ */
+int monitor_start(const char* path);
+
+/**
+ * @brief Tells whether the supervised monitor is still running.
+ *
+ * @return true if the monitor is running.
+ */
+bool monitor_running(void);
+
+/**
+ * @brief Returns the PID of the supervised monitor.
+ *
+ * @return The monitor's PID, the shell's own for the built-in sampler, or -1 if none was started.
+ */
+pid_t monitor_pid(void);
+
+/**
+ * @brief Tells whether the running monitor is the shell's built-in /proc sampler.
+ *
+ * @return true if the built-in sampler is running.
+ */
+bool monitor_is_builtin(void);
+
+/**
+ * @brief Returns the ring the monitor publishes its samples into.
+ *
+ * @return The read-write mapping of the ring, or NULL if no monitor was ever started.
+ */
+const MetricsRing* monitor_metrics(void);
+
+/**
+ * @brief Adds the samples published since the last call to the time series of their metrics.
+ *
+ * Runs every second while a monitor is running, and before anything reads the series.
+ */
+void monitor_collect(void);
+
+/**
+ * @brief Sends a request to the monitor and waits briefly for its reply.
+ *
+ * @param type The request type.
+ * @param value Numeric argument of the request.
+ * @param payload Text argument of the request, or NULL.
+ * @param reply Where to store the reply, or NULL if only success matters.
+ * @return 0 if the monitor applied the request, -1 otherwise.
+ */
+int monitor_request(MonitorMessageType type, uint32_t value, const char* payload, MonitorMessage* reply);
+
+/**
+ * @brief Asks the monitor to exit, interrupting it if it does not, and reaps it.
+ *
+ * @return 0 on success, -1 if no monitor was running.
+ */
+int monitor_stop(void);
+
+#endif // MONITOR_H
@@ -0,0 +1,51 @@
+/**
+ * @file monitor_channel.h
+ * @brief Header file for the event-driven channels between the shell and the monitor.
+ *
+ * This header file declares the inotify-based watches the shell keeps on the monitor's FIFO and status
+ * file. Writing to the FIFO no longer needs a forked writer blocked in open(): the shell opens the FIFO
+ * itself, queues the data, and lets go of it once inotify reports that the monitor has opened the other
+ * end. Status file updates are noticed as they happen instead of on the next command.
+ *
+ * @date 17/10/2026
+ * @author 1v6n
+ */
+
+#ifndef MONITOR_CHANNEL_H
+#define MONITOR_CHANNEL_H
+
+#include "global.h"
+#include <time.h>
+
+/**
+ * @brief Creates the inotify instance, registers it with the event loop and watches the status file.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int monitor_channel_init(void);
+
+/**
+ * @brief Queues data in a FIFO for the next process that opens it for reading.
+ *
+ * The FIFO is opened read-write so the call never blocks; it is closed, leaving the data to the reader,
+ * as soon as the event loop sees the reader's open. Only one send can be pending at a time.
+ *
+ * @param path Path of the FIFO.
+ * @param data The bytes to write; must fit in the pipe buffer.
+ * @return 0 on success, -1 on failure.
+ */
+int monitor_fifo_send(const char* path, const char* data);
+
+/**
+ * @brief Drops a pending FIFO send whose reader never showed up.
+ */
+void monitor_fifo_cancel(void);
+
+/**
+ * @brief Tells when the monitor last rewrote its status file.
+ *
+ * @return The time of the last update seen by the shell, or 0 if none was seen.
+ */
+time_t monitor_status_updated(void);
+
+#endif // MONITOR_CHANNEL_H
@@ -0,0 +1,49 @@
+/**
+ * @file monitor_protocol.h
+ * @brief Wire format of the control channel between the shell and the monitor.
+ *
+ * The shell starts the monitor with one end of a SOCK_SEQPACKET socket pair and passes its descriptor
+ * number in the MONITOR_CONTROL_FD environment variable. Every packet carries exactly one MonitorMessage;
+ * the monitor answers each request with MONITOR_MSG_ACK, MONITOR_MSG_ERROR or, for a snapshot, a
+ * MONITOR_MSG_SNAPSHOT packet holding the current readings as text.
+ *
+ * @date 17/10/2026
+ * @author 1v6n
+ */
+
+#ifndef MONITOR_PROTOCOL_H
+#define MONITOR_PROTOCOL_H
+
+#include <stdint.h>
+
+#define MONITOR_CONTROL_ENV "MONITOR_CONTROL_FD" /**< Environment variable naming the monitor's socket. */
+#define MONITOR_PAYLOAD_SIZE 4096                 /**< Maximum payload of a message, terminator included. */
+
+/**
+ * @enum MonitorMessageType
+ * @brief Kinds of messages exchanged over the control socket.
+ */
+typedef enum
+{
+    MONITOR_MSG_SET_INTERVAL = 1, /**< Request: sample every `value` seconds. */
+    MONITOR_MSG_SET_METRICS,      /**< Request: collect the comma-separated metrics in `payload`. */
+    MONITOR_MSG_SNAPSHOT,         /**< Request for, and reply with, the current readings. */
+    MONITOR_MSG_STOP,             /**< Request: acknowledge and exit. */
+    MONITOR_MSG_ACK,              /**< Reply: the request was applied. */
+    MONITOR_MSG_ERROR             /**< Reply: the request was rejected; `payload` says why. */
+} MonitorMessageType;
+
+/**
+ * @struct MonitorMessage
+ * @brief One packet of the control protocol.
+ *
+ * Only the bytes up to and including the payload's terminator are sent.
+ */
+typedef struct
+{
+    uint32_t type;                       /**< A MonitorMessageType. */
+    uint32_t value;                      /**< Numeric argument, e.g. the interval in seconds. */
+    char payload[MONITOR_PAYLOAD_SIZE];  /**< NUL-terminated text argument or reply. */
+} MonitorMessage;
+
+#endif // MONITOR_PROTOCOL_H
@@ -0,0 +1,36 @@
+/**
+ * @file perfect_hash.h
+ * @brief Seeded string hash shared by the builtin table generator and the shell.
+ *
+ * The generator in tools/ searches for a seed under which every builtin name lands in its own slot, and
+ * the shell hashes command names with the same function and seed, so both must use this definition.
+ *
+ * @date 17/10/2026
+ * @author 1v6n
+ */
+
+#ifndef PERFECT_HASH_H
+#define PERFECT_HASH_H
+
+#include <stdint.h>
+
+/**
+ * @brief Computes the 32-bit FNV-1a hash of a string, starting from a seed mixed into the offset basis.
+ *
+ * @param str The NUL-terminated string to hash.
+ * @param seed The seed chosen by the generator.
+ * @return The hash value.
+ */
+static inline uint32_t perfect_hash(const char* str, uint32_t seed)
+{
+    uint32_t hash = 2166136261u ^ (seed * 2654435761u);
+    for (const unsigned char* p = (const unsigned char*)str; *p; p++)
+    {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+    hash ^= hash >> 15;
+    return hash;
+}
+
+#endif // PERFECT_HASH_H
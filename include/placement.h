@@ -0,0 +1,86 @@
+/**
+ * @file placement.h
+ * @brief Header file for the CPU and NUMA placement of launched jobs.
+ *
+ * This header file declares how a job is confined to a set of CPUs and, optionally, has its memory
+ * preferred from one NUMA node. A placement comes either from a 'pin <cpus>' prefix on the command line
+ * or from the scheduler spreading background jobs round-robin over cores or nodes. It is applied in the
+ * child between fork and exec with sched_setaffinity and set_mempolicy, both of which the program then
+ * inherits, and shown next to the job by `jobs`. The topology is read once from sysfs and limited to the
+ * CPUs the shell itself may run on.
+ *
+ * @date 17/10/2026
+ * @author 1v6n
+ */
+
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include "global.h"
+#include <sched.h>
+
+#define PLACEMENT_MAX_NODES 64 /**< NUMA nodes considered when spreading; higher node IDs are ignored. */
+
+/**
+ * @enum PlacementSpread
+ * @brief How the scheduler places background jobs that were not pinned.
+ */
+typedef enum
+{
+    PLACEMENT_SPREAD_OFF,   /**< Jobs inherit the shell's affinity. */
+    PLACEMENT_SPREAD_CORES, /**< Each job gets the next CPU. */
+    PLACEMENT_SPREAD_NODES  /**< Each job gets the CPUs of the next NUMA node, and prefers its memory. */
+} PlacementSpread;
+
+/**
+ * @struct Placement
+ * @brief Where a job runs.
+ */
+typedef struct Placement
+{
+    cpu_set_t cpus;                   /**< CPUs the job may run on. */
+    int node;                         /**< NUMA node memory is preferred from, or -1 to leave the policy alone. */
+    char label[PLACEMENT_LABEL_SIZE]; /**< How `jobs` shows the placement, e.g. "cpus 0-7" or "node 1". */
+} Placement;
+
+/**
+ * @brief Parses a CPU list such as "0-7,16,18-19" into a placement.
+ *
+ * The list is reduced to the CPUs the shell may run on, and the label shows what is left, as "cpus 0-3,8"
+ * cut short with "..." if it does not fit. A malformed list, or one naming none of those CPUs, is reported
+ * on standard error.
+ *
+ * @param list The CPU list.
+ * @param placement Receives the CPUs, no memory node and the label.
+ * @return 0 on success, -1 if the list is malformed or names no CPU the shell may run on.
+ */
+int placement_parse(const char* list, Placement* placement);
+
+/**
+ * @brief Picks the next core or node, round-robin, for a job the scheduler is spreading.
+ *
+ * @param spread PLACEMENT_SPREAD_CORES or PLACEMENT_SPREAD_NODES.
+ * @param placement Receives the placement.
+ * @return 0 on success, -1 if spreading is off or the shell's affinity cannot be read.
+ */
+int placement_next(PlacementSpread spread, Placement* placement);
+
+/**
+ * @brief Applies a placement to the calling process; meant for a child right before exec.
+ *
+ * A memory policy the kernel refuses is reported and left out, as it only affects where pages come from.
+ *
+ * @param placement The placement.
+ * @return 0 on success, -1 if the affinity could not be set.
+ */
+int placement_apply(const Placement* placement);
+
+/**
+ * @brief Returns the name of a spread mode as used by the sched builtin.
+ *
+ * @param spread The mode.
+ * @return "off", "cores" or "nodes".
+ */
+const char* placement_spread_name(PlacementSpread spread);
+
+#endif // PLACEMENT_H
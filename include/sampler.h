@@ -0,0 +1,89 @@
+/**
+ * @file sampler.h
+ * @brief Header file for the shell's built-in /proc metrics sampler.
+ *
+ * This header file declares the sampler the shell falls back to when the external monitor binary is
+ * missing. It reads /proc/stat, /proc/meminfo, /proc/diskstats and /proc/net/dev through descriptors opened
+ * once and re-read with pread from offset 0, parses them with a small numeric scanner instead of stdio,
+ * and publishes into the same metrics ring the external monitor writes, so status_monitor and the other
+ * monitor commands work the same with either engine. Only the files the selected metrics need are read,
+ * and rates are computed from the difference between two samples.
+ *
+ * @date 17/10/2026
+ * @author 1v6n
+ */
+
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include "metrics_shm.h"
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define SAMPLER_MAX_INTERVAL (INT_MAX / 1000) /**< Longest interval in seconds whose milliseconds fit an int. */
+
+/**
+ * @brief Starts sampling into a ring every interval, from the event loop.
+ *
+ * No metric is selected until sampler_set_metrics is called.
+ *
+ * @param ring The ring to publish into; the sampler becomes its only writer.
+ * @param interval_seconds Seconds between samples, from 1 to SAMPLER_MAX_INTERVAL.
+ * @return 0 on success, -1 on failure or if the interval is out of range.
+ */
+int sampler_start(MetricsRing* ring, int interval_seconds);
+
+/**
+ * @brief Tells whether the sampler has been started and not stopped.
+ *
+ * @return true if the sampler is running.
+ */
+bool sampler_running(void);
+
+/**
+ * @brief Changes the time between samples.
+ *
+ * @param interval_seconds Seconds between samples, from 1 to SAMPLER_MAX_INTERVAL.
+ * @return 0 on success, -1 if the interval is invalid.
+ */
+int sampler_set_interval(int interval_seconds);
+
+/**
+ * @brief Selects the metrics to sample, replacing the ring's name table.
+ *
+ * @param list Comma-separated metric names, as sent to the external monitor.
+ * @param error Receives the reason on failure.
+ * @param error_size Size of the error buffer.
+ * @return 0 on success, -1 if a name is unknown, in which case the selection is left unchanged.
+ */
+int sampler_set_metrics(const char* list, char* error, size_t error_size);
+
+/**
+ * @brief Takes one sample of the selected metrics and publishes it. Rates are 0 on the first sample.
+ *
+ * @return The number of records published, -1 if the sampler is not running.
+ */
+int sampler_sample(void);
+
+/**
+ * @brief Stops sampling and closes the /proc descriptors. The ring is left as it is.
+ */
+void sampler_stop(void);
+
+/**
+ * @brief Returns the number of metrics the sampler knows.
+ *
+ * @return The number of metrics.
+ */
+size_t sampler_metric_count(void);
+
+/**
+ * @brief Returns the name of one of the sampler's metrics.
+ *
+ * @param index Index of the metric, below sampler_metric_count().
+ * @return The metric's name.
+ */
+const char* sampler_metric_name(size_t index);
+
+#endif // SAMPLER_H
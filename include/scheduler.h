@@ -0,0 +1,96 @@
+/**
+ * @file scheduler.h
+ * @brief Header file for the shell's background job scheduler.
+ *
+ * This header file declares the queue every background command line goes through. With no limit set, a
+ * line ending in '&' starts right away as it always did. With a limit, at most that many scheduled jobs
+ * run at once: the others are listed by `jobs` as Queued under their own job ID, with a copy of the
+ * parsed line kept in an arena of their own, and start as running jobs finish or stop. A job's 'prio'
+ * nice value decides which queued job starts first, and is applied to its processes once it runs. The
+ * scheduler can also spread the jobs it starts round-robin over cores or NUMA nodes (see placement.h),
+ * leaving alone those pinned with 'pin'.
+ *
+ * @date 17/10/2026
+ * @author 1v6n
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "global.h"
+#include "placement.h"
+
+/**
+ * @brief Starts a background command line, or queues it if the limit of running jobs is reached.
+ *
+ * @param parsed_cmd The parsed line; it is copied if queued, so the caller may release it afterwards.
+ * @return The status of the launch, 0 if the line was queued, 1 if it could not be tracked.
+ */
+int scheduler_submit(ParsedCommand* parsed_cmd);
+
+/**
+ * @brief Starts queued jobs, lowest nice value first and in submission order otherwise, while fewer
+ * than the limit of scheduled jobs are running.
+ *
+ * Called by the reaper whenever a child changed state; does nothing while already starting a job.
+ */
+void scheduler_pump(void);
+
+/**
+ * @brief Starts a queued job right away, regardless of the limit, as fg and bg do.
+ *
+ * @param job The queued job; on success it is the started job, in the same slot.
+ * @return 0 on success, -1 if the job could not be started, in which case it is removed.
+ */
+int scheduler_start(Job* job);
+
+/**
+ * @brief Drops a queued job without ever starting it.
+ *
+ * @param job The queued job; it is removed.
+ */
+void scheduler_cancel(Job* job);
+
+/**
+ * @brief Sets how many scheduled jobs may run at once, and starts queued jobs if that allows more.
+ *
+ * @param limit Maximum number of running jobs, 0 for no limit.
+ */
+void scheduler_set_limit(size_t limit);
+
+/**
+ * @brief Sets how the jobs started from then on are placed.
+ *
+ * @param spread PLACEMENT_SPREAD_OFF to let them inherit the shell's affinity, or the unit to spread over.
+ */
+void scheduler_set_spread(PlacementSpread spread);
+
+/**
+ * @brief Returns how started jobs are placed.
+ *
+ * @return The spread mode.
+ */
+PlacementSpread scheduler_spread(void);
+
+/**
+ * @brief Returns the maximum number of scheduled jobs running at once.
+ *
+ * @return The limit, 0 if there is none.
+ */
+size_t scheduler_limit(void);
+
+/**
+ * @brief Counts the scheduled jobs currently running.
+ *
+ * @return The number of running jobs that count against the limit.
+ */
+size_t scheduler_running(void);
+
+/**
+ * @brief Counts the jobs waiting in the queue.
+ *
+ * @return The number of queued jobs.
+ */
+size_t scheduler_queued(void);
+
+#endif // SCHEDULER_H
@@ -0,0 +1,118 @@
+/**
+ * @file series.h
+ * @brief Header file for the shell's in-memory time series of monitored metrics.
+ *
+ * This header file declares a store with one series per metric name. Every series keeps its last
+ * SERIES_RAW_CAPACITY samples in a ring, and rolls every sample up into per-minute and per-hour
+ * min/max/avg buckets kept in two more rings, so an hour of samples at one per second stays exact while a
+ * day and a month remain available at coarser resolution. Samples arrive in time order, so a query is a
+ * binary search over one ring, and nothing is allocated once a series exists.
+ *
+ * The store can be saved to a compact binary file and loaded back, which the shell does on quit and
+ * startup when SERIES_FILE_ENV names a file.
+ *
+ * @date 17/10/2026
+ * @author 1v6n
+ */
+
+#ifndef SERIES_H
+#define SERIES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SERIES_RAW_CAPACITY 4096                /**< Raw samples kept per metric. */
+#define SERIES_MINUTE_CAPACITY 1440             /**< Per-minute buckets kept per metric, a day. */
+#define SERIES_HOUR_CAPACITY 720                /**< Per-hour buckets kept per metric, thirty days. */
+#define SERIES_MAX 64                           /**< Metrics the store can hold. */
+#define SERIES_NAME_SIZE 48                     /**< Bytes per metric name, terminator included. */
+#define SERIES_FILE_ENV "SHELL_METRICS_HISTORY" /**< Environment variable naming the file to persist to. */
+
+/**
+ * @enum SeriesTier
+ * @brief Resolutions a series is kept at, finest first.
+ */
+typedef enum
+{
+    SERIES_RAW,    /**< Every sample. */
+    SERIES_MINUTE, /**< One bucket per minute. */
+    SERIES_HOUR,   /**< One bucket per hour. */
+    SERIES_TIER_COUNT
+} SeriesTier;
+
+/**
+ * @struct SeriesBucket
+ * @brief Aggregate of the samples in one interval; a raw sample is a bucket of one.
+ */
+typedef struct
+{
+    uint64_t start_ns; /**< CLOCK_REALTIME start of the interval, or time of the raw sample. */
+    double min;        /**< Smallest sample. */
+    double max;        /**< Largest sample. */
+    double sum;        /**< Sum of the samples, for the average. */
+    uint32_t count;    /**< Number of samples. */
+} SeriesBucket;
+
+/**
+ * @brief Adds a sample to a metric's series, creating the series on its first sample.
+ *
+ * @param metric Name of the metric.
+ * @param timestamp_ns CLOCK_REALTIME time of the sample, in nanoseconds.
+ * @param value The sample.
+ * @return 0 on success, -1 if the sample is older than the series' last one or the store is full.
+ */
+int series_add(const char* metric, uint64_t timestamp_ns, double value);
+
+/**
+ * @brief Copies a metric's buckets that overlap a time range, oldest first.
+ *
+ * The finest tier that still covers the start of the range is used, but never one finer than the range
+ * calls for: raw samples up to an hour, minutes up to a day, hours beyond.
+ *
+ * @param metric Name of the metric.
+ * @param since_ns Start of the range; the range ends at the newest sample.
+ * @param tier Receives the tier the buckets come from.
+ * @param buckets Where to store the buckets.
+ * @param capacity Maximum number of buckets to copy; the newest are kept.
+ * @return The number of buckets copied, -1 if the metric has no series.
+ */
+long series_query(const char* metric, uint64_t since_ns, SeriesTier* tier, SeriesBucket* buckets, size_t capacity);
+
+/**
+ * @brief Returns the number of metrics with a series.
+ *
+ * @return The number of series.
+ */
+size_t series_count(void);
+
+/**
+ * @brief Describes one series.
+ *
+ * @param index Index of the series, below series_count().
+ * @param samples Receives the number of samples ever added, loaded ones included.
+ * @return The metric's name.
+ */
+const char* series_name(size_t index, uint64_t* samples);
+
+/**
+ * @brief Drops every series.
+ */
+void series_clear(void);
+
+/**
+ * @brief Writes the store to a file, through a temporary file renamed over it.
+ *
+ * @param path The file; NULL does nothing.
+ * @return 0 on success or if there was nothing to do, -1 on failure.
+ */
+int series_save(const char* path);
+
+/**
+ * @brief Replaces the store with the contents of a file written by series_save.
+ *
+ * @param path The file; NULL or a missing file does nothing.
+ * @return 0 on success or if there was nothing to do, -1 if the file is unreadable or malformed.
+ */
+int series_load(const char* path);
+
+#endif // SERIES_H
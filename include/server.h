@@ -0,0 +1,43 @@
+/**
+ * @file server.h
+ * @brief Header file for the shell's command server.
+ *
+ * This header file declares the server behind `--server <socket>`: a long-lived shell that runs command
+ * lines and scripts sent by clients (see server_protocol.h and the ShellProject_client binary) through the
+ * same execute_command path as its own input, so a request pays for neither process startup nor metric
+ * discovery. While a request runs, the client's descriptors are swapped onto the shell's standard input,
+ * output and error, so builtins and children alike write to the client directly.
+ *
+ * @date 17/10/2026
+ * @author 1v6n
+ */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "global.h"
+
+/**
+ * @brief Listens on a Unix socket and, if the event loop is running, serves clients from it.
+ *
+ * A socket file left behind by a server that is gone is replaced. SIGPIPE is ignored from then on, so a
+ * client hanging up cannot take the shell down, and SIGTERM stops the event loop between requests.
+ *
+ * @param path Path of the socket.
+ * @return 0 on success, -1 on failure or if another server is listening on path.
+ */
+int server_start(const char* path);
+
+/**
+ * @brief Accepts one pending client, runs its request and sends back the exit status.
+ *
+ * @return 0 if a request was served, -1 if there was none or it was malformed.
+ */
+int server_serve(void);
+
+/**
+ * @brief Stops listening and removes the socket file.
+ */
+void server_stop(void);
+
+#endif // SERVER_H
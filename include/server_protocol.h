@@ -0,0 +1,48 @@
+/**
+ * @file server_protocol.h
+ * @brief Wire format between the shell's command server and its clients.
+ *
+ * A shell started with --server listens on a SOCK_SEQPACKET Unix socket. A client connects and sends one
+ * SERVER_MSG_RUN packet carrying, as SCM_RIGHTS, the SERVER_FD_COUNT descriptors the commands should use
+ * as standard input, output and error. The commands are the lines of the payload or, if the payload is
+ * empty, the script read from the passed standard input. Their output goes straight to the client's
+ * descriptors as it is written; once the last line has run, the server answers with a SERVER_MSG_STATUS
+ * packet holding the exit status of that line and closes the connection. Requests are served one at a
+ * time, and the shell's state (working directory, jobs, configuration) carries over between them.
+ *
+ * @date 17/10/2026
+ * @author 1v6n
+ */
+
+#ifndef SERVER_PROTOCOL_H
+#define SERVER_PROTOCOL_H
+
+#include <stdint.h>
+
+#define SERVER_PAYLOAD_SIZE 4096 /**< Maximum payload of a message, terminator included. */
+#define SERVER_FD_COUNT 3        /**< Descriptors passed with a request: input, output and error. */
+
+/**
+ * @enum ServerMessageType
+ * @brief Kinds of messages exchanged with the server.
+ */
+typedef enum
+{
+    SERVER_MSG_RUN = 1, /**< Request: run the lines in `payload`, or the script on the passed input. */
+    SERVER_MSG_STATUS   /**< Reply: every line ran; `value` is the exit status of the last one. */
+} ServerMessageType;
+
+/**
+ * @struct ServerMessage
+ * @brief One packet of the server protocol.
+ *
+ * Only the bytes up to and including the payload's terminator are sent.
+ */
+typedef struct
+{
+    uint32_t type;                     /**< A ServerMessageType. */
+    uint32_t value;                    /**< Numeric argument, e.g. the exit status. */
+    char payload[SERVER_PAYLOAD_SIZE]; /**< NUL-terminated text argument. */
+} ServerMessage;
+
+#endif // SERVER_PROTOCOL_H
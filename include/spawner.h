@@ -0,0 +1,76 @@
+/**
+ * @file spawner.h
+ * @brief Header file for the process spawning layer.
+ *
+ * This header file declares the functions used to launch external programs. Launches go through
+ * posix_spawn, which glibc implements with clone(CLONE_VM | CLONE_VFORK): the child borrows the shell's
+ * address space until it execs, so no page tables are copied no matter how large the shell has grown.
+ * Redirections and pipe descriptors are applied in the child through spawn file actions. A plain
+ * fork + exec variant is kept for comparison and for callers that really need a copy of the shell.
+ *
+ * @date 17/10/2026
+ * @author 1v6n
+ */
+
+#ifndef SPAWNER_H
+#define SPAWNER_H
+
+#include "global.h"
+
+/**
+ * @struct SpawnOptions
+ * @brief Describes how the standard streams and process group of a new child are set up.
+ */
+typedef struct
+{
+    int stdin_fd;                      /**< Descriptor installed as stdin, or -1 to inherit the shell's. */
+    int stdout_fd;                     /**< Descriptor installed as stdout, or -1 to inherit the shell's. */
+    const char* input_file;            /**< File opened as stdin, or NULL. */
+    const char* output_file;           /**< File truncated (or appended to) and opened as stdout, or NULL. */
+    bool append_output;                /**< Open output_file for appending instead of truncating it. */
+    const char* error_file;            /**< File truncated and opened as stderr, or NULL. */
+    pid_t pgid;                        /**< Process group to join: 0 starts a new group, -1 keeps the shell's group. */
+    const struct Placement* placement; /**< CPUs and memory node to run on, or NULL to inherit the shell's. */
+} SpawnOptions;
+
+/**
+ * @brief Initializes spawn options so the child inherits everything from the shell.
+ *
+ * @param options Pointer to the options to initialize.
+ */
+void spawn_options_init(SpawnOptions* options);
+
+/**
+ * @brief Launches a program through posix_spawn.
+ *
+ * Descriptors passed in the options are expected to be close-on-exec; they are dup'ed onto the
+ * standard streams in the child and the originals disappear at exec time. Arguments that would exceed the
+ * kernel's ARG_MAX or per-string limit are reported before anything is started. posix_spawn has no way to
+ * set the affinity or memory policy of the child, so a launch with a placement goes through fork_command.
+ *
+ * @param argv NULL-terminated argument vector; argv[0] is resolved through the command hash.
+ * @param options Pointer to the spawn options.
+ * @return The child's PID, or -1 if the program could not be started.
+ */
+pid_t spawn_command(char* const argv[], const SpawnOptions* options);
+
+/**
+ * @brief Launches a program with fork + execv, honoring the same options as spawn_command.
+ *
+ * @param argv NULL-terminated argument vector; argv[0] is resolved through the command hash.
+ * @param options Pointer to the spawn options.
+ * @return The child's PID, or -1 if the command was not found, its arguments are too large or fork failed.
+ */
+pid_t fork_command(char* const argv[], const SpawnOptions* options);
+
+/**
+ * @brief Forks the shell, counting the child in the statistics.
+ *
+ * Every fork goes through here, so the fork counter covers builtins run in the background, batch lines,
+ * the monitor and metric discovery as well as external commands.
+ *
+ * @return As fork: the child's PID in the parent, 0 in the child, -1 on failure.
+ */
+pid_t fork_shell(void);
+
+#endif // SPAWNER_H
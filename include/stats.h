@@ -0,0 +1,133 @@
+/**
+ * @file stats.h
+ * @brief Header file for the shell's self-instrumentation.
+ *
+ * This header file declares latency histograms for the phases the shell goes through between reading a
+ * line and a child exiting, and counters for the system work it does on the way. Probes read the
+ * monotonic clock and add one to a histogram bucket, so they cost a few tens of nanoseconds. The
+ * histograms are log-linear like HDR histograms: every power of two of nanoseconds is split into
+ * STATS_SUB_BUCKETS equal buckets, which keeps the relative error of any percentile under 1/16 from one
+ * nanosecond to minutes, in a fixed table with no allocation.
+ *
+ * Building with SHELL_NO_STATS defined (the SHELL_STATS CMake option set to OFF) turns every probe into
+ * nothing; the stats builtin then only says so.
+ *
+ * @date 17/10/2026
+ * @author 1v6n
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+#define STATS_SUB_BUCKET_BITS 4                             /**< log2 of the buckets per power of two. */
+#define STATS_SUB_BUCKETS (1 << STATS_SUB_BUCKET_BITS)      /**< Buckets per power of two. */
+#define STATS_MAX_EXPONENT 40                               /**< Largest power of two tracked, about 18 minutes. */
+#define STATS_BUCKETS ((STATS_MAX_EXPONENT - STATS_SUB_BUCKET_BITS + 2) * STATS_SUB_BUCKETS) /**< Per histogram. */
+
+/**
+ * @enum StatsPhase
+ * @brief Phases timed by the probes, one histogram each.
+ */
+typedef enum
+{
+    STATS_PARSE,    /**< Tokenizing and parsing a command line. */
+    STATS_BUILTIN,  /**< Running a builtin's handler in the shell. */
+    STATS_REDIRECT, /**< Setting up and undoing redirections in the shell, or preparing them for a child. */
+    STATS_SPAWN,    /**< Launching a child, from the PATH lookup until fork or posix_spawn returns. */
+    STATS_JOB,      /**< Lifetime of a job, from its launch until its last process is reaped. */
+    STATS_PHASE_COUNT
+} StatsPhase;
+
+/**
+ * @enum StatsCounter
+ * @brief Events counted by the probes.
+ */
+typedef enum
+{
+    STATS_FORKS,         /**< Children created with fork. */
+    STATS_SPAWNS,        /**< Programs started with posix_spawn. */
+    STATS_EXECS,         /**< Programs executed, by either route. */
+    STATS_PATH_LOOKUPS,  /**< Commands resolved through the command hash. */
+    STATS_PATH_SEARCHES, /**< Lookups that had to walk PATH. */
+    STATS_JOBS_REAPED,   /**< Jobs whose last process was reaped. */
+    STATS_COUNTER_COUNT
+} StatsCounter;
+
+#ifndef SHELL_NO_STATS
+#define STATS_ENABLED 1
+/** Declares var and stores the current time in it. */
+#define STATS_START(var) uint64_t var = stats_now()
+/** Records the time elapsed since STATS_START(var) in the histogram of phase. */
+#define STATS_STOP(phase, var) stats_record(phase, stats_now() - (var))
+/** Records a duration in nanoseconds in the histogram of phase. */
+#define STATS_RECORD(phase, nanoseconds) stats_record(phase, nanoseconds)
+/** Adds one to a counter. */
+#define STATS_COUNT(counter) stats_count(counter)
+#else
+#define STATS_ENABLED 0
+#define STATS_START(var) ((void)0)
+#define STATS_STOP(phase, var) ((void)0)
+#define STATS_RECORD(phase, nanoseconds) ((void)0)
+#define STATS_COUNT(counter) ((void)0)
+#endif
+
+/**
+ * @brief Returns the monotonic clock in nanoseconds.
+ *
+ * @return Nanoseconds since an arbitrary point.
+ */
+uint64_t stats_now(void);
+
+/**
+ * @brief Adds a duration to the histogram of a phase.
+ *
+ * @param phase The phase.
+ * @param nanoseconds The duration.
+ */
+void stats_record(StatsPhase phase, uint64_t nanoseconds);
+
+/**
+ * @brief Adds one to a counter.
+ *
+ * @param counter The counter.
+ */
+void stats_count(StatsCounter counter);
+
+/**
+ * @brief Returns a counter's value.
+ *
+ * @param counter The counter.
+ * @return Its value.
+ */
+uint64_t stats_counter(StatsCounter counter);
+
+/**
+ * @brief Returns the number of durations recorded for a phase.
+ *
+ * @param phase The phase.
+ * @return The number of samples.
+ */
+uint64_t stats_samples(StatsPhase phase);
+
+/**
+ * @brief Estimates a percentile of a phase's durations.
+ *
+ * @param phase The phase.
+ * @param percentile The percentile, from 0 to 100.
+ * @return The upper bound of the bucket holding the percentile in nanoseconds, 0 if there are no samples.
+ */
+uint64_t stats_percentile(StatsPhase phase, double percentile);
+
+/**
+ * @brief Prints the sample count, mean, percentiles and maximum of every phase, and every counter.
+ */
+void stats_print(void);
+
+/**
+ * @brief Clears every histogram and counter.
+ */
+void stats_reset(void);
+
+#endif // STATS_H
@@ -16,12 +16,50 @@
 #include "global.h"
 
 /**
- * @brief Parses user input into a structured command.
+ * @struct LineReader
+ * @brief Splits the bytes read from a descriptor into lines without stdio buffering.
+ *
+ * Regular files are mapped and split in place; anything else is read into a buffer that starts at
+ * INPUT_BUFFER_SIZE bytes and doubles whenever a line does not fit, so lines have no length limit.
+ */
+typedef struct
+{
+    int fd;          /**< Descriptor the lines are read from. */
+    char* buffer;    /**< Bytes read but not consumed yet, or the mapped file. */
+    size_t capacity; /**< Size of the allocated buffer, 0 when none is allocated or the file is mapped. */
+    size_t length;   /**< Number of bytes in the buffer. */
+    size_t start;    /**< Offset of the first unconsumed byte. */
+    bool eof;        /**< Whether end of file has been reached. */
+    bool mapped;     /**< Whether the buffer is a private mapping of the whole file. */
+    char* tail;      /**< Copy of a mapped file's last line without newline, which has no room for a NUL. */
+} LineReader;
+
+/**
+ * @brief Parses user input into a structured command, using the shell's line arena.
+ *
+ * Words may be quoted with '...' or "..." and characters escaped with a backslash; each pipeline
+ * stage takes its own < and > redirections, and a trailing & runs the line in the background.
+ * Leading 'time', 'prio <nice>' and 'pin <cpus>' keywords set is_timed, priority and placement. The input
+ * string itself is left untouched.
  *
  * @param input The raw input string from the user.
  * @param parsed_cmd Pointer to the ParsedCommand structure to store parsed details.
+ * @return 0 on success, -1 if the line is blank or has a syntax error (reported on stderr).
+ */
+int parse_input(const char* input, ParsedCommand* parsed_cmd);
+
+/**
+ * @brief Parses a command line into the given arena.
+ *
+ * Tokens, argument vectors, stages and a copy of the line are all carved from the arena, so nothing is
+ * malloc'ed per token and everything is released together by resetting the arena.
+ *
+ * @param input The raw command line.
+ * @param parsed_cmd Pointer to the ParsedCommand structure to store parsed details.
+ * @param arena Arena that owns the parsed command.
+ * @return 0 on success, -1 if the line is blank or has a syntax error (reported on stderr).
  */
-void parse_input(char* input, ParsedCommand* parsed_cmd);
+int parse_command_line(const char* input, ParsedCommand* parsed_cmd, Arena* arena);
 
 /**
  * @brief Checks if a given command is an internal shell command.
@@ -32,22 +70,61 @@ void parse_input(char* input, ParsedCommand* parsed_cmd);
 int is_internal_command(const char* command);
 
 /**
- * @brief Cleans up memory allocated for a parsed command.
+ * @brief Releases a parsed command by resetting the arena it was parsed into.
  *
  * @param parsed_cmd Pointer to the ParsedCommand structure to clean up.
  */
 void cleanup_parsed_command(ParsedCommand* parsed_cmd);
 
 /**
- * @brief Sets up signal handlers for the shell.
+ * @brief Blocks SIGCHLD and the job control signals and routes them to a signalfd.
+ *
+ * The signals are then handled synchronously by the event loop instead of in signal handlers.
+ *
+ * @return The signalfd, or -1 on failure.
  */
-void setup_signal_handlers(void);
+int setup_signal_handlers(void);
+
 /**
- * @brief Handles a signal received by the shell.
+ * @brief Forwards a signal received by the shell to the foreground job's process group.
+ *
+ * SIGINTs are also counted in interrupt_count, so long-running builtins can notice them.
  *
  * @param sig The signal number received.
  */
-void handle_signal(int sig);
+void forward_signal(int sig);
+
+/**
+ * @brief Fills a set with the signals the shell ignores while it controls the terminal.
+ *
+ * Children must get their default dispositions back, or a background job reading the terminal would not
+ * stop.
+ *
+ * @param set The set to fill.
+ */
+void job_control_signals(sigset_t* set);
+
+/**
+ * @brief Unblocks every signal and restores the job control signals' dispositions, for forked children
+ * that must not inherit the shell's signal setup.
+ */
+void reset_signal_mask(void);
+
+/**
+ * @brief Converts a status returned by waitpid into a shell exit status.
+ *
+ * @param status The raw status from waitpid.
+ * @return The exit code, or 128 plus the signal number for signaled processes.
+ */
+int exit_status_from_wait(int status);
+
+/**
+ * @brief Computes the 32-bit FNV-1a hash of a string.
+ *
+ * @param str The NUL-terminated string to hash.
+ * @return The hash value.
+ */
+uint32_t hash_string(const char* str);
 
 /**
  * @brief Creates a FIFO for inter-process communication.
@@ -58,6 +135,18 @@ void handle_signal(int sig);
  */
 int create_fifo(const char* path, mode_t mode);
 
+/**
+ * @brief Copies everything readable from one descriptor to another, in the kernel where possible.
+ *
+ * splice is used when either side is a pipe, copy_file_range between regular files, and sendfile from a
+ * regular file to anything else; whatever the kernel refuses falls back to a large-buffer read/write loop.
+ *
+ * @param in_fd Descriptor to read from, from its current offset to the end.
+ * @param out_fd Descriptor to write to.
+ * @return The number of bytes copied, or -1 on failure.
+ */
+ssize_t copy_fd(int in_fd, int out_fd);
+
 /**
  * @brief Displays the shell prompt with the current working directory.
  */
@@ -68,6 +157,42 @@ void display_prompt(void);
  */
 void display_start_screen(void);
 
+/**
+ * @brief Initializes a line reader on a descriptor, mapping it if it is a regular file.
+ *
+ * @param reader Pointer to the reader.
+ * @param fd The descriptor to read from.
+ */
+void line_reader_init(LineReader* reader, int fd);
+
+/**
+ * @brief Releases the buffer or the mapping of a line reader. The descriptor is left open.
+ *
+ * @param reader Pointer to the reader.
+ */
+void line_reader_free(LineReader* reader);
+
+/**
+ * @brief Reads whatever is available from the descriptor into the reader with a single read call.
+ *
+ * The buffer is grown first if it is full of an incomplete line. Does nothing for a mapped file.
+ *
+ * @param reader Pointer to the reader.
+ * @return The number of bytes read, 0 on end of file or interruption, -1 on error.
+ */
+int line_reader_fill(LineReader* reader);
+
+/**
+ * @brief Returns the next complete line, without its newline.
+ *
+ * At end of file a trailing line without newline is returned too. A line is only returned once it is
+ * complete, however long it is.
+ *
+ * @param reader Pointer to the reader.
+ * @return The line, valid until the next fill, or NULL if no complete line is buffered.
+ */
+char* line_reader_next(LineReader* reader);
+
 /**
  * @brief Cleans and checks the user input for special characters.
  *
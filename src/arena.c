@@ -0,0 +1,98 @@
+/**
+ * @file arena.c
+ * @brief Implementation of the bump-pointer arena allocator.
+ */
+#include "arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGNMENT (sizeof(max_align_t)) /**< Alignment of every allocation. */
+
+static ArenaBlock* new_block(size_t size)
+{
+    ArenaBlock* block = malloc(sizeof(ArenaBlock) + size);
+    if (block == NULL)
+    {
+        perror("arena malloc failed");
+        return NULL;
+    }
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+void arena_init(Arena* arena)
+{
+    arena->first = NULL;
+    arena->current = NULL;
+}
+
+void* arena_alloc(Arena* arena, size_t size)
+{
+    size = (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+    ArenaBlock* block = arena->current;
+    if (block && block->size - block->used >= size)
+    {
+        void* ptr = (unsigned char*)block->data + block->used;
+        block->used += size;
+        return ptr;
+    }
+
+    // Reuse the next block left over from before the last reset, or chain in a new one.
+    ArenaBlock* next = block ? block->next : arena->first;
+    if (next == NULL || next->size < size)
+    {
+        ArenaBlock* fresh = new_block(size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE);
+        if (fresh == NULL)
+        {
+            return NULL;
+        }
+        fresh->next = next;
+        if (block)
+        {
+            block->next = fresh;
+        }
+        else
+        {
+            arena->first = fresh;
+        }
+        next = fresh;
+    }
+    next->used = size;
+    arena->current = next;
+    return next->data;
+}
+
+char* arena_strndup(Arena* arena, const char* str, size_t len)
+{
+    char* copy = arena_alloc(arena, len + 1);
+    if (copy)
+    {
+        memcpy(copy, str, len);
+        copy[len] = '\0';
+    }
+    return copy;
+}
+
+void arena_reset(Arena* arena)
+{
+    if (arena->first)
+    {
+        arena->first->used = 0;
+    }
+    arena->current = arena->first;
+}
+
+void arena_destroy(Arena* arena)
+{
+    ArenaBlock* block = arena->first;
+    while (block)
+    {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    arena_init(arena);
+}
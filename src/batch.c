@@ -0,0 +1,306 @@
+/**
+ * @file batch.c
+ * @brief Implementation of the parallel batch file executor.
+ */
+#include "batch.h"
+#include "event_loop.h"
+#include "execution.h"
+#include "jobs.h"
+#include "spawner.h"
+#include "utils.h"
+#include <sys/mman.h>
+#include <time.h>
+
+/**
+ * @struct BatchEntry
+ * @brief A batch file line, from launch to its line in the summary.
+ */
+typedef struct
+{
+    char* text;               /**< The line as written in the file. */
+    int line_number;          /**< Line number in the batch file. */
+    int job_id;               /**< Job running the line, 0 once it has finished. */
+    int output_fd;            /**< memfd holding the line's output, -1 once flushed. */
+    int status;               /**< Exit status of the line. */
+    bool finished;            /**< Whether the line is done and its status recorded. */
+    struct timespec started;  /**< When the line was launched. */
+    double seconds;           /**< Wall time of the line. */
+    double cpu_seconds;       /**< User plus system time of the line, 0 for builtins run by the shell itself. */
+    long max_rss_kb;          /**< Peak RSS of the line's largest process. */
+} BatchEntry;
+
+static BatchEntry* entries = NULL;
+static size_t num_entries = 0;
+static size_t entries_capacity = 0;
+static size_t next_flush = 0; /**< First entry whose output has not been printed yet. */
+static int in_flight = 0;
+
+static double seconds_since(const struct timespec* start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) + (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static BatchEntry* new_entry(const char* line, int line_number)
+{
+    if (num_entries == entries_capacity)
+    {
+        size_t new_capacity = entries_capacity ? entries_capacity * 2 : 64;
+        BatchEntry* new_entries = realloc(entries, new_capacity * sizeof(BatchEntry));
+        if (new_entries == NULL)
+        {
+            perror("realloc failed");
+            return NULL;
+        }
+        entries = new_entries;
+        entries_capacity = new_capacity;
+    }
+    char* text = strdup(line);
+    if (text == NULL)
+    {
+        perror("strdup failed");
+        return NULL;
+    }
+    BatchEntry* entry = &entries[num_entries++];
+    memset(entry, 0, sizeof(*entry));
+    entry->text = text;
+    entry->line_number = line_number;
+    entry->output_fd = -1;
+    clock_gettime(CLOCK_MONOTONIC, &entry->started);
+    return entry;
+}
+
+/**
+ * @brief Copies a finished line's captured output to standard output.
+ */
+static void flush_output(BatchEntry* entry)
+{
+    if (entry->output_fd == -1)
+    {
+        return;
+    }
+    lseek(entry->output_fd, 0, SEEK_SET);
+    copy_fd(entry->output_fd, STDOUT_FILENO);
+    close(entry->output_fd);
+    entry->output_fd = -1;
+}
+
+/**
+ * @brief Prints, in file order, the output of every finished line not preceded by a running one.
+ */
+static void flush_in_order(void)
+{
+    while (next_flush < num_entries && entries[next_flush].finished)
+    {
+        flush_output(&entries[next_flush++]);
+    }
+}
+
+/**
+ * @brief Records the status of every line whose job has finished.
+ *
+ * @return true if at least one line finished.
+ */
+static bool collect_finished(void* arg)
+{
+    bool any = false;
+    for (size_t i = next_flush; i < num_entries; i++)
+    {
+        BatchEntry* entry = &entries[i];
+        if (entry->job_id == 0 || jobs[entry->job_id - 1].state != JOB_DONE)
+        {
+            continue;
+        }
+        Job* job = &jobs[entry->job_id - 1];
+        entry->status = exit_status_from_wait(job->status);
+        entry->seconds = seconds_since(&entry->started);
+        entry->cpu_seconds = job->usage.user_seconds + job->usage.system_seconds;
+        entry->max_rss_kb = job->usage.max_rss_kb;
+        entry->finished = true;
+        entry->job_id = 0;
+        remove_job(job);
+        in_flight--;
+        any = true;
+    }
+    return any;
+}
+
+/**
+ * @brief Waits until fewer than limit lines are running, printing output as lines complete.
+ */
+static void wait_below(int limit)
+{
+    while (in_flight >= limit && in_flight > 0)
+    {
+        wait_for_jobs_until(collect_finished, NULL);
+        flush_in_order();
+    }
+}
+
+/**
+ * @brief Runs a line in a child whose standard output and error go to an anonymous memory file.
+ */
+static void launch(BatchEntry* entry, ParsedCommand* parsed_cmd)
+{
+    entry->output_fd = memfd_create("batch-output", MFD_CLOEXEC);
+    if (entry->output_fd == -1)
+    {
+        perror("memfd_create failed");
+        entry->status = EXIT_FAILURE;
+        entry->finished = true;
+        return;
+    }
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork_shell();
+    if (pid < 0)
+    {
+        perror("fork failed");
+        entry->status = EXIT_FAILURE;
+        entry->finished = true;
+        return;
+    }
+    else if (pid == 0)
+    {
+        reset_signal_mask();
+        event_loop_detach();
+        dup2(entry->output_fd, STDOUT_FILENO);
+        dup2(entry->output_fd, STDERR_FILENO);
+        int status = execute_command(parsed_cmd);
+        fflush(stdout);
+        exit(status);
+    }
+    Job* job = create_job(&pid, 1, entry->text, false);
+    if (job == NULL)
+    {
+        waitpid(pid, NULL, 0);
+        entry->status = EXIT_FAILURE;
+        entry->finished = true;
+        return;
+    }
+    entry->job_id = job->job_id;
+    in_flight++;
+}
+
+/**
+ * @brief Prints the exit status, duration, CPU time and peak RSS of every line.
+ *
+ * @return 0 if every line succeeded, 1 otherwise.
+ */
+static int print_summary(void)
+{
+    int failed = 0;
+    fprintf(stderr, "[Batch] %zu lines\n", num_entries);
+    fprintf(stderr, "  %-6s %-6s %-10s %-10s %-10s %s\n", "LINE", "STATUS", "TIME", "CPU", "MAXRSS", "COMMAND");
+    for (size_t i = 0; i < num_entries; i++)
+    {
+        BatchEntry* entry = &entries[i];
+        fprintf(stderr, "  %-6d %-6d %-10.3f %-10.3f %-10ld %s\n", entry->line_number, entry->status, entry->seconds,
+                entry->cpu_seconds, entry->max_rss_kb, entry->text);
+        failed += entry->status != 0;
+    }
+    fprintf(stderr, "[Batch] %d failed\n", failed);
+    return failed ? 1 : 0;
+}
+
+static void free_entries(void)
+{
+    for (size_t i = 0; i < num_entries; i++)
+    {
+        free(entries[i].text);
+    }
+    free(entries);
+    entries = NULL;
+    num_entries = entries_capacity = next_flush = 0;
+}
+
+/**
+ * @brief Tells whether a line's first word is the given one, whatever blanks surround it.
+ */
+static bool first_word_is(const char* line, const char* word)
+{
+    const char* start = line + strspn(line, " \t");
+    size_t length = strlen(word);
+    return strncmp(start, word, length) == 0 && strchr(" \t", start[length]) != NULL;
+}
+
+int run_batch_parallel(int fd, int max_jobs)
+{
+    static LineReader reader;
+    line_reader_init(&reader, fd);
+    int line_number = 0;
+    while (!reader.eof || reader.start < reader.length)
+    {
+        char* line = line_reader_next(&reader);
+        if (line == NULL)
+        {
+            if (line_reader_fill(&reader) == -1)
+            {
+                break;
+            }
+            continue;
+        }
+        line_number++;
+        if (!clean_and_check_input(line) || line[strspn(line, " \t")] == '\0')
+        {
+            continue;
+        }
+        if (first_word_is(line, BATCH_BARRIER))
+        {
+            wait_below(1);
+            continue;
+        }
+        // 'quit' would exit the shell from under the running lines; here it only ends the batch.
+        if (first_word_is(line, "quit"))
+        {
+            break;
+        }
+
+        ParsedCommand parsed_cmd;
+        int parsed = parse_input(line, &parsed_cmd);
+        BatchEntry* entry = new_entry(line, line_number);
+        if (entry == NULL)
+        {
+            cleanup_parsed_command(&parsed_cmd);
+            break;
+        }
+        if (parsed == -1)
+        {
+            entry->status = 2;
+            entry->finished = true;
+        }
+        else if (parsed_cmd.is_background)
+        {
+            // Started by the shell itself, so the job belongs to it as in a serial batch, and is not
+            // orphaned by a line runner that exits as soon as the job is submitted.
+            entry->status = execute_command(&parsed_cmd);
+            entry->seconds = seconds_since(&entry->started);
+            entry->finished = true;
+        }
+        else if (parsed_cmd.is_internal && !parsed_cmd.is_piped)
+        {
+            // Builtins may change the shell itself (cd, set_interval), so they act as barriers.
+            wait_below(1);
+            flush_in_order();
+            execute_command(&parsed_cmd);
+            entry->seconds = seconds_since(&entry->started);
+            entry->finished = true;
+        }
+        else
+        {
+            wait_below(max_jobs);
+            clock_gettime(CLOCK_MONOTONIC, &entry->started);
+            launch(entry, &parsed_cmd);
+        }
+        cleanup_parsed_command(&parsed_cmd);
+        flush_in_order();
+    }
+    wait_below(1);
+    flush_in_order();
+    line_reader_free(&reader);
+    fflush(stdout);
+    int result = print_summary();
+    free_entries();
+    return result;
+}
@@ -0,0 +1,24 @@
+/**
+ * @file builtins.c
+ * @brief Implementation of the builtin command table.
+ */
+#include "builtins.h"
+#include "builtin_hash.h"
+#include "commands.h"
+#include "perfect_hash.h"
+
+static const CommandHandler builtins[] = {
+#define BUILTIN(name, pipe_mode) {#name, handle_##name, pipe_mode},
+#include "builtins.def"
+#undef BUILTIN
+};
+
+const CommandHandler* find_builtin(const char* command)
+{
+    int index = builtin_slots[perfect_hash(command, BUILTIN_HASH_SEED) & BUILTIN_HASH_MASK];
+    if (index < 0 || strcmp(builtins[index].command, command) != 0)
+    {
+        return NULL;
+    }
+    return &builtins[index];
+}
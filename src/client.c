@@ -0,0 +1,107 @@
+/**
+ * @file client.c
+ * @brief Client of the shell's command server: runs commands or a script in a shell started with --server.
+ */
+#include "server_protocol.h"
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define CLIENT_FAILURE_STATUS 125 /**< Exit status when the request could not be served at all. */
+
+/**
+ * @brief Sends a request with the descriptors the commands should use.
+ */
+static int send_request(int fd, const ServerMessage* request, const int fds[SERVER_FD_COUNT])
+{
+    union
+    {
+        char buffer[CMSG_SPACE(sizeof(int) * SERVER_FD_COUNT)];
+        struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+    struct iovec iov = {.iov_base = (void*)request,
+                        .iov_len = offsetof(ServerMessage, payload) + strlen(request->payload) + 1};
+    struct msghdr message = {
+        .msg_iov = &iov, .msg_iovlen = 1, .msg_control = control.buffer, .msg_controllen = sizeof(control.buffer)};
+    struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int) * SERVER_FD_COUNT);
+    memcpy(CMSG_DATA(header), fds, sizeof(int) * SERVER_FD_COUNT);
+    return sendmsg(fd, &message, MSG_NOSIGNAL) == -1 ? -1 : 0;
+}
+
+/**
+ * @brief Main function of the client.
+ *
+ * The commands given with -c, or the script read from the given file or from standard input, run in the
+ * server with the client's standard output and error, so their output appears as they write it.
+ *
+ * @return The exit status of the last command, or CLIENT_FAILURE_STATUS if the server could not run them.
+ */
+int main(int argc, char* argv[])
+{
+    bool inline_commands = argc == 4 && strcmp(argv[2], "-c") == 0;
+    if (argc < 2 || argc > 4 || (argc == 4 && !inline_commands) || (argc == 3 && strcmp(argv[2], "-c") == 0))
+    {
+        fprintf(stderr, "Usage: %s <socket> [-c <commands> | <script>]\n", argv[0]);
+        return CLIENT_FAILURE_STATUS;
+    }
+    ServerMessage request = {.type = SERVER_MSG_RUN};
+    int input_fd = STDIN_FILENO;
+    if (inline_commands)
+    {
+        if (strlen(argv[3]) >= sizeof(request.payload))
+        {
+            fprintf(stderr, "Commands too long for -c, pass them as a script instead\n");
+            return CLIENT_FAILURE_STATUS;
+        }
+        if (argv[3][0] == '\0')
+        {
+            return EXIT_SUCCESS;
+        }
+        memcpy(request.payload, argv[3], strlen(argv[3]) + 1);
+    }
+    else if (argc == 3 && (input_fd = open(argv[2], O_RDONLY | O_CLOEXEC)) == -1)
+    {
+        perror(argv[2]);
+        return CLIENT_FAILURE_STATUS;
+    }
+
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    if (strlen(argv[1]) >= sizeof(address.sun_path))
+    {
+        fprintf(stderr, "Socket path too long: %s\n", argv[1]);
+        return CLIENT_FAILURE_STATUS;
+    }
+    memcpy(address.sun_path, argv[1], strlen(argv[1]) + 1);
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd == -1 || connect(fd, (struct sockaddr*)&address, sizeof(address)) == -1)
+    {
+        perror(argv[1]);
+        return CLIENT_FAILURE_STATUS;
+    }
+    int fds[SERVER_FD_COUNT] = {input_fd, STDOUT_FILENO, STDERR_FILENO};
+    if (send_request(fd, &request, fds) == -1)
+    {
+        perror("send failed");
+        return CLIENT_FAILURE_STATUS;
+    }
+
+    ServerMessage reply;
+    ssize_t received = recv(fd, &reply, sizeof(reply), 0);
+    if (received < (ssize_t)offsetof(ServerMessage, payload) || reply.type != SERVER_MSG_STATUS)
+    {
+        fprintf(stderr, "The server hung up without an exit status\n");
+        return CLIENT_FAILURE_STATUS;
+    }
+    close(fd);
+    return (int)(reply.value & 0xff);
+}
@@ -0,0 +1,243 @@
+/**
+ * @file command_hash.c
+ * @brief Implementation of the command path hash table.
+ */
+#include "command_hash.h"
+#include "stats.h"
+#include "utils.h"
+
+#define COMMAND_HASH_INITIAL_CAPACITY 64 /**< Initial number of slots, always a power of two. */
+
+/**
+ * @struct CommandHashEntry
+ * @brief A cached command name and the path it resolved to.
+ */
+typedef struct
+{
+    char* name;         /**< Command name, NULL for an empty slot. */
+    char* path;         /**< Absolute path of the executable. */
+    uint32_t hash;      /**< Hash of the name. */
+    unsigned long hits; /**< Number of lookups served by this entry. */
+} CommandHashEntry;
+
+static CommandHashEntry* table = NULL;
+static size_t capacity = 0;
+static size_t count = 0;
+static char* hashed_path_env = NULL; /**< Value of PATH the entries were resolved against. */
+static unsigned long total_hits = 0;
+static unsigned long total_misses = 0;
+
+static bool is_executable(const char* path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISREG(st.st_mode) && access(path, X_OK) == 0;
+}
+
+static char* search_path(const char* name)
+{
+    STATS_COUNT(STATS_PATH_SEARCHES);
+    const char* path_env = getenv("PATH");
+    if (path_env == NULL)
+    {
+        path_env = "/bin:/usr/bin";
+    }
+    char candidate[MAX_PATH];
+    const char* dir = path_env;
+    while (1)
+    {
+        const char* end = strchr(dir, ':');
+        size_t dir_len = end ? (size_t)(end - dir) : strlen(dir);
+        int written = dir_len == 0 ? snprintf(candidate, sizeof(candidate), "%s", name)
+                                   : snprintf(candidate, sizeof(candidate), "%.*s/%s", (int)dir_len, dir, name);
+        if (written > 0 && (size_t)written < sizeof(candidate) && is_executable(candidate))
+        {
+            return strdup(candidate);
+        }
+        if (!end)
+        {
+            return NULL;
+        }
+        dir = end + 1;
+    }
+}
+
+static size_t find_slot(const char* name, uint32_t hash)
+{
+    size_t mask = capacity - 1;
+    size_t slot = hash & mask;
+    while (table[slot].name && (table[slot].hash != hash || strcmp(table[slot].name, name) != 0))
+    {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static void free_entry(CommandHashEntry* entry)
+{
+    free(entry->name);
+    free(entry->path);
+    memset(entry, 0, sizeof(*entry));
+}
+
+static void remove_slot(size_t slot)
+{
+    size_t mask = capacity - 1;
+    free_entry(&table[slot]);
+    count--;
+    // Backward-shift the rest of the probe run so lookups never stop early at the new hole.
+    size_t hole = slot;
+    size_t next = (slot + 1) & mask;
+    while (table[next].name)
+    {
+        size_t home = table[next].hash & mask;
+        if (((next - home) & mask) >= ((next - hole) & mask))
+        {
+            table[hole] = table[next];
+            memset(&table[next], 0, sizeof(table[next]));
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+}
+
+static int grow_table(void)
+{
+    size_t new_capacity = capacity ? capacity * 2 : COMMAND_HASH_INITIAL_CAPACITY;
+    CommandHashEntry* new_table = calloc(new_capacity, sizeof(CommandHashEntry));
+    if (new_table == NULL)
+    {
+        perror("calloc failed");
+        return -1;
+    }
+    CommandHashEntry* old_table = table;
+    size_t old_capacity = capacity;
+    table = new_table;
+    capacity = new_capacity;
+    for (size_t i = 0; i < old_capacity; i++)
+    {
+        if (old_table[i].name)
+        {
+            table[find_slot(old_table[i].name, old_table[i].hash)] = old_table[i];
+        }
+    }
+    free(old_table);
+    return 0;
+}
+
+/**
+ * @brief Flushes the table if PATH changed since the entries were resolved.
+ */
+static void check_path_env(void)
+{
+    const char* path_env = getenv("PATH");
+    if (path_env == NULL)
+    {
+        path_env = "";
+    }
+    if (hashed_path_env && strcmp(hashed_path_env, path_env) == 0)
+    {
+        return;
+    }
+    command_hash_clear();
+    hashed_path_env = strdup(path_env);
+}
+
+static CommandHashEntry* insert(const char* name, uint32_t hash, char* path)
+{
+    if ((count + 1) * 10 > capacity * 7 && grow_table() == -1)
+    {
+        free(path);
+        return NULL;
+    }
+    size_t slot = find_slot(name, hash);
+    if (table[slot].name)
+    {
+        free(table[slot].path);
+        table[slot].path = path;
+        return &table[slot];
+    }
+    table[slot].name = strdup(name);
+    table[slot].path = path;
+    table[slot].hash = hash;
+    table[slot].hits = 0;
+    count++;
+    return &table[slot];
+}
+
+const char* command_hash_lookup(const char* name)
+{
+    if (strchr(name, '/'))
+    {
+        return name;
+    }
+    STATS_COUNT(STATS_PATH_LOOKUPS);
+    check_path_env();
+    uint32_t hash = hash_string(name);
+    if (capacity)
+    {
+        size_t slot = find_slot(name, hash);
+        if (table[slot].name)
+        {
+            if (access(table[slot].path, X_OK) == 0)
+            {
+                table[slot].hits++;
+                total_hits++;
+                return table[slot].path;
+            }
+            remove_slot(slot);
+        }
+    }
+    total_misses++;
+    char* path = search_path(name);
+    if (path == NULL)
+    {
+        return NULL;
+    }
+    CommandHashEntry* entry = insert(name, hash, path);
+    return entry ? entry->path : NULL;
+}
+
+int command_hash_add(const char* name)
+{
+    check_path_env();
+    char* path = strchr(name, '/') ? NULL : search_path(name);
+    if (path == NULL)
+    {
+        return -1;
+    }
+    return insert(name, hash_string(name), path) ? 0 : -1;
+}
+
+void command_hash_clear(void)
+{
+    for (size_t i = 0; i < capacity; i++)
+    {
+        if (table[i].name)
+        {
+            free_entry(&table[i]);
+        }
+    }
+    count = 0;
+    free(hashed_path_env);
+    hashed_path_env = NULL;
+}
+
+void command_hash_print(void)
+{
+    if (count == 0)
+    {
+        printf("hash: hash table empty\n");
+    }
+    else
+    {
+        printf("%-8s %s\n", "hits", "command");
+        for (size_t i = 0; i < capacity; i++)
+        {
+            if (table[i].name)
+            {
+                printf("%-8lu %s\n", table[i].hits, table[i].path);
+            }
+        }
+    }
+    printf("lookups: %lu hits, %lu misses\n", total_hits, total_misses);
+}
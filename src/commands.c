@@ -1,4 +1,15 @@
 #include "commands.h"
+#include "command_hash.h"
+#include "config.h"
+#include "event_loop.h"
+#include "monitor.h"
+#include "monitor_channel.h"
+#include "placement.h"
+#include "sampler.h"
+#include "scheduler.h"
+#include "series.h"
+#include "spawner.h"
+#include "stats.h"
 
 void handle_cd(ParsedCommand* parsed_cmd)
 {
@@ -12,18 +23,15 @@ void handle_echo(ParsedCommand* parsed_cmd)
 {
     if (parsed_cmd->input_file)
     {
-        FILE* file = fopen(parsed_cmd->input_file, "r");
-        if (!file)
+        int fd = open(parsed_cmd->input_file, O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
         {
             perror("Input file open failed");
             return;
         }
-        char buffer[INPUT_BUFFER_SIZE];
-        while (fgets(buffer, sizeof(buffer), file))
-        {
-            printf("%s", buffer);
-        }
-        fclose(file);
+        fflush(stdout);
+        copy_fd(fd, STDOUT_FILENO);
+        close(fd);
     }
     else
     {
@@ -42,6 +50,9 @@ void handle_clr(ParsedCommand* parsed_cmd)
 
 void handle_quit(ParsedCommand* parsed_cmd)
 {
+    config_flush();
+    monitor_collect();
+    series_save(getenv(SERIES_FILE_ENV));
     free_metrics();
     cleanup_and_exit();
 }
@@ -52,7 +63,11 @@ void handle_set_interval(ParsedCommand* parsed_cmd)
     {
         interval = atoi(parsed_cmd->args[1]);
         printf("Interval set to %d seconds\n", interval);
-        create_config_file(CONFIG_FILE, interval, metrics, num_metrics);
+        config_set_interval(interval);
+        if (monitor_running() && monitor_request(MONITOR_MSG_SET_INTERVAL, (uint32_t)interval, NULL, NULL) == 0)
+        {
+            printf("Monitor updated.\n");
+        }
     }
     else
     {
@@ -65,6 +80,7 @@ void handle_set_interval(ParsedCommand* parsed_cmd)
 
 void handle_set_metrics(ParsedCommand* parsed_cmd)
 {
+    require_metrics();
     if (parsed_cmd->args[1] == NULL)
     {
         display_metrics_mapping();
@@ -97,39 +113,67 @@ void handle_set_metrics(ParsedCommand* parsed_cmd)
             fprintf(stderr, "Invalid metric number: %d\n", metric_number);
         }
     }
-    create_config_file(CONFIG_FILE, interval, metrics, num_metrics);
+    config_set_metrics(metrics, num_metrics);
+    if (monitor_running())
+    {
+        char metric_list[MONITOR_PAYLOAD_SIZE] = "";
+        for (size_t i = 0; i < num_metrics; i++)
+        {
+            size_t used = strlen(metric_list);
+            snprintf(metric_list + used, sizeof(metric_list) - used, "%s%s", i ? "," : "", metrics[i]);
+        }
+        if (monitor_request(MONITOR_MSG_SET_METRICS, (uint32_t)num_metrics, metric_list, NULL) == 0)
+        {
+            printf("Monitor updated.\n");
+        }
+    }
 }
 
-void handle_start_monitor(ParsedCommand* parsed_cmd)
+/**
+ * @brief Joins the configured metric names with a separator.
+ *
+ * @return The number of metrics, -1 if the configuration has no metric list.
+ */
+static int join_config_metrics(char* buffer, size_t size, const char* separator)
 {
-    if (root == NULL)
-    {
-        fprintf(stderr, "Configuration not loaded.\n");
-        return;
-    }
+    buffer[0] = '\0';
     cJSON* metrics_array = cJSON_GetObjectItem(root, "metrics");
     if (!cJSON_IsArray(metrics_array))
     {
-        fprintf(stderr, "Metrics is not an array\n");
-        return;
+        return -1;
     }
-    char metrics_string[INPUT_BUFFER_SIZE] = "";
+    int count = 0;
+    size_t used = 0;
     cJSON* metric;
     cJSON_ArrayForEach(metric, metrics_array)
     {
-        if (cJSON_IsString(metric))
+        if (cJSON_IsString(metric) && used < size)
         {
-            strcat(metrics_string, metric->valuestring);
-            strcat(metrics_string, ", ");
+            int written = snprintf(buffer + used, size - used, "%s%s", count ? separator : "", metric->valuestring);
+            used += written > 0 ? (size_t)written : 0;
+            count++;
         }
     }
-    size_t len = strlen(metrics_string);
-    if (len > 2 && metrics_string[len - 2] == ',' && metrics_string[len - 1] == ' ')
+    return count;
+}
+
+void handle_start_monitor(ParsedCommand* parsed_cmd)
+{
+    require_metrics();
+    if (root == NULL)
+    {
+        fprintf(stderr, "Configuration not loaded.\n");
+        return;
+    }
+    char metrics_string[INPUT_BUFFER_SIZE];
+    if (join_config_metrics(metrics_string, sizeof(metrics_string), ", ") == -1)
     {
-        metrics_string[len - 2] = '\0';
+        fprintf(stderr, "Metrics is not an array\n");
+        return;
     }
-    if (create_fifo(FIFO_PATH, 0666) == -1)
+    if (monitor_running())
     {
+        printf("Monitor already running with PID %d.\n", monitor_pid());
         return;
     }
 
@@ -137,31 +181,25 @@ void handle_start_monitor(ParsedCommand* parsed_cmd)
     printf("\033[1;35m|         Starting the Monitor...        |\033[0m\n");
     printf("\033[1;36m=========================================\033[0m\n");
 
-    pid_t fifo_pid = fork();
-    if (fifo_pid < 0)
+    bool external = access(monitor_path, X_OK) == 0;
+    if (external)
     {
-        perror("fork failed");
+        // Monitors that predate the control socket still read their metric list from the FIFO.
+        monitor_fifo_send(fifo_path, metrics_string);
+    }
+    if (monitor_start(monitor_path) == -1)
+    {
+        monitor_fifo_cancel();
         return;
     }
-    else if (fifo_pid == 0)
+    if (!external)
     {
-        FILE* fifo_file = fopen(FIFO_PATH, "w");
-        if (fifo_file == NULL)
-        {
-            perror("fopen fifo for writing failed");
-            exit(EXIT_FAILURE);
-        }
-        if (fwrite(metrics_string, sizeof(char), strlen(metrics_string), fifo_file) != strlen(metrics_string))
-        {
-            perror("fwrite to fifo failed");
-        }
-        fclose(fifo_file);
-        exit(EXIT_SUCCESS);
+        printf("\033[1;33m%s not found, sampling /proc in the shell every %d seconds.\033[0m\n\n", monitor_path,
+               interval);
+        monitor_request(MONITOR_MSG_SET_METRICS, 0, metrics_string, NULL);
+        return;
     }
-    execlp(MONITOR_PATH, MONITOR_PATH, NULL);
-    perror("execlp");
-    exit(EXIT_FAILURE);
-    waitpid(fifo_pid, NULL, 0);
+    printf("\033[1;33mMonitor started with PID %d.\033[0m\n\n", monitor_pid());
 }
 
 void handle_man(ParsedCommand* parsed_cmd)
@@ -197,7 +235,8 @@ void handle_man(ParsedCommand* parsed_cmd)
     printf("\033[1;33mEXAMPLE:\033[0m     set_metrics 1 3 5\n\n");
 
     printf("\033[1;33mCOMMAND:\033[0m   \033[1;37mstart_monitor\033[0m\n");
-    printf("\033[1;33mDESCRIPTION:\033[0m Start the monitoring process in the background.\n");
+    printf("\033[1;33mDESCRIPTION:\033[0m Start the monitoring process as a supervised background child.\n");
+    printf("            Without the monitor binary, the shell samples /proc itself into the same ring.\n");
     printf("\033[1;33mUSAGE:\033[0m       start_monitor\n\n");
 
     printf("\033[1;33mCOMMAND:\033[0m   \033[1;37mstop_monitor\033[0m\n");
@@ -206,130 +245,780 @@ void handle_man(ParsedCommand* parsed_cmd)
 
     printf("\033[1;33mCOMMAND:\033[0m   \033[1;37mstatus_monitor\033[0m\n");
     printf("\033[1;33mDESCRIPTION:\033[0m Display the status of the monitoring process.\n");
-    printf("\033[1;33mUSAGE:\033[0m       status_monitor\n\n");
+    printf("\033[1;33mUSAGE:\033[0m       status_monitor [--watch [updates] | --last <samples>]\n");
+    printf("\033[1;33mEXAMPLE:\033[0m     status_monitor --last 20\n\n");
+
+    printf("\033[1;33mCOMMAND:\033[0m   \033[1;37mhash\033[0m\n");
+    printf("\033[1;33mDESCRIPTION:\033[0m Show, add or clear remembered command paths and their hit counts.\n");
+    printf("\033[1;33mUSAGE:\033[0m       hash [-r] [command ...]\n");
+    printf("\033[1;33mEXAMPLE:\033[0m     hash -r\n\n");
+
+    printf("\033[1;33mCOMMAND:\033[0m   \033[1;37mjobs\033[0m\n");
+    printf("\033[1;33mDESCRIPTION:\033[0m List background, queued and stopped jobs; -l adds their process IDs, -v\n"
+           "             their resource usage followed by that of the last finished jobs.\n");
+    printf("\033[1;33mUSAGE:\033[0m       jobs [-l | -v]\n\n");
+
+    printf("\033[1;33mCOMMAND:\033[0m   \033[1;37mtime\033[0m\n");
+    printf("\033[1;33mDESCRIPTION:\033[0m Run a command, then report its real, user and system time, peak RSS,\n"
+           "             context switches and page faults.\n");
+    printf("\033[1;33mUSAGE:\033[0m       time <command>\n");
+    printf("\033[1;33mEXAMPLE:\033[0m     time ls -R / | wc -l\n\n");
+
+    printf("\033[1;33mCOMMAND:\033[0m   \033[1;37mfg / bg\033[0m\n");
+    printf("\033[1;33mDESCRIPTION:\033[0m Resume a job in the foreground or in the background (Ctrl-Z stops one).\n");
+    printf("\033[1;33mUSAGE:\033[0m       fg [%%job]   bg [%%job]\n");
+    printf("\033[1;33mEXAMPLE:\033[0m     fg %%1\n\n");
+
+    printf("\033[1;33mCOMMAND:\033[0m   \033[1;37mkill\033[0m\n");
+    printf("\033[1;33mDESCRIPTION:\033[0m Send a signal (TERM by default) to jobs or processes.\n");
+    printf("\033[1;33mUSAGE:\033[0m       kill [-s signal | -signal] %%job | pid ...   kill -l\n");
+    printf("\033[1;33mEXAMPLE:\033[0m     kill -STOP %%2\n\n");
+
+    printf("\033[1;33mCOMMAND:\033[0m   \033[1;37mwait\033[0m\n");
+    printf("\033[1;33mDESCRIPTION:\033[0m Wait for a job, or for every background job, to finish.\n");
+    printf("\033[1;33mUSAGE:\033[0m       wait [%%job]\n\n");
+
+    printf("\033[1;33mCOMMAND:\033[0m   \033[1;37msched / prio / pin\033[0m\n");
+    printf("\033[1;33mDESCRIPTION:\033[0m Limit how many background jobs run at once (auto: one per CPU); the\n"
+           "             rest are listed as Queued and start as running ones finish, lowest nice value\n"
+           "             first. 'sched spread' places each one on the next core, or on the CPUs and\n"
+           "             memory of the next NUMA node. 'prio <nice>' runs a line at that nice value,\n"
+           "             'pin <cpus>' on those CPUs only. jobs shows where each job was placed.\n");
+    printf("\033[1;33mUSAGE:\033[0m       sched [limit <jobs> | limit auto | limit off | spread cores | spread\n"
+           "             nodes | spread off]   prio <nice> <command>   pin <cpu list> <command>\n");
+    printf("\033[1;33mEXAMPLE:\033[0m     pin 0-7 prio 10 make &\n\n");
+
+    printf("\033[1;33mCOMMAND:\033[0m   \033[1;37mconfig\033[0m\n");
+    printf("\033[1;33mDESCRIPTION:\033[0m Show the live configuration and when it was last loaded from config.json.\n");
+    printf("\033[1;33mUSAGE:\033[0m       config show\n\n");
+
+    printf("\033[1;33mCOMMAND:\033[0m   \033[1;37mstats\033[0m\n");
+    printf("\033[1;33mDESCRIPTION:\033[0m Show latency percentiles of the parse, builtin, redirect, spawn and job\n"
+           "             phases, and counters of forks, execs, PATH lookups and reaped jobs.\n");
+    printf("\033[1;33mUSAGE:\033[0m       stats [reset]\n\n");
+
+    printf("\033[1;33mCOMMAND:\033[0m   \033[1;37mhistory\033[0m\n");
+    printf("\033[1;33mDESCRIPTION:\033[0m Show a metric's samples over a range (default 1h): raw up to an hour, then\n"
+           "             per-minute and per-hour min/avg/max. Kept across runs in $%s if set.\n",
+           SERIES_FILE_ENV);
+    printf("\033[1;33mUSAGE:\033[0m       history [<metric> [<number>[s|m|h|d]]]\n");
+    printf("\033[1;33mEXAMPLE:\033[0m     history cpu_usage 15m\n\n");
 
     printf("\033[1;36m============================================\033[0m\n\n");
 }
 
-void handle_stop_monitor(ParsedCommand* parsed_cmd)
+void handle_hash(ParsedCommand* parsed_cmd)
+{
+    if (parsed_cmd->args[1] == NULL)
+    {
+        command_hash_print();
+        return;
+    }
+    if (strcmp(parsed_cmd->args[1], "-r") == 0)
+    {
+        command_hash_clear();
+        return;
+    }
+    for (int i = 1; parsed_cmd->args[i]; i++)
+    {
+        if (command_hash_add(parsed_cmd->args[i]) == -1)
+        {
+            fprintf(stderr, "hash: %s: not found\n", parsed_cmd->args[i]);
+        }
+    }
+}
+
+void handle_config(ParsedCommand* parsed_cmd)
+{
+    if (parsed_cmd->args[1] == NULL || strcmp(parsed_cmd->args[1], "show") != 0)
+    {
+        fprintf(stderr, "Usage: config show\n");
+        return;
+    }
+    char* json_string = root ? cJSON_Print(root) : NULL;
+    if (json_string == NULL)
+    {
+        fprintf(stderr, "Configuration not loaded.\n");
+        return;
+    }
+    printf("%s\n", json_string);
+    free(json_string);
+    time_t loaded = config_loaded_at();
+    if (loaded)
+    {
+        char when[32];
+        struct tm local;
+        localtime_r(&loaded, &local);
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &local);
+        printf("Version %lu, loaded from %s at %s (%lds ago)\n", config_version(), config_file_path(), when,
+               (long)(time(NULL) - loaded));
+    }
+    else
+    {
+        printf("Version %lu, never loaded from %s\n", config_version(), config_file_path());
+    }
+}
+
+void handle_jobs(ParsedCommand* parsed_cmd)
+{
+    bool long_format = parsed_cmd->args[1] && strcmp(parsed_cmd->args[1], "-l") == 0;
+    bool usage_format = parsed_cmd->args[1] && strcmp(parsed_cmd->args[1], "-v") == 0;
+    reap_children();
+    for (size_t i = 0; i < job_capacity; i++)
+    {
+        Job* job = &jobs[i];
+        if (job->job_id == 0 || !(job->is_background || job->state == JOB_STOPPED) || job->on_complete)
+        {
+            continue;
+        }
+        printf("[%d]%c  %-8s", job->job_id, job_is_current(job) ? '+' : ' ', job_state_name(job));
+        for (int j = 0; long_format && j < job->num_processes; j++)
+        {
+            printf(" %d", job->pids[j]);
+        }
+        if (job->placement[0])
+        {
+            printf(" (%s)", job->placement);
+        }
+        if (usage_format)
+        {
+            JobUsage usage;
+            job_usage_so_far(job, &usage);
+            printf(" real %.3f s, user %.3f s, sys %.3f s, max RSS %ld KiB", usage.wall_seconds, usage.user_seconds,
+                   usage.system_seconds, usage.max_rss_kb);
+        }
+        printf("  %s\n", job->command);
+    }
+    if (usage_format)
+    {
+        print_job_history();
+    }
+}
+
+/**
+ * @brief Finds the job named by a builtin's argument, complaining on behalf of the builtin if there is none.
+ */
+static Job* job_argument(const char* builtin, const char* spec)
+{
+    Job* job = find_job(spec);
+    if (job == NULL || job->on_complete)
+    {
+        fprintf(stderr, "%s: %s: no such job\n", builtin, spec ? spec : "current");
+        return NULL;
+    }
+    return job;
+}
+
+void handle_fg(ParsedCommand* parsed_cmd)
+{
+    Job* job = job_argument("fg", parsed_cmd->args[1]);
+    if (job && job->state == JOB_QUEUED && scheduler_start(job) == -1)
+    {
+        return;
+    }
+    if (job)
+    {
+        printf("%s\n", job->command);
+        fflush(stdout);
+        run_job_in_foreground(job, true, NULL);
+    }
+}
+
+void handle_bg(ParsedCommand* parsed_cmd)
+{
+    Job* job = job_argument("bg", parsed_cmd->args[1]);
+    if (job == NULL)
+    {
+        return;
+    }
+    if (job->state == JOB_QUEUED)
+    {
+        if (scheduler_start(job) == 0)
+        {
+            printf("[%d]+ %s &\n", job->job_id, job->command);
+        }
+        return;
+    }
+    if (job->state != JOB_STOPPED && job->is_background)
+    {
+        fprintf(stderr, "bg: job %d already in background\n", job->job_id);
+        return;
+    }
+    continue_job_in_background(job);
+    printf("[%d]+ %s &\n", job->job_id, job->command);
+}
+
+/**
+ * @struct SignalName
+ * @brief Maps a signal name, without its SIG prefix, to its number.
+ */
+typedef struct
+{
+    const char* name; /**< Signal name without the SIG prefix. */
+    int number;       /**< Signal number. */
+} SignalName;
+
+static const SignalName signal_names[] = {{"HUP", SIGHUP},   {"INT", SIGINT},   {"QUIT", SIGQUIT}, {"KILL", SIGKILL},
+                                          {"USR1", SIGUSR1}, {"USR2", SIGUSR2}, {"PIPE", SIGPIPE}, {"ALRM", SIGALRM},
+                                          {"TERM", SIGTERM}, {"CONT", SIGCONT}, {"STOP", SIGSTOP}, {"TSTP", SIGTSTP},
+                                          {"TTIN", SIGTTIN}, {"TTOU", SIGTTOU}};
+
+/**
+ * @brief Parses a signal given by number or by name, with or without the SIG prefix.
+ *
+ * @return The signal number, or -1 if it is not a known signal.
+ */
+static int parse_signal(const char* text)
+{
+    char* end;
+    long number = strtol(text, &end, 10);
+    if (*end == '\0')
+    {
+        return number > 0 && number < NSIG ? (int)number : -1;
+    }
+    if (strncmp(text, "SIG", 3) == 0)
+    {
+        text += 3;
+    }
+    for (size_t i = 0; i < sizeof(signal_names) / sizeof(signal_names[0]); i++)
+    {
+        if (strcmp(text, signal_names[i].name) == 0)
+        {
+            return signal_names[i].number;
+        }
+    }
+    return -1;
+}
+
+void handle_kill(ParsedCommand* parsed_cmd)
 {
-    for (int i = 0; i < job_count; i++)
+    char** args = parsed_cmd->args + 1;
+    int sig = SIGTERM;
+    if (args[0] && strcmp(args[0], "-l") == 0)
+    {
+        for (size_t i = 0; i < sizeof(signal_names) / sizeof(signal_names[0]); i++)
+        {
+            printf("%2d) SIG%s\n", signal_names[i].number, signal_names[i].name);
+        }
+        return;
+    }
+    if (args[0] && strcmp(args[0], "-s") == 0 && args[1])
+    {
+        sig = parse_signal(args[1]);
+        args += 2;
+    }
+    else if (args[0] && args[0][0] == '-')
+    {
+        sig = parse_signal(args[0] + 1);
+        args++;
+    }
+    if (sig == -1 || args[0] == NULL)
+    {
+        fprintf(stderr, "Usage: kill [-s signal | -signal] %%job | pid ...\n");
+        return;
+    }
+    for (; *args; args++)
     {
-        if (strcmp(jobs[i].command, "start_monitor") == 0)
+        if ((*args)[0] == '%')
         {
-            pid_t monitor_pid = jobs[i].pid;
-            if (kill(monitor_pid, 2) == 0)
+            Job* job = job_argument("kill", *args);
+            if (job && job->state == JOB_QUEUED)
             {
-                printf("\n\033[1;31m=========================================\033[0m\n");
-                printf("\033[1;31m|      Monitor Process Terminated       |\033[0m\n");
-                printf("\033[1;31m=========================================\033[0m\n");
-                printf("\033[1;33mMonitor with PID %d has been successfully stopped.\033[0m\n\n", monitor_pid);
-                for (int j = i; j < job_count - 1; j++)
-                {
-                    jobs[j] = jobs[j + 1];
-                }
-                job_count--;
-                return;
+                // Nothing runs yet, so whatever the signal, the job is dropped from the queue.
+                printf("[%d]+ Cancelled %s\n", job->job_id, job->command);
+                scheduler_cancel(job);
             }
-            else
+            else if (job && signal_job(job, sig) == -1)
             {
-                perror("Failed to stop monitor");
-                return;
+                fprintf(stderr, "kill: %s: %s\n", *args, strerror(errno));
             }
+            continue;
+        }
+        char* end;
+        long pid = strtol(*args, &end, 10);
+        if (*end != '\0' || pid == 0)
+        {
+            fprintf(stderr, "kill: %s: arguments must be process or job IDs\n", *args);
+        }
+        else if (kill((pid_t)pid, sig) == -1)
+        {
+            fprintf(stderr, "kill: %s: %s\n", *args, strerror(errno));
         }
     }
-    printf("No active monitor found to stop.\n");
 }
 
-void retrive_metrics(const char* fifo_path, const char* monitor_path)
+static unsigned int wait_signals; /**< interrupt_count when wait started. */
+
+/**
+ * @brief Tells whether wait is done: the given job, or every user job, no longer running, or an interrupt.
+ *
+ * The job is passed by ID and looked up on every check, since jobs started meanwhile may grow the table.
+ */
+static bool wait_done(void* arg)
 {
-    if (unlink(fifo_path) == -1 && errno != ENOENT)
+    if (interrupt_count != wait_signals)
+    {
+        return true;
+    }
+    int job_id = (int)(intptr_t)arg;
+    if (job_id)
+    {
+        const Job* job = &jobs[job_id - 1];
+        return job->job_id != job_id || (job->state != JOB_RUNNING && job->state != JOB_QUEUED);
+    }
+    for (size_t i = 0; i < job_capacity; i++)
+    {
+        const Job* job = &jobs[i];
+        if (job->job_id && job->is_background && job->on_complete == NULL &&
+            (job->state == JOB_RUNNING || job->state == JOB_QUEUED) &&
+            !(monitor_running() && job->pid == monitor_pid()))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void handle_wait(ParsedCommand* parsed_cmd)
+{
+    Job* job = NULL;
+    if (parsed_cmd->args[1] && (job = job_argument("wait", parsed_cmd->args[1])) == NULL)
     {
-        perror("unlink failed");
         return;
     }
-    if (create_fifo(FIFO_PATH, 0666) == -1)
+    wait_signals = interrupt_count;
+    wait_for_jobs_until(wait_done, (void*)(intptr_t)(job ? job->job_id : 0));
+}
+
+void handle_sched(ParsedCommand* parsed_cmd)
+{
+    const char* setting = parsed_cmd->args[1];
+    if (setting == NULL)
     {
+        printf("Background jobs: %zu running, %zu queued, ", scheduler_running(), scheduler_queued());
+        if (scheduler_limit() == 0)
+        {
+            printf("no limit");
+        }
+        else
+        {
+            printf("at most %zu at once", scheduler_limit());
+        }
+        printf(", spread over %s\n", placement_spread_name(scheduler_spread()));
         return;
     }
-    pid_t writer_pid = fork();
-    if (writer_pid < 0)
+    const char* value = parsed_cmd->args[2];
+    if (strcmp(setting, "spread") == 0 && value && parsed_cmd->args[3] == NULL)
     {
-        perror("fork failed");
+        for (PlacementSpread spread = PLACEMENT_SPREAD_OFF; spread <= PLACEMENT_SPREAD_NODES; spread++)
+        {
+            if (strcmp(value, placement_spread_name(spread)) == 0)
+            {
+                scheduler_set_spread(spread);
+                return;
+            }
+        }
+    }
+    char* end = NULL;
+    long limit = value ? strtol(value, &end, 10) : -1;
+    if (value && strcmp(value, "auto") == 0)
+    {
+        limit = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    else if (value && strcmp(value, "off") == 0)
+    {
+        limit = 0;
+    }
+    else if (end == value || (end && *end != '\0'))
+    {
+        limit = -1;
+    }
+    if (strcmp(setting, "limit") != 0 || parsed_cmd->args[3] || limit < 0)
+    {
+        fprintf(stderr, "Usage: sched [limit <jobs> | limit auto | limit off | spread cores | spread nodes | "
+                        "spread off]\n");
         return;
     }
-    else if (writer_pid == 0)
+    scheduler_set_limit((size_t)limit);
+}
+
+void handle_stats(ParsedCommand* parsed_cmd)
+{
+    if (parsed_cmd->args[1] == NULL)
+    {
+        stats_print();
+    }
+    else if (strcmp(parsed_cmd->args[1], "reset") == 0)
+    {
+        stats_reset();
+    }
+    else
+    {
+        fprintf(stderr, "Usage: stats [reset]\n");
+    }
+}
+
+void apply_config(void)
+{
+    cJSON* item = cJSON_GetObjectItem(root, "interval");
+    if (cJSON_IsNumber(item) && item->valueint > 0 && item->valueint != interval)
     {
-        FILE* fifo_file = fopen(fifo_path, "w");
-        if (fifo_file == NULL)
+        interval = item->valueint;
+        if (monitor_running())
         {
-            perror("fopen fifo for writing failed");
-            exit(EXIT_FAILURE);
+            monitor_request(MONITOR_MSG_SET_INTERVAL, (uint32_t)interval, NULL, NULL);
         }
-        if (fwrite("1", sizeof(char), 1, fifo_file) != 1)
+    }
+    char metric_list[MONITOR_PAYLOAD_SIZE];
+    int count = join_config_metrics(metric_list, sizeof(metric_list), ",");
+    if (count >= 0 && monitor_running())
+    {
+        monitor_request(MONITOR_MSG_SET_METRICS, (uint32_t)count, metric_list, NULL);
+    }
+}
+
+void handle_stop_monitor(ParsedCommand* parsed_cmd)
+{
+    pid_t pid = monitor_pid();
+    bool builtin = monitor_is_builtin();
+    if (monitor_stop() == -1)
+    {
+        printf("No active monitor found to stop.\n");
+        return;
+    }
+    if (builtin)
+    {
+        printf("\033[1;33mThe built-in /proc sampler has been stopped.\033[0m\n\n");
+        return;
+    }
+    printf("\n\033[1;31m=========================================\033[0m\n");
+    printf("\033[1;31m|      Monitor Process Terminated       |\033[0m\n");
+    printf("\033[1;31m=========================================\033[0m\n");
+    printf("\033[1;33mMonitor with PID %d has been successfully stopped.\033[0m\n\n", pid);
+}
+
+static bool discovery_started = false; /**< Whether retrive_metrics has run, at startup or on first use. */
+static bool discovery_pending = false;
+static bool discovery_timed_out = false;
+static bool discovery_cancelled = false;
+static pid_t discovery_pid = -1;
+static int discovery_timer = -1;
+
+/**
+ * @brief Loads whatever the discovery produced and fills in the configuration keys the file does not have.
+ *
+ * An interval or metric list already in the file is the user's choice and is left alone.
+ */
+static void finish_metric_discovery(bool found)
+{
+    if (discovery_timer != -1)
+    {
+        event_loop_remove_timer(discovery_timer);
+        discovery_timer = -1;
+    }
+    monitor_fifo_cancel();
+    discovery_pending = false;
+    if (discovery_cancelled)
+    {
+        return; // The shell is exiting; leave the previous configuration alone.
+    }
+    if (found)
+    {
+        initialize_metrics_from_status_file(METRICS_FILE);
+    }
+    if (root == NULL || !cJSON_IsNumber(cJSON_GetObjectItem(root, "interval")))
+    {
+        config_set_interval(interval);
+    }
+    if (num_metrics > 0 && (root == NULL || !cJSON_IsArray(cJSON_GetObjectItem(root, "metrics"))))
+    {
+        config_set_metrics(metrics, num_metrics);
+    }
+}
+
+static void metric_discovery_done(Job* job, void* data)
+{
+    int status = exit_status_from_wait(job->status);
+    if (status != 0 && !discovery_timed_out && !discovery_cancelled)
+    {
+        fprintf(stderr, "Metric discovery failed: monitor exited with status %d\n", status);
+    }
+    finish_metric_discovery(status == 0);
+}
+
+static void metric_discovery_timeout(int fd, uint32_t events, void* data)
+{
+    fprintf(stderr, "Metric discovery timed out, continuing without metrics\n");
+    discovery_timed_out = true;
+    event_loop_remove_timer(discovery_timer);
+    discovery_timer = -1;
+    // The completion callback still runs once the monitor is reaped.
+    killpg(discovery_pid, SIGKILL);
+}
+
+/**
+ * @brief Offers the built-in sampler's metrics when there is no monitor binary to discover them from.
+ */
+static void initialize_builtin_metrics(void)
+{
+    num_metrics = 0;
+    for (size_t i = 0; i < sampler_metric_count() && num_metrics < MAX_ARGS; i++)
+    {
+        metrics[num_metrics] = strdup(sampler_metric_name(i));
+        if (metrics[num_metrics] == NULL)
         {
-            perror("fwrite to fifo failed");
-            fclose(fifo_file);
-            exit(EXIT_FAILURE);
+            perror("strdup failed");
+            return;
         }
-        fclose(fifo_file);
-        exit(EXIT_SUCCESS);
+        num_metrics++;
+    }
+}
+
+void retrive_metrics(const char* fifo_path, const char* monitor_path, unsigned int timeout_ms)
+{
+    discovery_started = true;
+    discovery_pending = true;
+    discovery_timed_out = false;
+    discovery_cancelled = false;
+    if (access(monitor_path, X_OK) == -1)
+    {
+        initialize_builtin_metrics();
+        finish_metric_discovery(false);
+        return;
+    }
+    if (unlink(fifo_path) == -1 && errno != ENOENT)
+    {
+        perror("unlink failed");
+        finish_metric_discovery(false);
+        return;
+    }
+    if (!event_loop_active() || monitor_fifo_send(fifo_path, "1") == -1)
+    {
+        finish_metric_discovery(false);
+        return;
     }
-    pid_t monitor_pid = fork();
-    if (monitor_pid < 0)
+    fflush(stdout);
+    discovery_pid = fork_shell();
+    if (discovery_pid < 0)
     {
         perror("fork failed");
+        finish_metric_discovery(false);
         return;
     }
-    else if (monitor_pid == 0)
+    else if (discovery_pid == 0)
     {
+        setpgid(0, 0); // Its own group, so a timeout also kills anything the monitor started.
+        reset_signal_mask();
+        event_loop_detach();
         execl(monitor_path, monitor_path, (char*)NULL);
         perror("execl failed");
         exit(EXIT_FAILURE);
     }
-    else
+    setpgid(discovery_pid, discovery_pid);
+    Job* job = create_job(&discovery_pid, 1, "metric discovery", false);
+    if (job == NULL)
+    {
+        kill(discovery_pid, SIGKILL);
+        finish_metric_discovery(false);
+        return;
+    }
+    job_on_complete(job, metric_discovery_done, NULL);
+    discovery_timer = event_loop_add_timer(timeout_ms, false, metric_discovery_timeout, NULL);
+}
+
+static bool metric_discovery_finished(void* arg)
+{
+    return !discovery_pending;
+}
+
+void wait_for_metric_discovery(void)
+{
+    if (discovery_pending)
     {
-        waitpid(writer_pid, NULL, 0);
-        waitpid(monitor_pid, NULL, 0);
+        wait_for_jobs_until(metric_discovery_finished, NULL);
     }
 }
 
-void create_config_file(const char* config_file, int interval, char** metrics, size_t num_metrics)
+void require_metrics(void)
 {
-    if (root)
+    if (num_metrics == 0 && !discovery_started)
     {
-        cJSON_Delete(root);
+        retrive_metrics(fifo_path, monitor_path, DISCOVERY_TIMEOUT_MS);
     }
-    root = cJSON_CreateObject();
-    cJSON_AddNumberToObject(root, "interval", interval);
-    cJSON* metrics_array = cJSON_CreateArray();
-    cJSON_AddItemToObject(root, "metrics", metrics_array);
-    for (size_t i = 0; i < num_metrics; i++)
+    wait_for_metric_discovery();
+}
+
+void cancel_metric_discovery(void)
+{
+    if (discovery_pending)
     {
-        cJSON_AddItemToArray(metrics_array, cJSON_CreateString(metrics[i]));
+        discovery_cancelled = true;
+        killpg(discovery_pid, SIGKILL);
+        wait_for_metric_discovery();
     }
-    char* json_string = cJSON_Print(root);
-    if (json_string == NULL)
+}
+
+/**
+ * @brief Formats a sample's timestamp as local wall-clock time with milliseconds.
+ */
+static void format_sample_time(uint64_t timestamp_ns, char* buffer, size_t size)
+{
+    time_t seconds = (time_t)(timestamp_ns / 1000000000u);
+    struct tm local;
+    localtime_r(&seconds, &local);
+    size_t length = strftime(buffer, size, "%H:%M:%S", &local);
+    snprintf(buffer + length, size - length, ".%03u", (unsigned int)(timestamp_ns / 1000000u % 1000u));
+}
+
+static void print_latest_samples(const MetricsSnapshot* snapshot)
+{
+    printf("  %-5s | %-24s | %-14s | %s\n", "ID", "Metric", "Value", "Sampled at");
+    for (uint32_t i = 0; i < snapshot->num_names; i++)
+    {
+        const MetricRecord* record = &snapshot->latest[i];
+        char sampled_at[32] = "-";
+        if (record->timestamp_ns)
+        {
+            format_sample_time(record->timestamp_ns, sampled_at, sizeof(sampled_at));
+        }
+        printf("  %-5u | %-24s | %-14.3f | %s\n", i + 1, snapshot->names[i], record->value, sampled_at);
+    }
+    fflush(stdout);
+}
+
+static void print_last_samples(const MetricsRing* ring, size_t count)
+{
+    MetricsSnapshot snapshot;
+    MetricRecord* records = malloc(count * sizeof(MetricRecord));
+    if (records == NULL)
     {
-        fprintf(stderr, "Failed to print JSON\n");
+        perror("malloc failed");
         return;
     }
-    FILE* config_file_fp = fopen(config_file, "w");
-    if (config_file_fp == NULL)
+    ssize_t copied = metrics_ring_last(ring, records, count);
+    if (copied == -1)
     {
-        perror("fopen");
-        free(json_string);
+        fprintf(stderr, "Metrics unavailable: the monitor left its ring mid-write.\n");
+        free(records);
         return;
     }
-    fprintf(config_file_fp, "%s\n", json_string);
-    fclose(config_file_fp);
-    free(json_string);
+    if (metrics_ring_snapshot(ring, &snapshot) == -1)
+    {
+        snapshot.num_names = 0;
+    }
+    printf("  %-12s | %-24s | %s\n", "Sampled at", "Metric", "Value");
+    for (size_t i = 0; i < (size_t)copied; i++)
+    {
+        char sampled_at[32];
+        format_sample_time(records[i].timestamp_ns, sampled_at, sizeof(sampled_at));
+        const char* name = records[i].metric_id < snapshot.num_names ? snapshot.names[records[i].metric_id] : "?";
+        printf("  %-12s | %-24s | %.3f\n", sampled_at, name, records[i].value);
+    }
+    free(records);
+}
+
+static uint64_t watch_head;        /**< Ring head when the watch last printed. */
+static int watch_remaining;        /**< Updates left to print, -1 for no limit. */
+static unsigned int watch_signals; /**< interrupt_count when the watch started. */
+
+static void watch_tick(int fd, uint32_t events, void* data)
+{
+    MetricsSnapshot snapshot;
+    if (metrics_ring_snapshot(data, &snapshot) == -1)
+    {
+        fprintf(stderr, "Metrics unavailable: the monitor left its ring mid-write.\n");
+        watch_remaining = 0;
+        return;
+    }
+    if (snapshot.head != watch_head)
+    {
+        watch_head = snapshot.head;
+        printf("\n");
+        print_latest_samples(&snapshot);
+        if (watch_remaining > 0)
+        {
+            watch_remaining--;
+        }
+    }
+}
+
+static bool watch_done(void* arg)
+{
+    return watch_remaining == 0 || interrupt_count != watch_signals || !monitor_running();
+}
+
+/**
+ * @brief Prints the latest samples every time the monitor publishes, until interrupted or count updates.
+ */
+static void watch_samples(const MetricsRing* ring, int count)
+{
+    watch_head = 0;
+    watch_remaining = count > 0 ? count : -1;
+    watch_signals = interrupt_count;
+    int timer_fd = -1;
+    if (event_loop_active())
+    {
+        timer_fd = event_loop_add_timer(250, true, watch_tick, (void*)ring);
+    }
+    if (timer_fd == -1)
+    {
+        watch_tick(-1, 0, (void*)ring);
+        return;
+    }
+    watch_tick(timer_fd, 0, (void*)ring);
+    wait_for_jobs_until(watch_done, NULL);
+    event_loop_remove_timer(timer_fd);
 }
 
 void handle_status_monitor(ParsedCommand* parsed_cmd)
 {
-    FILE* file = fopen(STATUS_FILE, "r");
-    if (!file)
+    const MetricsRing* ring = monitor_metrics();
+    MetricsSnapshot snapshot;
+    bool unavailable = ring && metrics_ring_snapshot(ring, &snapshot) == -1;
+    bool published = ring && !unavailable && snapshot.head > 0;
+    const char* option = parsed_cmd->args[1];
+    if (option && strcmp(option, "--last") != 0 && strcmp(option, "--watch") != 0)
+    {
+        fprintf(stderr, "Usage: status_monitor [--watch [updates] | --last <samples>]\n");
+        return;
+    }
+    if (unavailable)
+    {
+        fprintf(stderr, "Metrics unavailable: the monitor left its ring mid-write.\n");
+        return;
+    }
+    if (option && !published)
+    {
+        fprintf(stderr, "The monitor has not published any samples.\n");
+        return;
+    }
+    if (option && strcmp(option, "--last") == 0)
+    {
+        int count = parsed_cmd->args[2] ? atoi(parsed_cmd->args[2]) : 10;
+        print_last_samples(ring, count > 0 && count <= METRICS_RING_CAPACITY ? (size_t)count : 10);
+        return;
+    }
+    if (option)
+    {
+        watch_samples(ring, parsed_cmd->args[2] ? atoi(parsed_cmd->args[2]) : 0);
+        return;
+    }
+
+    if (published)
+    {
+        printf("\n\033[1;34m=========================================\033[0m\n");
+        printf("\033[1;34m|          Monitor Status Report        |\033[0m\n");
+        printf("\033[1;34m=========================================\033[0m\n\n");
+        print_latest_samples(&snapshot);
+        printf("\n\033[1;34m=========================================\033[0m\n");
+        return;
+    }
+
+    // Monitors that do not publish into the ring are asked for a text snapshot or read from their file.
+    MonitorMessage reply;
+    bool live = monitor_running() && monitor_request(MONITOR_MSG_SNAPSHOT, 0, NULL, &reply) == 0;
+    FILE* file = NULL;
+    if (!live && (file = fopen(STATUS_FILE, "r")) == NULL)
     {
         perror("\033[1;31mFailed to open status file\033[0m");
         return;
@@ -339,13 +1028,122 @@ void handle_status_monitor(ParsedCommand* parsed_cmd)
     printf("\033[1;34m|          Monitor Status Report        |\033[0m\n");
     printf("\033[1;34m=========================================\033[0m\n\n");
 
-    char buffer[INPUT_BUFFER_SIZE];
-    while (fgets(buffer, sizeof(buffer), file))
+    if (live)
+    {
+        printf("\033[1;37m%s\033[0m", reply.payload);
+    }
+    else
     {
-        printf("\033[1;37m%s\033[0m", buffer);
+        char buffer[INPUT_BUFFER_SIZE];
+        while (fgets(buffer, sizeof(buffer), file))
+        {
+            printf("\033[1;37m%s\033[0m", buffer);
+        }
+        fclose(file);
+        time_t updated = monitor_status_updated();
+        if (updated)
+        {
+            printf("\n\033[1;33mLast update: %lds ago\033[0m\n", (long)(time(NULL) - updated));
+        }
     }
     printf("\n\033[1;34m=========================================\033[0m\n");
-    fclose(file);
+}
+
+/**
+ * @brief Parses a range such as 90, 90s, 15m, 2h or 7d into nanoseconds.
+ */
+static int parse_range(const char* text, uint64_t* range_ns)
+{
+    char* end;
+    errno = 0;
+    unsigned long long amount = strtoull(text, &end, 10);
+    const char* units = "smhd";
+    static const uint64_t seconds[] = {1, 60, 3600, 86400};
+    const char* unit = *end ? strchr(units, *end) : units;
+    if (errno || end == text || unit == NULL || (*end && end[1]) || amount == 0 || amount > 100000)
+    {
+        return -1;
+    }
+    *range_ns = amount * seconds[unit - units] * 1000000000ull;
+    return 0;
+}
+
+void handle_history(ParsedCommand* parsed_cmd)
+{
+    monitor_collect();
+    const char* metric = parsed_cmd->args[1];
+    if (metric == NULL)
+    {
+        if (series_count() == 0)
+        {
+            printf("No metric history yet; start the monitor to record some.\n");
+        }
+        for (size_t i = 0; i < series_count(); i++)
+        {
+            uint64_t samples;
+            const char* name = series_name(i, &samples);
+            printf("  %-24s %llu samples\n", name, (unsigned long long)samples);
+        }
+        return;
+    }
+    uint64_t range_ns = 3600ull * 1000000000ull;
+    if (parsed_cmd->args[2] && (parsed_cmd->args[3] || parse_range(parsed_cmd->args[2], &range_ns) == -1))
+    {
+        fprintf(stderr, "Usage: history [<metric> [<number>[s|m|h|d]]]\n");
+        return;
+    }
+
+    static SeriesBucket buckets[SERIES_RAW_CAPACITY];
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    uint64_t now_ns = (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+    uint64_t started = stats_now();
+    SeriesTier tier;
+    long count = series_query(metric, now_ns > range_ns ? now_ns - range_ns : 0, &tier, buckets, SERIES_RAW_CAPACITY);
+    uint64_t elapsed = stats_now() - started;
+    if (count == -1)
+    {
+        fprintf(stderr, "history: no samples of %s\n", metric);
+        return;
+    }
+
+    static const char* const tier_names[SERIES_TIER_COUNT] = {"samples", "minute buckets", "hour buckets"};
+    double min = count ? buckets[0].min : 0, max = count ? buckets[0].max : 0, sum = 0;
+    uint64_t samples = 0;
+    for (long i = 0; i < count; i++)
+    {
+        min = buckets[i].min < min ? buckets[i].min : min;
+        max = buckets[i].max > max ? buckets[i].max : max;
+        sum += buckets[i].sum;
+        samples += buckets[i].count;
+    }
+    printf("%s over the last %s: %ld %s, min %.3f, avg %.3f, max %.3f (queried in %.1f us)\n", metric,
+           parsed_cmd->args[2] ? parsed_cmd->args[2] : "1h", count, tier_names[tier], min,
+           samples ? sum / (double)samples : 0.0, max, (double)elapsed / 1e3);
+    if (tier == SERIES_RAW)
+    {
+        printf("  %-12s | %s\n", "Sampled at", "Value");
+    }
+    else
+    {
+        printf("  %-16s | %-12s | %-12s | %-12s | %s\n", "Starting at", "Min", "Avg", "Max", "Samples");
+    }
+    for (long i = 0; i < count; i++)
+    {
+        char when[32];
+        if (tier == SERIES_RAW)
+        {
+            format_sample_time(buckets[i].start_ns, when, sizeof(when));
+            printf("  %-12s | %.3f\n", when, buckets[i].min);
+            continue;
+        }
+        time_t seconds = (time_t)(buckets[i].start_ns / 1000000000u);
+        struct tm local;
+        localtime_r(&seconds, &local);
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M", &local);
+        printf("  %-16s | %-12.3f | %-12.3f | %-12.3f | %u\n", when, buckets[i].min,
+               buckets[i].sum / buckets[i].count, buckets[i].max, buckets[i].count);
+    }
 }
 
 void initialize_metrics_from_status_file(const char* status_file)
@@ -0,0 +1,443 @@
+/**
+ * @file config.c
+ * @brief Implementation of the debounced, atomic configuration file writer.
+ */
+#include "config.h"
+#include "event_loop.h"
+#include "utils.h"
+#include <libgen.h>
+#include <sys/inotify.h>
+
+static char config_path[MAX_PATH] = CONFIG_FILE; /**< Absolute path, so a `cd` does not move the file. */
+static char config_dir[MAX_PATH] = ".";          /**< Directory holding the configuration file. */
+static bool dirty = false;                       /**< Whether `root` has changes the file does not have yet. */
+static int write_timer = -1;                     /**< Timer that ends the current write window, -1 when none is open. */
+static int inotify_fd = -1;
+static char config_name[MAX_PATH]; /**< Base name of the configuration file inside the watched directory. */
+static ConfigReloadHandler reload_handler = NULL;
+static time_t loaded_at = 0;       /**< When the configuration was last read from disk. */
+static off_t file_size = -1;       /**< Size of the file as last read or written by the shell. */
+static struct timespec file_mtime; /**< Modification time of the file as last read or written by the shell. */
+static uint32_t file_hash = 0;     /**< Hash of the file's contents as last read or written by the shell. */
+
+/**
+ * @brief Returns the configuration object, creating an empty one if none has been loaded.
+ */
+static cJSON* config_root(void)
+{
+    if (root == NULL)
+    {
+        root = cJSON_CreateObject();
+    }
+    return root;
+}
+
+/**
+ * @brief Reads the whole configuration file into a NUL-terminated buffer the caller frees.
+ */
+static char* read_config_file(struct stat* info)
+{
+    int fd = open(config_path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return NULL;
+    }
+    char* contents = NULL;
+    if (fstat(fd, info) == 0 && (contents = malloc((size_t)info->st_size + 1)) != NULL)
+    {
+        ssize_t length = pread(fd, contents, (size_t)info->st_size, 0);
+        if (length == -1)
+        {
+            free(contents);
+            contents = NULL;
+        }
+        else
+        {
+            contents[length] = '\0';
+        }
+    }
+    int saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+    return contents;
+}
+
+/**
+ * @brief Remembers the size, modification time and hash of the file as it is on disk now.
+ */
+static void remember_file(const struct stat* info, const char* contents)
+{
+    file_size = info->st_size;
+    file_mtime = info->st_mtim;
+    file_hash = hash_string(contents);
+}
+
+/**
+ * @brief Resolves the configuration file's directory once, so every later access uses the same absolute path.
+ */
+static void resolve_config_path(const char* config_file)
+{
+    char dir_path[MAX_PATH];
+    char base_path[MAX_PATH];
+    snprintf(dir_path, sizeof(dir_path), "%s", config_file);
+    snprintf(base_path, sizeof(base_path), "%s", config_file);
+    snprintf(config_name, sizeof(config_name), "%s", basename(base_path));
+    char* resolved = realpath(dirname(dir_path), NULL);
+    if (resolved == NULL)
+    {
+        perror("Failed to resolve the configuration directory");
+        snprintf(config_dir, sizeof(config_dir), "%s", dirname(dir_path));
+        snprintf(config_path, sizeof(config_path), "%s", config_file);
+        return;
+    }
+    int length = snprintf(config_path, sizeof(config_path), "%s/%s", strcmp(resolved, "/") == 0 ? "" : resolved,
+                          config_name);
+    if (length < 0 || (size_t)length >= sizeof(config_path))
+    {
+        fprintf(stderr, "Configuration path too long, using %s\n", config_file);
+        snprintf(config_path, sizeof(config_path), "%s", config_file);
+    }
+    snprintf(config_dir, sizeof(config_dir), "%s", resolved);
+    free(resolved);
+}
+
+int config_init(const char* config_file)
+{
+    resolve_config_path(config_file);
+    struct stat info;
+    char* contents = read_config_file(&info);
+    if (contents == NULL)
+    {
+        config_root();
+        if (errno != ENOENT)
+        {
+            perror("Failed to read configuration file");
+            return -1;
+        }
+        return 0;
+    }
+    remember_file(&info, contents);
+    cJSON* loaded = cJSON_Parse(contents);
+    free(contents);
+    if (!cJSON_IsObject(loaded))
+    {
+        fprintf(stderr, "Ignoring unreadable configuration file %s\n", config_path);
+        cJSON_Delete(loaded);
+        config_root();
+        return -1;
+    }
+    cJSON_Delete(root);
+    root = loaded;
+    loaded_at = time(NULL);
+    return 0;
+}
+
+int config_reload(void)
+{
+    struct stat info;
+    if (stat(config_path, &info) == -1)
+    {
+        return errno == ENOENT ? 0 : -1;
+    }
+    if (info.st_size == file_size && info.st_mtim.tv_sec == file_mtime.tv_sec &&
+        info.st_mtim.tv_nsec == file_mtime.tv_nsec)
+    {
+        return 0;
+    }
+    char* contents = read_config_file(&info);
+    if (contents == NULL)
+    {
+        return errno == ENOENT ? 0 : -1;
+    }
+    uint32_t hash = hash_string(contents);
+    if (hash == file_hash && info.st_size == file_size)
+    {
+        // Touched or rewritten with the same contents.
+        remember_file(&info, contents);
+        free(contents);
+        return 0;
+    }
+    cJSON* loaded = cJSON_Parse(contents);
+    if (!cJSON_IsObject(loaded))
+    {
+        // Possibly caught between an editor's truncate and write; the next event brings the rest.
+        cJSON_Delete(loaded);
+        free(contents);
+        return -1;
+    }
+    remember_file(&info, contents);
+    free(contents);
+    cJSON_Delete(root);
+    root = loaded;
+    loaded_at = time(NULL);
+    // The file on disk is newer than any change still waiting for its write window.
+    dirty = false;
+    if (write_timer != -1)
+    {
+        event_loop_remove_timer(write_timer);
+        write_timer = -1;
+    }
+    return 1;
+}
+
+static void handle_config_event(int fd, uint32_t events, void* data)
+{
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    bool changed = false;
+    ssize_t length;
+    while ((length = read(fd, buffer, sizeof(buffer))) > 0)
+    {
+        for (char* p = buffer; p < buffer + length;)
+        {
+            const struct inotify_event* event = (const struct inotify_event*)p;
+            changed |= event->len && strcmp(event->name, config_name) == 0;
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+    if (changed && config_reload() == 1 && reload_handler)
+    {
+        reload_handler();
+    }
+}
+
+int config_watch(ConfigReloadHandler on_reload)
+{
+    reload_handler = on_reload;
+    if (inotify_fd != -1)
+    {
+        return 0;
+    }
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd == -1)
+    {
+        perror("inotify_init1 failed");
+        return -1;
+    }
+    // Watch the directory, since a file renamed over config.json is a new inode.
+    if (inotify_add_watch(inotify_fd, config_dir, IN_CLOSE_WRITE | IN_MOVED_TO) == -1 ||
+        event_loop_add(inotify_fd, EPOLLIN, 0, handle_config_event, NULL) == -1)
+    {
+        perror("Failed to watch the configuration file");
+        close(inotify_fd);
+        inotify_fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Writes the configuration to a temporary file, syncs it and renames it over the configuration file.
+ *
+ * The temporary file sits in the configuration file's own directory, so the rename stays within one file
+ * system, and carries the shell's PID, so two shells sharing the file never write into each other's copy.
+ */
+static int write_config_file(const char* json_string)
+{
+    char temp_path[2 * MAX_PATH + 32];
+    snprintf(temp_path, sizeof(temp_path), "%s/.%s.%d.tmp", config_dir, config_name, (int)getpid());
+    int fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1)
+    {
+        perror("open");
+        return -1;
+    }
+    size_t length = strlen(json_string);
+    size_t written = 0;
+    while (written < length)
+    {
+        ssize_t result = write(fd, json_string + written, length - written);
+        if (result == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (result == -1)
+        {
+            perror("write");
+            break;
+        }
+        written += (size_t)result;
+    }
+    if (written == length && fsync(fd) == -1)
+    {
+        perror("fsync");
+        written = 0;
+    }
+    close(fd);
+    if (written < length)
+    {
+        unlink(temp_path);
+        return -1;
+    }
+    if (rename(temp_path, config_path) == -1)
+    {
+        perror("rename");
+        unlink(temp_path);
+        return -1;
+    }
+    struct stat info;
+    if (stat(config_path, &info) == 0)
+    {
+        remember_file(&info, json_string); // So the watch does not reload our own write.
+    }
+    // Sync the directory too, so the rename itself survives a crash.
+    int dir_fd = open(config_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd != -1)
+    {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+    return 0;
+}
+
+int config_flush(void)
+{
+    if (write_timer != -1)
+    {
+        event_loop_remove_timer(write_timer);
+        write_timer = -1;
+    }
+    if (!dirty)
+    {
+        return 0;
+    }
+    dirty = false;
+    cJSON* version = cJSON_GetObjectItem(config_root(), "version");
+    if (cJSON_IsNumber(version))
+    {
+        cJSON_SetNumberValue(version, version->valuedouble + 1);
+    }
+    else
+    {
+        cJSON_DeleteItemFromObject(root, "version");
+        cJSON_AddNumberToObject(root, "version", 1);
+    }
+    char* json_string = cJSON_Print(root);
+    if (json_string == NULL)
+    {
+        fprintf(stderr, "Failed to print JSON\n");
+        return -1;
+    }
+    size_t length = strlen(json_string);
+    char* contents = realloc(json_string, length + 2);
+    if (contents == NULL)
+    {
+        perror("realloc failed");
+        free(json_string);
+        return -1;
+    }
+    memcpy(contents + length, "\n", 2);
+    int result = write_config_file(contents);
+    free(contents);
+    return result;
+}
+
+static void handle_write_timer(int fd, uint32_t events, void* data)
+{
+    config_flush();
+}
+
+/**
+ * @brief Marks the configuration as changed and opens a write window unless one is already open.
+ *
+ * The window is not extended by later changes, so a steady stream of changes is still written every
+ * CONFIG_WRITE_DELAY_MS. Without an event loop there is nothing to end the window, so the file is written
+ * at once.
+ */
+static void schedule_write(void)
+{
+    dirty = true;
+    if (write_timer != -1)
+    {
+        return;
+    }
+    if (event_loop_active())
+    {
+        write_timer = event_loop_add_timer(CONFIG_WRITE_DELAY_MS, false, handle_write_timer, NULL);
+    }
+    if (write_timer == -1)
+    {
+        config_flush();
+    }
+}
+
+void config_set_interval(int interval)
+{
+    cJSON* item = cJSON_GetObjectItem(config_root(), "interval");
+    if (cJSON_IsNumber(item) && item->valuedouble == (double)interval)
+    {
+        return;
+    }
+    if (cJSON_IsNumber(item))
+    {
+        cJSON_SetNumberValue(item, interval);
+    }
+    else
+    {
+        cJSON_DeleteItemFromObject(root, "interval");
+        cJSON_AddNumberToObject(root, "interval", interval);
+    }
+    schedule_write();
+}
+
+void config_set_metrics(char** metrics, size_t num_metrics)
+{
+    cJSON* metrics_array = cJSON_GetObjectItem(config_root(), "metrics");
+    if (!cJSON_IsArray(metrics_array))
+    {
+        cJSON_DeleteItemFromObject(root, "metrics");
+        metrics_array = cJSON_AddArrayToObject(root, "metrics");
+        if (metrics_array == NULL)
+        {
+            fprintf(stderr, "Failed to create the metrics array\n");
+            return;
+        }
+    }
+    bool changed = false;
+    cJSON* metric = metrics_array->child;
+    for (size_t i = 0; i < num_metrics; i++)
+    {
+        if (metric == NULL)
+        {
+            cJSON_AddItemToArray(metrics_array, cJSON_CreateString(metrics[i]));
+            changed = true;
+            continue;
+        }
+        if (!cJSON_IsString(metric))
+        {
+            cJSON_ReplaceItemInArray(metrics_array, (int)i, cJSON_CreateString(metrics[i]));
+            metric = cJSON_GetArrayItem(metrics_array, (int)i);
+            changed = true;
+        }
+        else if (strcmp(metric->valuestring, metrics[i]) != 0)
+        {
+            cJSON_SetValuestring(metric, metrics[i]);
+            changed = true;
+        }
+        metric = metric->next;
+    }
+    while (cJSON_GetArraySize(metrics_array) > (int)num_metrics)
+    {
+        cJSON_DeleteItemFromArray(metrics_array, (int)num_metrics);
+        changed = true;
+    }
+    if (changed)
+    {
+        schedule_write();
+    }
+}
+
+const char* config_file_path(void)
+{
+    return config_path;
+}
+
+time_t config_loaded_at(void)
+{
+    return loaded_at;
+}
+
+unsigned long config_version(void)
+{
+    cJSON* version = root ? cJSON_GetObjectItem(root, "version") : NULL;
+    return cJSON_IsNumber(version) ? (unsigned long)version->valuedouble : 0;
+}
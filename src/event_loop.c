@@ -0,0 +1,284 @@
+/**
+ * @file event_loop.c
+ * @brief Implementation of the shell's epoll-based event loop.
+ */
+#include "event_loop.h"
+#include <sys/timerfd.h>
+
+#define EVENT_LOOP_MAX_EVENTS 32 /**< Events fetched per epoll_wait. */
+
+/**
+ * @struct EventSource
+ * @brief A registered descriptor and what to do when it is ready.
+ */
+typedef struct
+{
+    EventHandler handler; /**< Callback to invoke. */
+    void* data;           /**< Pointer passed back to the callback. */
+    uint32_t events;      /**< epoll events of interest. */
+    int flags;            /**< Source flags (EVENT_LOOP_INPUT). */
+    bool registered;      /**< Whether the slot is in use. */
+    bool always_ready;    /**< The descriptor cannot be polled (e.g. a regular file). */
+    bool is_timer;        /**< The descriptor is a timerfd owned by the loop. */
+} EventSource;
+
+static int epoll_fd = -1;
+static EventSource* sources = NULL; /**< Sources indexed by descriptor. */
+static size_t sources_capacity = 0;
+static bool stop_requested = false;
+static int depth = 0;
+
+int event_loop_init(void)
+{
+    if (epoll_fd != -1)
+    {
+        return 0;
+    }
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd == -1)
+    {
+        perror("epoll_create1 failed");
+        return -1;
+    }
+    return 0;
+}
+
+bool event_loop_active(void)
+{
+    return epoll_fd != -1;
+}
+
+static int watch(int fd, uint32_t events)
+{
+    struct epoll_event event = {.events = events, .data.fd = fd};
+    return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+}
+
+int event_loop_add(int fd, uint32_t events, int flags, EventHandler handler, void* data)
+{
+    if (epoll_fd == -1 || fd < 0)
+    {
+        return -1;
+    }
+    if ((size_t)fd >= sources_capacity)
+    {
+        size_t new_capacity = sources_capacity ? sources_capacity : 16;
+        while (new_capacity <= (size_t)fd)
+        {
+            new_capacity *= 2;
+        }
+        EventSource* new_sources = realloc(sources, new_capacity * sizeof(EventSource));
+        if (new_sources == NULL)
+        {
+            perror("realloc failed");
+            return -1;
+        }
+        memset(new_sources + sources_capacity, 0, (new_capacity - sources_capacity) * sizeof(EventSource));
+        sources = new_sources;
+        sources_capacity = new_capacity;
+    }
+
+    EventSource* source = &sources[fd];
+    memset(source, 0, sizeof(*source));
+    source->handler = handler;
+    source->data = data;
+    source->events = events;
+    source->flags = flags;
+    bool paused = depth > 0 && (flags & EVENT_LOOP_INPUT);
+    if (!paused && watch(fd, events) == -1)
+    {
+        if (errno != EPERM)
+        {
+            perror("epoll_ctl failed");
+            return -1;
+        }
+        source->always_ready = true;
+    }
+    source->registered = true;
+    return 0;
+}
+
+void event_loop_remove(int fd)
+{
+    if (fd < 0 || (size_t)fd >= sources_capacity || !sources[fd].registered)
+    {
+        return;
+    }
+    if (!sources[fd].always_ready)
+    {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    }
+    sources[fd].registered = false;
+}
+
+int event_loop_set_timer(int timer_fd, unsigned int interval_ms, bool periodic)
+{
+    struct itimerspec spec = {0};
+    spec.it_value.tv_sec = interval_ms / 1000;
+    spec.it_value.tv_nsec = (long)(interval_ms % 1000) * 1000000L;
+    if (periodic)
+    {
+        spec.it_interval = spec.it_value;
+    }
+    if (timerfd_settime(timer_fd, 0, &spec, NULL) == -1)
+    {
+        perror("timerfd_settime failed");
+        return -1;
+    }
+    return 0;
+}
+
+int event_loop_add_timer(unsigned int interval_ms, bool periodic, EventHandler handler, void* data)
+{
+    int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd == -1)
+    {
+        perror("timerfd_create failed");
+        return -1;
+    }
+    if (event_loop_add(timer_fd, EPOLLIN, 0, handler, data) == -1 ||
+        event_loop_set_timer(timer_fd, interval_ms, periodic) == -1)
+    {
+        event_loop_remove(timer_fd);
+        close(timer_fd);
+        return -1;
+    }
+    sources[timer_fd].is_timer = true;
+    return timer_fd;
+}
+
+void event_loop_remove_timer(int timer_fd)
+{
+    event_loop_remove(timer_fd);
+    close(timer_fd);
+}
+
+static void dispatch(int fd, uint32_t events)
+{
+    if ((size_t)fd >= sources_capacity || !sources[fd].registered)
+    {
+        return;
+    }
+    EventSource* source = &sources[fd];
+    if (depth > 0 && (source->flags & EVENT_LOOP_INPUT))
+    {
+        return;
+    }
+    if (source->is_timer)
+    {
+        uint64_t expirations;
+        if (read(fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+        {
+            return;
+        }
+    }
+    // The handler may register new sources and move the table, so nothing is read from it afterwards.
+    source->handler(fd, events, source->data);
+}
+
+int event_loop_run_once(int timeout_ms)
+{
+    bool ready_now = false;
+    for (size_t fd = 0; fd < sources_capacity && !ready_now; fd++)
+    {
+        ready_now = sources[fd].registered && sources[fd].always_ready &&
+                    !(depth > 0 && (sources[fd].flags & EVENT_LOOP_INPUT));
+    }
+
+    struct epoll_event events[EVENT_LOOP_MAX_EVENTS];
+    int count = epoll_wait(epoll_fd, events, EVENT_LOOP_MAX_EVENTS, ready_now ? 0 : timeout_ms);
+    if (count == -1)
+    {
+        if (errno == EINTR)
+        {
+            return 0;
+        }
+        perror("epoll_wait failed");
+        return -1;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        dispatch(events[i].data.fd, events[i].events);
+    }
+    for (size_t fd = 0; ready_now && fd < sources_capacity; fd++)
+    {
+        if (sources[fd].registered && sources[fd].always_ready)
+        {
+            dispatch((int)fd, EPOLLIN);
+            count++;
+        }
+    }
+    return count;
+}
+
+void event_loop_run(void)
+{
+    stop_requested = false;
+    while (!stop_requested && event_loop_run_once(-1) != -1)
+    {
+    }
+}
+
+void event_loop_stop(void)
+{
+    stop_requested = true;
+}
+
+/**
+ * @brief Takes input sources out of (or back into) the epoll set, so a paused source that hung up cannot
+ * make epoll_wait spin.
+ */
+static void set_input_paused(bool paused)
+{
+    for (size_t fd = 0; fd < sources_capacity; fd++)
+    {
+        EventSource* source = &sources[fd];
+        if (!source->registered || source->always_ready || !(source->flags & EVENT_LOOP_INPUT))
+        {
+            continue;
+        }
+        if (paused)
+        {
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, (int)fd, NULL);
+        }
+        else if (watch((int)fd, source->events) == -1 && errno == EPERM)
+        {
+            source->always_ready = true;
+        }
+    }
+}
+
+void event_loop_wait_until(bool (*done)(void* arg), void* arg)
+{
+    if (depth++ == 0)
+    {
+        set_input_paused(true);
+    }
+    while (!done(arg) && event_loop_run_once(-1) != -1)
+    {
+    }
+    if (--depth == 0)
+    {
+        set_input_paused(false);
+    }
+}
+
+int event_loop_depth(void)
+{
+    return depth;
+}
+
+void event_loop_detach(void)
+{
+    if (epoll_fd == -1)
+    {
+        return;
+    }
+    // The epoll instance is shared with the parent, so it is closed without removing anything from it.
+    close(epoll_fd);
+    epoll_fd = -1;
+    free(sources);
+    sources = NULL;
+    sources_capacity = 0;
+    depth = 0;
+}
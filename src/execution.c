@@ -1,180 +1,464 @@
 #include "execution.h"
+#include "builtins.h"
+#include "event_loop.h"
+#include "placement.h"
+#include "scheduler.h"
+#include "spawner.h"
+#include "stats.h"
+#include <sys/resource.h>
+#include <time.h>
 
-void execute_command(ParsedCommand* parsed_cmd)
+/**
+ * @brief Runs a builtin in the shell and reports its usage, taken from the shell's own counters.
+ */
+static void time_internal_command(ParsedCommand* parsed_cmd)
+{
+    struct rusage before, after;
+    struct timespec start, end;
+    getrusage(RUSAGE_SELF, &before);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    handle_internal_command(parsed_cmd);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    getrusage(RUSAGE_SELF, &after);
+    JobUsage usage = {
+        .wall_seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9,
+        .user_seconds = (double)(after.ru_utime.tv_sec - before.ru_utime.tv_sec) +
+                        (double)(after.ru_utime.tv_usec - before.ru_utime.tv_usec) / 1e6,
+        .system_seconds = (double)(after.ru_stime.tv_sec - before.ru_stime.tv_sec) +
+                          (double)(after.ru_stime.tv_usec - before.ru_stime.tv_usec) / 1e6,
+        .max_rss_kb = after.ru_maxrss,
+        .voluntary_switches = after.ru_nvcsw - before.ru_nvcsw,
+        .involuntary_switches = after.ru_nivcsw - before.ru_nivcsw,
+        .minor_faults = after.ru_minflt - before.ru_minflt,
+        .major_faults = after.ru_majflt - before.ru_majflt,
+    };
+    print_job_usage("Time", &usage);
+}
+
+/**
+ * @brief Registers the processes of a command line as a job, at the line's 'prio' nice value if it has one,
+ * and notes where it was placed.
+ */
+static Job* track_job(const ParsedCommand* parsed_cmd, const pid_t* pids, int num_processes, bool is_background)
+{
+    Job* job = create_job(pids, num_processes, parsed_cmd->text, is_background);
+    if (job && parsed_cmd->has_priority && set_job_priority(job, parsed_cmd->priority) == -1)
+    {
+        fprintf(stderr, "prio: %d: %s\n", parsed_cmd->priority, strerror(errno));
+    }
+    if (job && parsed_cmd->placement)
+    {
+        memcpy(job->placement, parsed_cmd->placement->label, sizeof(job->placement));
+    }
+    return job;
+}
+
+int execute_command(ParsedCommand* parsed_cmd)
+{
+    if (parsed_cmd->is_background)
+    {
+        return scheduler_submit(parsed_cmd);
+    }
+    return launch_command(parsed_cmd);
+}
+
+int launch_command(ParsedCommand* parsed_cmd)
 {
     if (parsed_cmd->is_internal)
     {
         if (parsed_cmd->is_background)
         {
-            pid_t pid = fork();
+            fflush(stdout);
+            pid_t pid = fork_shell();
             if (pid < 0)
             {
                 perror("Fork failed");
             }
             else if (pid == 0)
             {
+                setpgid(0, 0);
+                reset_signal_mask();
+                event_loop_detach();
+                if (parsed_cmd->placement && placement_apply(parsed_cmd->placement) == -1)
+                {
+                    exit(EXIT_FAILURE);
+                }
                 handle_internal_command(parsed_cmd);
                 exit(EXIT_SUCCESS);
             }
             else
             {
-                add_job(pid, parsed_cmd->command);
+                setpgid(pid, pid);
+                track_job(parsed_cmd, &pid, 1, true);
                 printf("[Background] PID: %d\n", pid);
             }
         }
+        else if (parsed_cmd->is_timed)
+        {
+            time_internal_command(parsed_cmd);
+        }
         else
         {
             handle_internal_command(parsed_cmd);
         }
+        return 0;
     }
     else if (parsed_cmd->is_piped)
     {
-        execute_piped_commands(parsed_cmd);
+        return execute_piped_commands(parsed_cmd);
     }
     else
     {
-        pid_t pid = fork();
+        SpawnOptions options;
+        spawn_options_init(&options);
+        options.input_file = parsed_cmd->input_file;
+        options.output_file = parsed_cmd->output_file;
+        options.append_output = parsed_cmd->append_output;
+        options.error_file = parsed_cmd->error_file;
+        options.pgid = 0;
+        options.placement = parsed_cmd->placement;
+        pid_t pid = spawn_command(parsed_cmd->args, &options);
         if (pid < 0)
         {
-            perror("Fork failed");
+            return 127;
         }
-        else if (pid == 0)
+        Job* job = track_job(parsed_cmd, &pid, 1, parsed_cmd->is_background);
+        if (parsed_cmd->is_background)
         {
-            execvp(parsed_cmd->args[0], parsed_cmd->args);
-            perror("execvp failed");
-            exit(EXIT_FAILURE);
+            printf("[Background] PID: %d\n", pid);
         }
-        else
+        else if (job)
         {
-            if (parsed_cmd->is_background)
-            {
-                add_job(pid, parsed_cmd->command);
-                printf("[Background] PID: %d\n", pid);
-            }
-            else
+            JobUsage usage;
+            int status = run_job_in_foreground(job, false, &usage);
+            if (parsed_cmd->is_timed)
             {
-                foreground_pid = pid;
-                waitpid(pid, NULL, 0);
-                foreground_pid = -1;
+                print_job_usage("Time", &usage);
             }
+            return status;
         }
     }
+    return 0;
+}
+
+int execute_line(char* line)
+{
+    if (!clean_and_check_input(line))
+    {
+        return 0;
+    }
+    ParsedCommand parsed_cmd;
+    int status = 2;
+    if (parse_input(line, &parsed_cmd) == 0)
+    {
+        status = execute_command(&parsed_cmd);
+    }
+    cleanup_parsed_command(&parsed_cmd);
+    reap_completed_jobs();
+    return status;
 }
 
-void execute_piped_commands(ParsedCommand* parsed_cmd)
+/**
+ * @brief Builds the simple command a pipeline stage amounts to, for running it as a builtin.
+ */
+static ParsedCommand stage_command(const ParsedCommand* parsed_cmd, int index)
 {
-    int pipe_fd[MAX_PIPES - 1][2];
-    for (int i = 0; i < parsed_cmd->num_pipes; i++)
+    const CommandStage* stage = &parsed_cmd->stages[index];
+    ParsedCommand stage_cmd = *parsed_cmd;
+    stage_cmd.command = stage->args[0];
+    stage_cmd.args = stage->args;
+    stage_cmd.input_file = stage->input_file;
+    stage_cmd.output_file = stage->output_file;
+    stage_cmd.append_output = stage->append_output;
+    stage_cmd.error_file = stage->error_file;
+    stage_cmd.is_piped = 0;
+    stage_cmd.is_internal = 1;
+    stage_cmd.builtin = stage->builtin;
+    stage_cmd.num_pipes = 0;
+    stage_cmd.stages = &parsed_cmd->stages[index];
+    return stage_cmd;
+}
+
+/**
+ * @brief Runs a builtin stage in the shell itself, with standard output moved onto the stage's pipe.
+ *
+ */
+static void run_builtin_stage(const ParsedCommand* parsed_cmd, int index, int out_fd)
+{
+    ParsedCommand stage_cmd = stage_command(parsed_cmd, index);
+    int original_stdout = -1;
+    if (out_fd != -1)
+    {
+        fflush(stdout);
+        original_stdout = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+        dup2(out_fd, STDOUT_FILENO);
+    }
+    // A reader that exits early must not take the shell down; the builtin's writes just fail with EPIPE.
+    struct sigaction ignore = {.sa_handler = SIG_IGN};
+    struct sigaction previous;
+    sigaction(SIGPIPE, &ignore, &previous);
+    handle_internal_command(&stage_cmd);
+    fflush(stdout);
+    clearerr(stdout);
+    sigaction(SIGPIPE, &previous, NULL);
+    reset_file_redirection(original_stdout, -1);
+}
+
+/**
+ * @brief Runs a builtin stage in a forked copy of the shell: any stage of a background pipeline, and those
+ * of a foreground one that are not meant to run in the shell itself.
+ */
+static pid_t fork_builtin_stage(const ParsedCommand* parsed_cmd, int index, int in_fd, int out_fd, pid_t pgid)
+{
+    fflush(stdout);
+    pid_t pid = fork_shell();
+    if (pid < 0)
+    {
+        perror("Fork failed");
+    }
+    else if (pid == 0)
     {
-        if (pipe(pipe_fd[i]) == -1)
+        setpgid(0, pgid);
+        reset_signal_mask();
+        event_loop_detach();
+        if (parsed_cmd->placement && placement_apply(parsed_cmd->placement) == -1)
         {
-            perror("pipe failed");
             exit(EXIT_FAILURE);
         }
+        if (in_fd != -1)
+        {
+            dup2(in_fd, STDIN_FILENO);
+        }
+        if (out_fd != -1)
+        {
+            dup2(out_fd, STDOUT_FILENO);
+        }
+        ParsedCommand stage_cmd = stage_command(parsed_cmd, index);
+        handle_internal_command(&stage_cmd);
+        fflush(stdout);
+        exit(EXIT_SUCCESS);
     }
-    for (int i = 0; i <= parsed_cmd->num_pipes; i++)
+    return pid;
+}
+
+int execute_piped_commands(ParsedCommand* parsed_cmd)
+{
+    int num_stages = parsed_cmd->num_pipes + 1;
+    pid_t* pids = arena_alloc(parsed_cmd->arena, (size_t)num_stages * sizeof(pid_t));
+    int* builtin_out = arena_alloc(parsed_cmd->arena, (size_t)num_stages * sizeof(int));
+    pid_t pgid = 0;
+    int prev_read = -1;
+    int started = 0;
+    int deferred = 0; // Builtins that only report run in the shell once the other stages are running.
+    bool failed = false;
+    struct timespec start_time;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+    if (pids == NULL || builtin_out == NULL)
     {
-        pid_t pid = fork();
+        return EXIT_FAILURE;
+    }
 
-        if (pid < 0)
+    for (int i = 0; i < num_stages; i++)
+    {
+        builtin_out[i] = -1;
+    }
+    for (int i = 0; i < num_stages; i++)
+    {
+        int pipe_fd[2] = {-1, -1};
+        if (i < parsed_cmd->num_pipes && pipe2(pipe_fd, O_CLOEXEC) == -1)
         {
-            perror("Fork failed");
-            exit(EXIT_FAILURE);
+            perror("pipe failed");
+            failed = true;
+            break;
         }
-        else if (pid == 0)
+        CommandStage* stage = &parsed_cmd->stages[i];
+        pid_t pid;
+        if (stage->builtin && stage->pipe_mode == BUILTIN_PIPE_IN_SHELL && !parsed_cmd->is_background)
         {
-            if (i > 0)
-            {
-                dup2(pipe_fd[i - 1][0], STDIN_FILENO);
-            }
-            if (i < parsed_cmd->num_pipes)
+            // Run after every external stage has started, so the builtin's output always has a reader.
+            // Builtins never read standard input, so the previous stage sees a closed pipe as it would
+            // with any command that exits without reading.
+            if (prev_read != -1)
             {
-                dup2(pipe_fd[i][1], STDOUT_FILENO);
+                close(prev_read);
             }
-            for (int j = 0; j < parsed_cmd->num_pipes; j++)
-            {
-                close(pipe_fd[j][0]);
-                close(pipe_fd[j][1]);
-            }
-            char* args[MAX_ARGS];
-            char* arg = strtok(parsed_cmd->pipes[i], " ");
-            int arg_count = 0;
-            while (arg && arg_count < MAX_ARGS - 1)
-            {
-                args[arg_count++] = arg;
-                arg = strtok(NULL, " ");
-            }
-            args[arg_count] = NULL;
-            execvp(args[0], args);
-            perror("execvp failed");
-            exit(EXIT_FAILURE);
+            builtin_out[i] = pipe_fd[1];
+            prev_read = pipe_fd[0];
+            deferred++;
+            continue;
+        }
+        if (stage->builtin)
+        {
+            pid = fork_builtin_stage(parsed_cmd, i, prev_read, pipe_fd[1], pgid);
         }
         else
         {
-            int status;
-            waitpid(pid, &status, 0);
-            if (i < parsed_cmd->num_pipes)
-            {
-                close(pipe_fd[i][1]);
-            }
-            if (i > 0)
+            SpawnOptions options;
+            spawn_options_init(&options);
+            options.pgid = pgid;
+            options.stdin_fd = prev_read;
+            options.stdout_fd = pipe_fd[1];
+            options.input_file = stage->input_file;
+            options.output_file = stage->output_file;
+            options.append_output = stage->append_output;
+            options.error_file = stage->error_file;
+            options.placement = parsed_cmd->placement;
+            pid = spawn_command(stage->args, &options);
+        }
+        if (pid < 0)
+        {
+            if (pipe_fd[0] != -1)
             {
-                close(pipe_fd[i - 1][0]);
+                close(pipe_fd[0]);
+                close(pipe_fd[1]);
             }
+            failed = true;
+            break;
         }
+
+        // Set the group from the parent too, so it is in place before anyone signals it.
+        if (pgid == 0)
+        {
+            pgid = pid;
+        }
+        setpgid(pid, pgid);
+        pids[started++] = pid;
+
+        // The parent keeps only the read end feeding the next stage.
+        if (prev_read != -1)
+        {
+            close(prev_read);
+        }
+        if (pipe_fd[1] != -1)
+        {
+            close(pipe_fd[1]);
+        }
+        prev_read = pipe_fd[0];
+    }
+    if (prev_read != -1)
+    {
+        close(prev_read);
+    }
+    if (failed && started > 0)
+    {
+        killpg(pgid, SIGTERM);
     }
-    for (int i = 0; i < parsed_cmd->num_pipes; i++)
+    if (deferred > 0 && !failed)
     {
-        close(pipe_fd[i][0]);
-        close(pipe_fd[i][1]);
+        // The other stages own the terminal while the shell writes into their pipes.
+        give_terminal_to(pgid);
     }
+    for (int i = 0; deferred > 0 && i < num_stages; i++)
+    {
+        const CommandStage* stage = &parsed_cmd->stages[i];
+        if (!stage->builtin || stage->pipe_mode != BUILTIN_PIPE_IN_SHELL || parsed_cmd->is_background)
+        {
+            continue;
+        }
+        if (!failed)
+        {
+            run_builtin_stage(parsed_cmd, i, builtin_out[i]);
+        }
+        if (builtin_out[i] != -1)
+        {
+            close(builtin_out[i]);
+        }
+    }
+    bool in_background = parsed_cmd->is_background && !failed;
+    Job* job = started > 0 ? track_job(parsed_cmd, pids, started, in_background) : NULL;
+    if (job == NULL && (started > 0 || failed))
+    {
+        give_terminal_to(getpgrp());
+        return EXIT_FAILURE;
+    }
+    if (in_background)
+    {
+        printf("[Background] PGID: %d\n", pgid);
+        return 0;
+    }
+
+    int status = 0;
+    JobUsage usage = {0};
+    if (job)
+    {
+        status = run_job_in_foreground(job, false, &usage);
+    }
+
+    struct timespec end_time;
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    double elapsed =
+        (double)(end_time.tv_sec - start_time.tv_sec) + (double)(end_time.tv_nsec - start_time.tv_nsec) / 1e9;
+    int exit_status = failed ? EXIT_FAILURE : parsed_cmd->stages[num_stages - 1].builtin ? 0 : status;
+    fprintf(stderr, "[Pipeline] %d stages, exit status %d, wall time %.3f s\n", num_stages, exit_status, elapsed);
+    if (parsed_cmd->is_timed)
+    {
+        usage.wall_seconds = elapsed; // Builtin stages ran in the shell, outside the job's own usage.
+        print_job_usage("Time", &usage);
+    }
+    return exit_status;
 }
 
 void handle_internal_command(ParsedCommand* parsed_cmd)
 {
     int original_stdout = -1;
-    handle_file_redirection(parsed_cmd->output_file, &original_stdout);
-    CommandHandler command_handlers[] = {{"cd", handle_cd},
-                                         {"echo", handle_echo},
-                                         {"clr", handle_clr},
-                                         {"quit", handle_quit},
-                                         {"set_interval", handle_set_interval},
-                                         {"set_metrics", handle_set_metrics},
-                                         {"start_monitor", handle_start_monitor},
-                                         {"stop_monitor", handle_stop_monitor},
-                                         {"status_monitor", handle_status_monitor},
-                                         {"man", handle_man},
-                                         {NULL, NULL}};
-    for (int i = 0; command_handlers[i].command != NULL; i++)
-    {
-        if (strcmp(parsed_cmd->args[0], command_handlers[i].command) == 0)
-        {
-            command_handlers[i].handler(parsed_cmd);
-            reset_file_redirection(original_stdout);
-            return;
-        }
-    }
-    fprintf(stderr, "Unknown internal command: %s\n", parsed_cmd->args[0]);
-    reset_file_redirection(original_stdout);
+    int original_stderr = -1;
+    STATS_START(redirect_start);
+    handle_file_redirection(parsed_cmd, &original_stdout, &original_stderr);
+    STATS_STOP(STATS_REDIRECT, redirect_start);
+    BuiltinHandler handler = parsed_cmd->builtin;
+    if (handler == NULL)
+    {
+        // Built by hand rather than by the parser.
+        const CommandHandler* builtin = find_builtin(parsed_cmd->args[0]);
+        handler = builtin ? builtin->handler : NULL;
+    }
+    if (handler)
+    {
+        STATS_START(builtin_start);
+        handler(parsed_cmd);
+        STATS_STOP(STATS_BUILTIN, builtin_start);
+    }
+    else
+    {
+        fprintf(stderr, "Unknown internal command: %s\n", parsed_cmd->args[0]);
+    }
+    STATS_START(reset_start);
+    reset_file_redirection(original_stdout, original_stderr);
+    STATS_STOP(STATS_REDIRECT, reset_start);
 }
 
-void handle_file_redirection(const char* output_file, int* original_stdout)
+/**
+ * @brief Opens a file onto one of the standard descriptors, saving the descriptor it replaces.
+ */
+static void redirect_to_file(const char* path, int flags, int target_fd, int* original_fd)
 {
-    if (output_file)
+    int fd = open(path, flags | O_CLOEXEC, 0644);
+    if (fd == -1)
     {
-        FILE* file = fopen(output_file, "w");
-        if (!file)
-        {
-            perror("Output file open failed");
-            return;
-        }
-        *original_stdout = dup(STDOUT_FILENO);
-        dup2(fileno(file), STDOUT_FILENO);
-        fclose(file);
+        perror(target_fd == STDERR_FILENO ? "Error file open failed" : "Output file open failed");
+        return;
     }
+    *original_fd = fcntl(target_fd, F_DUPFD_CLOEXEC, 0);
+    dup2(fd, target_fd);
+    close(fd);
 }
 
-void reset_file_redirection(int original_stdout)
+void handle_file_redirection(const ParsedCommand* parsed_cmd, int* original_stdout, int* original_stderr)
+{
+    if (parsed_cmd->output_file)
+    {
+        fflush(stdout);
+        int flags = O_WRONLY | O_CREAT | (parsed_cmd->append_output ? O_APPEND : O_TRUNC);
+        redirect_to_file(parsed_cmd->output_file, flags, STDOUT_FILENO, original_stdout);
+    }
+    if (parsed_cmd->error_file)
+    {
+        redirect_to_file(parsed_cmd->error_file, O_WRONLY | O_CREAT | O_TRUNC, STDERR_FILENO, original_stderr);
+    }
+}
+
+void reset_file_redirection(int original_stdout, int original_stderr)
 {
     if (original_stdout != -1)
     {
@@ -182,4 +466,9 @@ void reset_file_redirection(int original_stdout)
         dup2(original_stdout, STDOUT_FILENO);
         close(original_stdout);
     }
+    if (original_stderr != -1)
+    {
+        dup2(original_stderr, STDERR_FILENO);
+        close(original_stderr);
+    }
 }
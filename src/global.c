@@ -6,6 +6,8 @@ cJSON* root = NULL;
 int interval = DEFAULT_INTERVAL;
 char* metrics[MAX_ARGS];
 size_t num_metrics = 0;
-pid_t foreground_pid = -1;
-Job jobs[MAX_JOBS];
+pid_t foreground_pgid = -1;
+unsigned int interrupt_count = 0;
+Job* jobs = NULL;
+size_t job_capacity = 0;
 int job_count = 0;
@@ -3,51 +3,838 @@
  * @brief Implementation of job management functions.
  */
 #include "jobs.h"
+#include "event_loop.h"
+#include "scheduler.h"
+#include "stats.h"
+#include "utils.h"
+#include <stddef.h>
+#include <sys/resource.h>
+#include <termios.h>
 
-void add_job(pid_t pid, char* command)
+#define JOB_TABLE_INITIAL_CAPACITY 16 /**< Initial number of job slots. */
+#define PID_INDEX_INITIAL_CAPACITY 64 /**< Initial number of pid index slots, always a power of two. */
+#define STRING_POOL_BUCKETS 256       /**< Number of buckets in the command string pool. */
+#define JOB_HISTORY_SIZE 32           /**< Number of finished jobs whose usage is kept for jobs -v. */
+#define JOB_HISTORY_COMMAND 64        /**< Characters of a finished job's command kept in the history. */
+
+/**
+ * @struct PidIndexEntry
+ * @brief Maps the PID of a running process to the slot of the job it belongs to.
+ */
+typedef struct
+{
+    pid_t pid; /**< Process ID, 0 for an empty entry. */
+    int slot;  /**< Index of the job in the job table. */
+} PidIndexEntry;
+
+/**
+ * @struct InternedString
+ * @brief A reference-counted command string shared by every job launched with the same command line.
+ */
+typedef struct InternedString
+{
+    struct InternedString* next; /**< Next string in the bucket. */
+    size_t refs;                 /**< Number of jobs using the string. */
+    uint32_t hash;               /**< Hash of the text. */
+    char text[];                 /**< The string itself. */
+} InternedString;
+
+/**
+ * @struct FinishedJob
+ * @brief Usage of a job that has finished, kept after the job itself has been removed.
+ */
+typedef struct
+{
+    int job_id;                         /**< ID the job had while it ran. */
+    int status;                         /**< Exit status of the job. */
+    char command[JOB_HISTORY_COMMAND];  /**< Command of the job, truncated. */
+    JobUsage usage;                     /**< Resources used by the job. */
+} FinishedJob;
+
+static PidIndexEntry* pid_index = NULL;
+static size_t pid_index_capacity = 0;
+static size_t pid_index_count = 0;
+static int* free_slots = NULL; /**< Stack of free job slots. */
+static size_t num_free_slots = 0;
+static int reserved_slot = -1;    /**< Queued job the next create_job starts in place, -1 for none. */
+static bool jobs_changed = false; /**< Set when a job finishes, cleared once it has been reported. */
+static InternedString* string_pool[STRING_POOL_BUCKETS];
+static int shell_terminal = -1;    /**< Terminal handed to foreground jobs, -1 without job control. */
+static pid_t shell_pgid = 0;       /**< The shell's own process group. */
+static struct termios shell_modes; /**< Terminal modes restored whenever the shell takes the terminal back. */
+static int current_job = 0;        /**< Job fg and bg act on by default: the last one stopped or backgrounded. */
+static FinishedJob history[JOB_HISTORY_SIZE]; /**< Ring of the last finished jobs. */
+static size_t history_count = 0;              /**< Number of jobs that ever finished; the ring holds the last ones. */
+static JobUsage session_usage;                /**< Sum of the usage of every finished job; max_rss_kb is the peak. */
+static JobUsage last_usage;                   /**< Usage of the job wait_for_job last removed. */
+
+static const char* intern_string(const char* str)
+{
+    uint32_t hash = hash_string(str);
+    InternedString** bucket = &string_pool[hash % STRING_POOL_BUCKETS];
+    for (InternedString* entry = *bucket; entry; entry = entry->next)
+    {
+        if (entry->hash == hash && strcmp(entry->text, str) == 0)
+        {
+            entry->refs++;
+            return entry->text;
+        }
+    }
+    size_t len = strlen(str);
+    InternedString* entry = malloc(sizeof(InternedString) + len + 1);
+    if (entry == NULL)
+    {
+        perror("malloc failed");
+        return NULL;
+    }
+    entry->refs = 1;
+    entry->hash = hash;
+    memcpy(entry->text, str, len + 1);
+    entry->next = *bucket;
+    *bucket = entry;
+    return entry->text;
+}
+
+static void release_string(const char* text)
+{
+    InternedString* entry = (InternedString*)(text - offsetof(InternedString, text));
+    if (--entry->refs > 0)
+    {
+        return;
+    }
+    InternedString** link = &string_pool[entry->hash % STRING_POOL_BUCKETS];
+    while (*link != entry)
+    {
+        link = &(*link)->next;
+    }
+    *link = entry->next;
+    free(entry);
+}
+
+static size_t pid_hash(pid_t pid)
+{
+    return ((uint32_t)pid * 2654435761u) & (pid_index_capacity - 1);
+}
+
+/**
+ * @brief Looks up the job slot of a process.
+ */
+static int pid_index_find(pid_t pid)
+{
+    if (pid_index_capacity == 0)
+    {
+        return -1;
+    }
+    size_t mask = pid_index_capacity - 1;
+    for (size_t i = pid_hash(pid); pid_index[i].pid; i = (i + 1) & mask)
+    {
+        if (pid_index[i].pid == pid)
+        {
+            return pid_index[i].slot;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Removes a process from the index if it still maps to the given slot.
+ */
+static void pid_index_remove(pid_t pid, int slot)
+{
+    if (pid_index_capacity == 0)
+    {
+        return;
+    }
+    size_t mask = pid_index_capacity - 1;
+    size_t i = pid_hash(pid);
+    while (pid_index[i].pid && pid_index[i].pid != pid)
+    {
+        i = (i + 1) & mask;
+    }
+    if (pid_index[i].pid != pid || pid_index[i].slot != slot)
+    {
+        return;
+    }
+    pid_index[i].pid = 0;
+    pid_index_count--;
+    // Backward-shift the rest of the probe run so lookups never stop early at the new hole.
+    size_t hole = i;
+    for (size_t next = (i + 1) & mask; pid_index[next].pid; next = (next + 1) & mask)
+    {
+        size_t home = pid_hash(pid_index[next].pid);
+        if (((next - home) & mask) >= ((next - hole) & mask))
+        {
+            pid_index[hole] = pid_index[next];
+            pid_index[next].pid = 0;
+            hole = next;
+        }
+    }
+}
+
+static void pid_index_put(pid_t pid, int slot)
+{
+    size_t mask = pid_index_capacity - 1;
+    size_t i = pid_hash(pid);
+    while (pid_index[i].pid && pid_index[i].pid != pid)
+    {
+        i = (i + 1) & mask;
+    }
+    if (pid_index[i].pid == 0)
+    {
+        pid_index_count++;
+    }
+    pid_index[i].pid = pid;
+    pid_index[i].slot = slot;
+}
+
+static int pid_index_insert(pid_t pid, int slot)
+{
+    if ((pid_index_count + 1) * 2 > pid_index_capacity)
+    {
+        size_t new_capacity = pid_index_capacity ? pid_index_capacity * 2 : PID_INDEX_INITIAL_CAPACITY;
+        PidIndexEntry* new_index = calloc(new_capacity, sizeof(PidIndexEntry));
+        if (new_index == NULL)
+        {
+            perror("calloc failed");
+            return -1;
+        }
+        PidIndexEntry* old_index = pid_index;
+        size_t old_capacity = pid_index_capacity;
+        pid_index = new_index;
+        pid_index_capacity = new_capacity;
+        pid_index_count = 0;
+        for (size_t i = 0; i < old_capacity; i++)
+        {
+            if (old_index[i].pid)
+            {
+                pid_index_put(old_index[i].pid, old_index[i].slot);
+            }
+        }
+        free(old_index);
+    }
+    pid_index_put(pid, slot);
+    return 0;
+}
+
+static int grow_job_table(void)
+{
+    size_t new_capacity = job_capacity ? job_capacity * 2 : JOB_TABLE_INITIAL_CAPACITY;
+    int* new_free_slots = realloc(free_slots, new_capacity * sizeof(int));
+    if (new_free_slots == NULL)
+    {
+        perror("realloc failed");
+        return -1;
+    }
+    free_slots = new_free_slots;
+    Job* new_jobs = realloc(jobs, new_capacity * sizeof(Job));
+    if (new_jobs == NULL)
+    {
+        perror("realloc failed");
+        return -1;
+    }
+    jobs = new_jobs;
+    memset(jobs + job_capacity, 0, (new_capacity - job_capacity) * sizeof(Job));
+    // Push the new slots so the lowest one is handed out first.
+    for (size_t i = new_capacity; i > job_capacity; i--)
+    {
+        free_slots[num_free_slots++] = (int)(i - 1);
+    }
+    job_capacity = new_capacity;
+    return 0;
+}
+
+static double timeval_seconds(struct timeval tv)
+{
+    return (double)tv.tv_sec + (double)tv.tv_usec / 1e6;
+}
+
+/**
+ * @brief Adds the usage of one reaped process to its job.
+ */
+static void add_process_usage(JobUsage* usage, const struct rusage* ru)
+{
+    usage->user_seconds += timeval_seconds(ru->ru_utime);
+    usage->system_seconds += timeval_seconds(ru->ru_stime);
+    if (ru->ru_maxrss > usage->max_rss_kb)
+    {
+        usage->max_rss_kb = ru->ru_maxrss;
+    }
+    usage->voluntary_switches += ru->ru_nvcsw;
+    usage->involuntary_switches += ru->ru_nivcsw;
+    usage->minor_faults += ru->ru_minflt;
+    usage->major_faults += ru->ru_majflt;
+}
+
+/**
+ * @brief Adds one usage to another, keeping the larger peak RSS.
+ */
+static void add_usage(JobUsage* total, const JobUsage* usage)
+{
+    total->wall_seconds += usage->wall_seconds;
+    total->user_seconds += usage->user_seconds;
+    total->system_seconds += usage->system_seconds;
+    if (usage->max_rss_kb > total->max_rss_kb)
+    {
+        total->max_rss_kb = usage->max_rss_kb;
+    }
+    total->voluntary_switches += usage->voluntary_switches;
+    total->involuntary_switches += usage->involuntary_switches;
+    total->minor_faults += usage->minor_faults;
+    total->major_faults += usage->major_faults;
+}
+
+static double seconds_since(const struct timespec* start)
 {
-    if (job_count < MAX_JOBS)
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) + (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/**
+ * @brief Stamps the wall time of a job whose last process was just reaped, and adds it to the history and
+ * the session totals.
+ */
+static void finish_job_usage(Job* job)
+{
+    job->usage.wall_seconds = seconds_since(&job->started);
+    STATS_RECORD(STATS_JOB, (uint64_t)(job->usage.wall_seconds * 1e9));
+    STATS_COUNT(STATS_JOBS_REAPED);
+    FinishedJob* entry = &history[history_count++ % JOB_HISTORY_SIZE];
+    entry->job_id = job->job_id;
+    entry->status = exit_status_from_wait(job->status);
+    snprintf(entry->command, sizeof(entry->command), "%s", job->command);
+    entry->usage = job->usage;
+    add_usage(&session_usage, &job->usage);
+}
+
+/**
+ * @brief Records that a process stopped, continued or exited in its job.
+ */
+static void record_process_status(pid_t pid, int status, const struct rusage* ru)
+{
+    int slot = pid_index_find(pid);
+    if (slot < 0)
+    {
+        return;
+    }
+    Job* job = &jobs[slot];
+    if (WIFSTOPPED(status))
+    {
+        if (++job->stopped_processes >= job->running_processes && job->state == JOB_RUNNING)
+        {
+            job->state = JOB_STOPPED;
+            job->status = status;
+            job->stop_reported = false;
+            jobs_changed = true;
+        }
+        return;
+    }
+    if (WIFCONTINUED(status))
     {
-        jobs[job_count].job_id = job_count + 1;
-        jobs[job_count].pid = pid;
-        strncpy(jobs[job_count].command, command, INPUT_BUFFER_SIZE - 1);
-        jobs[job_count].command[INPUT_BUFFER_SIZE - 1] = '\0';
-        job_count++;
+        if (job->stopped_processes > 0)
+        {
+            job->stopped_processes--;
+        }
+        if (job->state == JOB_STOPPED)
+        {
+            job->state = JOB_RUNNING;
+        }
+        return;
     }
-    else
+    pid_index_remove(pid, slot);
+    add_process_usage(&job->usage, ru);
+    if (pid == job->pids[job->num_processes - 1])
     {
-        printf("Job limit reached, unable to track new background job.\n");
+        job->status = status;
+    }
+    if (job->stopped_processes > job->running_processes - 1)
+    {
+        job->stopped_processes = job->running_processes - 1; // A stopped process was killed.
+    }
+    if (--job->running_processes == 0)
+    {
+        job->state = JOB_DONE;
+        finish_job_usage(job);
+        if (job->on_complete)
+        {
+            job->on_complete(job, job->on_complete_data);
+            remove_job(job);
+            return;
+        }
+        jobs_changed = true;
     }
 }
 
-void reap_completed_jobs(void)
+void reap_children(void)
 {
     int status;
+    struct rusage ru;
     pid_t pid;
-    while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+    while ((pid = wait4(-1, &status, WNOHANG | WUNTRACED | WCONTINUED, &ru)) > 0)
+    {
+        record_process_status(pid, status, &ru);
+    }
+    scheduler_pump();
+}
+
+Job* create_job(const pid_t* pids, int num_processes, const char* command, bool is_background)
+{
+    Job* job = NULL;
+    pid_t* pids_copy = malloc((size_t)num_processes * sizeof(pid_t));
+    const char* interned = intern_string(command ? command : "");
+    bool reused = reserved_slot >= 0;
+    if (pids_copy == NULL || interned == NULL || (!reused && num_free_slots == 0 && grow_job_table() == -1))
+    {
+        printf("Unable to track new job.\n");
+        free(pids_copy);
+        if (interned)
+        {
+            release_string(interned);
+        }
+        return NULL;
+    }
+    int slot = reused ? reserved_slot : free_slots[--num_free_slots];
+    reserved_slot = -1;
+    job = &jobs[slot];
+    if (reused)
+    {
+        release_string(job->command); // The queued job becomes this one, under the same ID.
+        job_count--;
+    }
+    memcpy(pids_copy, pids, (size_t)num_processes * sizeof(pid_t));
+    job->job_id = slot + 1;
+    job->pid = pids[0];
+    pid_t pgid = getpgid(pids[0]);
+    job->pgid = pgid > 0 && pgid != getpgrp() ? pgid : 0;
+    job->command = interned;
+    job->pids = pids_copy;
+    job->num_processes = num_processes;
+    job->running_processes = num_processes;
+    job->stopped_processes = 0;
+    job->status = 0;
+    job->state = JOB_RUNNING;
+    job->is_background = is_background;
+    job->stop_reported = false;
+    job->scheduled = reused;
+    job->placement[0] = '\0';
+    job->on_complete = NULL;
+    job->on_complete_data = NULL;
+    clock_gettime(CLOCK_MONOTONIC, &job->started);
+    memset(&job->usage, 0, sizeof(job->usage));
+    for (int i = 0; i < num_processes; i++)
+    {
+        pid_index_insert(pids[i], slot);
+    }
+    job_count++;
+    if (is_background)
+    {
+        current_job = job->job_id;
+    }
+    return job;
+}
+
+Job* add_job(pid_t pid, const char* command)
+{
+    return create_job(&pid, 1, command, true);
+}
+
+Job* create_queued_job(const char* command)
+{
+    const char* interned = intern_string(command ? command : "");
+    if (interned == NULL || (num_free_slots == 0 && grow_job_table() == -1))
+    {
+        printf("Unable to track new job.\n");
+        if (interned)
+        {
+            release_string(interned);
+        }
+        return NULL;
+    }
+    int slot = free_slots[--num_free_slots];
+    Job* job = &jobs[slot];
+    memset(job, 0, sizeof(Job));
+    job->job_id = slot + 1;
+    job->command = interned;
+    job->state = JOB_QUEUED;
+    job->is_background = true;
+    job->scheduled = true;
+    clock_gettime(CLOCK_MONOTONIC, &job->started);
+    job_count++;
+    current_job = job->job_id;
+    return job;
+}
+
+void job_reserve_slot(const Job* job)
+{
+    reserved_slot = job ? job->job_id - 1 : -1;
+}
+
+int set_job_priority(const Job* job, int nice)
+{
+    if (job->pgid > 0)
+    {
+        // The whole group, so processes the job already forked are covered too.
+        return setpriority(PRIO_PGRP, (id_t)job->pgid, nice);
+    }
+    int result = 0;
+    for (int i = 0; i < job->num_processes; i++)
+    {
+        if (setpriority(PRIO_PROCESS, (id_t)job->pids[i], nice) == -1)
+        {
+            result = -1;
+        }
+    }
+    return result;
+}
+
+void job_on_complete(Job* job, void (*callback)(Job* job, void* data), void* data)
+{
+    job->on_complete = callback;
+    job->on_complete_data = data;
+}
+
+Job* find_job_by_pid(pid_t pid)
+{
+    int slot = pid_index_find(pid);
+    return slot < 0 ? NULL : &jobs[slot];
+}
+
+void remove_job(Job* job)
+{
+    int slot = job->job_id - 1;
+    for (int i = 0; i < job->num_processes; i++)
+    {
+        pid_index_remove(job->pids[i], slot);
+    }
+    release_string(job->command);
+    free(job->pids);
+    memset(job, 0, sizeof(Job));
+    free_slots[num_free_slots++] = slot;
+    job_count--;
+}
+
+static bool job_finished(void* arg)
+{
+    return jobs[(intptr_t)arg].state != JOB_RUNNING;
+}
+
+void wait_for_jobs_until(bool (*done)(void* arg), void* arg)
+{
+    if (event_loop_active())
+    {
+        // Keep serving signals, timers and monitor events; SIGCHLD arrives through the loop's signalfd.
+        event_loop_wait_until(done, arg);
+        return;
+    }
+    while (!done(arg))
+    {
+        int status;
+        struct rusage ru;
+        pid_t pid = wait4(-1, &status, WUNTRACED | WCONTINUED, &ru);
+        if (pid > 0)
+        {
+            record_process_status(pid, status, &ru);
+            scheduler_pump();
+        }
+        else if (errno != EINTR)
+        {
+            break;
+        }
+    }
+}
+
+int wait_for_job(Job* job)
+{
+    intptr_t slot = job->job_id - 1;
+    wait_for_jobs_until(job_finished, (void*)slot);
+    job = &jobs[slot];
+    int status = job->status;
+    if (job->state == JOB_STOPPED)
+    {
+        // Kept in the table, and reported when it finishes, until fg or bg picks it up again.
+        job->is_background = true;
+        job->stop_reported = true;
+        current_job = job->job_id;
+        printf("\n[%d]+ Stopped %s\n", job->job_id, job->command);
+        return exit_status_from_wait(status);
+    }
+    last_usage = job->usage;
+    remove_job(job);
+    return exit_status_from_wait(status);
+}
+
+int init_job_control(void)
+{
+    if (!isatty(STDIN_FILENO))
+    {
+        return 0;
+    }
+    // Started in the background of another shell: wait to be brought to the foreground.
+    while (tcgetpgrp(STDIN_FILENO) != (shell_pgid = getpgrp()))
+    {
+        kill(-shell_pgid, SIGTTIN);
+    }
+    signal(SIGTTIN, SIG_IGN);
+    signal(SIGTTOU, SIG_IGN);
+    shell_pgid = getpid();
+    if (getpgrp() != shell_pgid && setpgid(0, shell_pgid) == -1)
+    {
+        perror("setpgid failed");
+        return -1;
+    }
+    if (tcsetpgrp(STDIN_FILENO, shell_pgid) == -1)
+    {
+        perror("tcsetpgrp failed");
+        return -1;
+    }
+    tcgetattr(STDIN_FILENO, &shell_modes);
+    shell_terminal = STDIN_FILENO;
+    return 0;
+}
+
+int signal_job(const Job* job, int sig)
+{
+    if (job->pgid > 0)
+    {
+        return killpg(job->pgid, sig);
+    }
+    int result = 0;
+    for (int i = 0; i < job->num_processes; i++)
+    {
+        if (find_job_by_pid(job->pids[i]) == job && kill(job->pids[i], sig) == -1)
+        {
+            result = -1;
+        }
+    }
+    return result;
+}
+
+void give_terminal_to(pid_t pgid)
+{
+    if (shell_terminal != -1 && pgid > 0)
+    {
+        tcsetpgrp(shell_terminal, pgid);
+    }
+}
+
+int run_job_in_foreground(Job* job, bool resume, JobUsage* usage)
+{
+    job->is_background = false;
+    give_terminal_to(job->pgid);
+    if (resume && job->state == JOB_STOPPED)
+    {
+        job->state = JOB_RUNNING;
+        job->stopped_processes = 0;
+        signal_job(job, SIGCONT);
+    }
+    foreground_pgid = job->pgid > 0 ? job->pgid : -1;
+    // Jobs created while waiting may grow the table, so the job is looked up again by its slot afterwards.
+    int job_id = job->job_id;
+    size_t slot = (size_t)(job_id - 1);
+    int status = wait_for_job(job);
+    job = &jobs[slot];
+    foreground_pgid = -1;
+    if (shell_terminal != -1)
+    {
+        if (status == 128 + SIGINT)
+        {
+            printf("\n"); // Start the prompt on a fresh line after the ^C echoed by the terminal.
+        }
+        tcsetpgrp(shell_terminal, shell_pgid);
+        tcsetattr(shell_terminal, TCSADRAIN, &shell_modes);
+    }
+    if (usage && job->job_id != job_id)
+    {
+        *usage = last_usage;
+    }
+    else if (usage)
+    {
+        job_usage_so_far(job, usage); // Stopped: what it used up to now.
+    }
+    return status;
+}
+
+void continue_job_in_background(Job* job)
+{
+    job->is_background = true;
+    current_job = job->job_id;
+    if (job->state == JOB_STOPPED)
+    {
+        job->state = JOB_RUNNING;
+        job->stopped_processes = 0;
+        job->stop_reported = false;
+        signal_job(job, SIGCONT);
+    }
+}
+
+/**
+ * @brief Tells whether a job is one the user controls: in the background or stopped, and not supervised
+ * through a completion callback.
+ */
+static bool is_user_job(const Job* job)
+{
+    return job->job_id && (job->is_background || job->state == JOB_STOPPED) && job->on_complete == NULL;
+}
+
+Job* find_job(const char* spec)
+{
+    if (spec == NULL || strcmp(spec, "%+") == 0 || strcmp(spec, "%%") == 0 || strcmp(spec, "%") == 0)
     {
-        for (int i = 0; i < job_count; i++)
+        if (current_job > 0 && (size_t)current_job <= job_capacity && is_user_job(&jobs[current_job - 1]))
         {
-            if (jobs[i].pid == pid)
+            return &jobs[current_job - 1];
+        }
+        // The current job is gone; fall back to the most recent remaining one.
+        for (size_t i = job_capacity; i > 0; i--)
+        {
+            if (is_user_job(&jobs[i - 1]))
             {
-                printf("[%d]+ Done %s\n", jobs[i].job_id, jobs[i].command);
-                for (int j = i; j < job_count - 1; j++)
-                {
-                    jobs[j] = jobs[j + 1];
-                }
-                job_count--;
+                return &jobs[i - 1];
+            }
+        }
+        return NULL;
+    }
+    char* end;
+    long number = strtol(spec[0] == '%' ? spec + 1 : spec, &end, 10);
+    if (*end != '\0' || number <= 0)
+    {
+        return NULL;
+    }
+    if (spec[0] != '%')
+    {
+        return find_job_by_pid((pid_t)number);
+    }
+    if ((size_t)number > job_capacity || jobs[number - 1].job_id == 0)
+    {
+        return NULL;
+    }
+    return &jobs[number - 1];
+}
+
+const char* job_state_name(const Job* job)
+{
+    switch (job->state)
+    {
+    case JOB_RUNNING:
+        return "Running";
+    case JOB_STOPPED:
+        return "Stopped";
+    case JOB_QUEUED:
+        return "Queued";
+    default:
+        return "Done";
+    }
+}
+
+bool job_is_current(const Job* job)
+{
+    return job->job_id == current_job;
+}
+
+void print_job_usage(const char* label, const JobUsage* usage)
+{
+    fprintf(stderr,
+            "[%s] real %.3f s, user %.3f s, sys %.3f s, max RSS %ld KiB, %ld/%ld context switches (vol/invol), "
+            "%ld/%ld page faults (minor/major)\n",
+            label, usage->wall_seconds, usage->user_seconds, usage->system_seconds, usage->max_rss_kb,
+            usage->voluntary_switches, usage->involuntary_switches, usage->minor_faults, usage->major_faults);
+}
+
+void job_usage_so_far(const Job* job, JobUsage* usage)
+{
+    *usage = job->usage;
+    usage->wall_seconds = job->state == JOB_DONE ? job->usage.wall_seconds : seconds_since(&job->started);
+}
+
+void print_job_history(void)
+{
+    size_t count = history_count < JOB_HISTORY_SIZE ? history_count : JOB_HISTORY_SIZE;
+    if (count == 0)
+    {
+        return;
+    }
+    printf("Finished jobs (last %zu):\n", count);
+    printf("  %-5s %-6s %9s %9s %9s %11s %s\n", "JOB", "STATUS", "REAL", "USER", "SYS", "MAXRSS", "COMMAND");
+    for (size_t i = history_count - count; i < history_count; i++)
+    {
+        const FinishedJob* entry = &history[i % JOB_HISTORY_SIZE];
+        printf("  %-5d %-6d %9.3f %9.3f %9.3f %7ld KiB %s\n", entry->job_id, entry->status, entry->usage.wall_seconds,
+               entry->usage.user_seconds, entry->usage.system_seconds, entry->usage.max_rss_kb, entry->command);
+    }
+}
+
+void print_session_summary(void)
+{
+    if (history_count == 0)
+    {
+        return;
+    }
+    char label[48];
+    snprintf(label, sizeof(label), "Session: %zu jobs", history_count);
+    print_job_usage(label, &session_usage);
+    // The heaviest jobs among those still in the history.
+    size_t count = history_count < JOB_HISTORY_SIZE ? history_count : JOB_HISTORY_SIZE;
+    const FinishedJob* top[3] = {NULL, NULL, NULL};
+    for (size_t i = 0; i < count; i++)
+    {
+        const FinishedJob* entry = &history[i];
+        double cpu = entry->usage.user_seconds + entry->usage.system_seconds;
+        for (size_t j = 0; j < 3; j++)
+        {
+            if (top[j] == NULL || cpu > top[j]->usage.user_seconds + top[j]->usage.system_seconds)
+            {
+                memmove(&top[j + 1], &top[j], (2 - j) * sizeof(top[0]));
+                top[j] = entry;
                 break;
             }
         }
     }
+    for (size_t j = 0; j < 3 && top[j]; j++)
+    {
+        fprintf(stderr, "[Session] CPU %.3f s, max RSS %ld KiB: %s\n",
+                top[j]->usage.user_seconds + top[j]->usage.system_seconds, top[j]->usage.max_rss_kb, top[j]->command);
+    }
+}
+
+int reap_completed_jobs(void)
+{
+    int reported = 0;
+    reap_children();
+    if (jobs_changed)
+    {
+        jobs_changed = false;
+        for (size_t i = 0; i < job_capacity; i++)
+        {
+            if (jobs[i].job_id && jobs[i].is_background && jobs[i].state == JOB_DONE)
+            {
+                printf("[%d]+ Done %s\n", jobs[i].job_id, jobs[i].command);
+                remove_job(&jobs[i]);
+                reported++;
+            }
+            else if (jobs[i].job_id && jobs[i].state == JOB_STOPPED && !jobs[i].stop_reported &&
+                     jobs[i].on_complete == NULL)
+            {
+                printf("[%d]+ Stopped %s\n", jobs[i].job_id, jobs[i].command);
+                jobs[i].stop_reported = true;
+                current_job = jobs[i].job_id;
+                reported++;
+            }
+        }
+    }
+    return reported;
 }
 
 void cleanup_and_exit(void)
 {
-    for (int i = 0; i < job_count; i++)
+    for (size_t i = 0; i < job_capacity; i++)
     {
-        kill(jobs[i].pid, SIGTERM);
+        if (jobs[i].job_id && jobs[i].state != JOB_DONE)
+        {
+            signal_job(&jobs[i], SIGTERM);
+            signal_job(&jobs[i], SIGCONT); // Stopped jobs only act on the SIGTERM once continued.
+        }
     }
+    print_session_summary();
     printf("\n\033[1;31m============================================\033[0m\n");
     printf("\033[1;31m|          Shutting down processes          |\033[0m\n");
     printf("\033[1;31m|        All active tasks terminated        |\033[0m\n");
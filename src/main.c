@@ -2,76 +2,216 @@
  * @file main.c
  * @brief Entry point for the shell program.
  */
+#include "batch.h"
+#include "config.h"
+#include "event_loop.h"
 #include "execution.h"
+#include "monitor.h"
+#include "monitor_channel.h"
+#include "series.h"
+#include "server.h"
 #include "utils.h"
+#include <getopt.h>
+#include <sys/signalfd.h>
+
+static bool interactive = false; /**< Whether commands come from the terminal rather than a batch file. */
 
 /**
- * @brief Main function for the shell program.
- *
- * This function sets up signal handlers, retrieves initial metrics, and initializes the shell environment.
- * It then enters an infinite loop to read user input, parse commands, execute them, and clean up as needed.
+ * @brief Handles the signals delivered through the signalfd.
  *
- * @return 0 on successful execution.
+ * Children are reaped here in every case; finished background jobs are only reported when no command is
+ * running, so the report lands before a fresh prompt instead of in the middle of a command's output.
+ */
+static void handle_signalfd(int fd, uint32_t events, void* data)
+{
+    struct signalfd_siginfo info;
+    while (read(fd, &info, sizeof(info)) == sizeof(info))
+    {
+        if (info.ssi_signo == SIGCHLD)
+        {
+            reap_children();
+            if (event_loop_depth() == 0 && reap_completed_jobs() > 0 && interactive)
+            {
+                display_prompt();
+            }
+        }
+        else
+        {
+            forward_signal((int)info.ssi_signo);
+            if (event_loop_depth() == 0 && interactive)
+            {
+                printf("\n");
+                display_prompt();
+            }
+        }
+    }
+}
+
+/**
+ * @brief Applies a configuration file changed outside the shell, and redraws the prompt it printed over.
+ */
+static void handle_config_reload(void)
+{
+    apply_config();
+    printf("\nConfiguration reloaded from %s (version %lu).\n", config_file_path(), config_version());
+    if (event_loop_depth() == 0 && interactive)
+    {
+        display_prompt();
+    }
+}
+
+/**
+ * @brief Runs every complete line buffered by the reader, and stops the loop at end of input.
+ */
+static void handle_input(int fd, uint32_t events, void* data)
+{
+    LineReader* reader = data;
+    line_reader_fill(reader);
+    char* line;
+    while ((line = line_reader_next(reader)) != NULL)
+    {
+        execute_line(line);
+        if (interactive)
+        {
+            display_prompt();
+        }
+    }
+    if (reader->eof)
+    {
+        event_loop_remove(fd);
+        event_loop_stop();
+    }
+}
+
+/**
+ * @brief Saves what the session leaves behind once the input is exhausted: configuration, metrics and usage.
  */
+static void finish_session(void)
+{
+    cancel_metric_discovery();
+    config_flush();
+    monitor_collect();
+    series_save(getenv(SERIES_FILE_ENV));
+    print_session_summary();
+}
+
 /**
  * @brief Main function for the shell program.
  *
- * This function sets up signal handlers, retrieves initial metrics, and initializes the shell environment.
- * It then either reads commands from a batch file if provided or enters an infinite loop to read user input,
- * parse commands, execute them, and clean up as needed.
+ * This function sets up the event loop and the signalfd, loads and watches the configuration file, starts
+ * discovering the monitor's metrics in the background (unless --no-monitor is given), and initializes the
+ * shell environment. Commands are then read from a batch file if provided, or from standard input, and
+ * executed as their lines arrive. With `-j N` the lines of the batch file run up to N at a time. With
+ * `--server <socket>` the shell reads nothing itself and serves requests from clients until SIGTERM.
  *
  * @return 0 on successful execution.
  */
 int main(int argc, char* argv[])
 {
-    setup_signal_handlers();
-    retrive_metrics(FIFO_PATH, MONITOR_PATH);
-    initialize_metrics_from_status_file(METRICS_FILE);
-    create_config_file(CONFIG_FILE, interval, metrics, num_metrics);
+    static const struct option long_options[] = {
+        {"no-monitor", no_argument, NULL, 'n'}, {"server", required_argument, NULL, 's'}, {NULL, 0, NULL, 0}};
+    static const char* usage = "Usage: %s [--no-monitor] [-j jobs] [batch_file | --server socket]\n";
+    int max_jobs = 1;
+    bool use_monitor = true;
+    const char* server_path = NULL;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "j:", long_options, NULL)) != -1)
+    {
+        if (opt == 'n')
+        {
+            use_monitor = false;
+            continue;
+        }
+        if (opt == 's')
+        {
+            server_path = optarg;
+            continue;
+        }
+        if (opt == 'j' && (max_jobs = atoi(optarg)) > 0)
+        {
+            continue;
+        }
+        fprintf(stderr, usage, argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (argc - optind > 1 || (max_jobs > 1 && optind == argc) || (server_path && optind < argc))
+    {
+        fprintf(stderr, usage, argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (event_loop_init() == -1)
+    {
+        return EXIT_FAILURE;
+    }
+    int signal_fd = setup_signal_handlers();
+    if (signal_fd == -1 || event_loop_add(signal_fd, EPOLLIN, 0, handle_signalfd, NULL) == -1)
+    {
+        return EXIT_FAILURE;
+    }
+    monitor_channel_init();
+    if (config_init(CONFIG_FILE) == 0)
+    {
+        apply_config();
+    }
+    config_watch(handle_config_reload);
+    series_load(getenv(SERIES_FILE_ENV));
+    if (use_monitor)
+    {
+        retrive_metrics(fifo_path, monitor_path, DISCOVERY_TIMEOUT_MS);
+    }
+    if (server_path)
+    {
+        if (server_start(server_path) == -1)
+        {
+            return EXIT_FAILURE;
+        }
+        event_loop_run();
+        server_stop();
+        cancel_metric_discovery();
+        config_flush();
+        monitor_collect();
+        series_save(getenv(SERIES_FILE_ENV));
+        return EXIT_SUCCESS;
+    }
     display_start_screen();
 
-    if (argc == 2)
+    int input_fd = STDIN_FILENO;
+    if (optind < argc)
     {
-        FILE* file = fopen(argv[1], "r");
-        if (!file)
+        input_fd = open(argv[optind], O_RDONLY | O_CLOEXEC);
+        if (input_fd == -1)
         {
             perror("Failed to open batch file");
             return EXIT_FAILURE;
         }
-
-        char line[INPUT_BUFFER_SIZE];
-        while (fgets(line, sizeof(line), file))
+        if (max_jobs > 1)
         {
-            if (!clean_and_check_input(line))
-            {
-                continue;
-            }
-            ParsedCommand parsed_cmd;
-            parse_input(line, &parsed_cmd);
-            execute_command(&parsed_cmd);
-            cleanup_parsed_command(&parsed_cmd);
+            int result = run_batch_parallel(input_fd, max_jobs);
+            close(input_fd);
+            finish_session();
+            return result;
         }
-        fclose(file);
-        return EXIT_SUCCESS;
     }
     else
     {
-        char input[INPUT_BUFFER_SIZE];
-        while (1)
-        {
-            reap_completed_jobs();
-            display_prompt();
-            if (!fgets(input, sizeof(input), stdin))
-                break;
-            if (!clean_and_check_input(input))
-            {
-                continue;
-            }
-            ParsedCommand parsed_cmd;
-            parse_input(input, &parsed_cmd);
-            execute_command(&parsed_cmd);
-            cleanup_parsed_command(&parsed_cmd);
-        }
+        interactive = true;
+        init_job_control();
+        display_prompt();
+    }
+
+    static LineReader reader;
+    line_reader_init(&reader, input_fd);
+    if (event_loop_add(input_fd, EPOLLIN, EVENT_LOOP_INPUT, handle_input, &reader) == -1)
+    {
+        return EXIT_FAILURE;
+    }
+    event_loop_run();
+    line_reader_free(&reader);
+    if (input_fd != STDIN_FILENO)
+    {
+        close(input_fd);
     }
-    return 0;
+    finish_session();
+    return EXIT_SUCCESS;
 }
@@ -0,0 +1,229 @@
+/**
+ * @file metrics_shm.c
+ * @brief Implementation of the shared-memory metrics ring buffer.
+ */
+#include "metrics_shm.h"
+#include <stdbool.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define METRICS_READ_RETRIES 1000 /**< Attempts a reader makes before giving up on a busy ring. */
+#define METRICS_READ_SPINS 100000  /**< Polls of an odd sequence before the writer is taken for dead. */
+
+MetricsRing* metrics_ring_create(int* fd)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "/shell_metrics_%d", (int)getpid());
+    int shm_fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (shm_fd == -1)
+    {
+        perror("shm_open failed");
+        return NULL;
+    }
+    // Nothing else needs the name: the writer gets the descriptor itself.
+    shm_unlink(name);
+    if (ftruncate(shm_fd, sizeof(MetricsRing)) == -1)
+    {
+        perror("ftruncate failed");
+        close(shm_fd);
+        return NULL;
+    }
+    MetricsRing* ring = mmap(NULL, sizeof(MetricsRing), PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+    if (ring == MAP_FAILED)
+    {
+        perror("mmap failed");
+        close(shm_fd);
+        return NULL;
+    }
+    ring->magic = METRICS_RING_MAGIC;
+    *fd = shm_fd;
+    return ring;
+}
+
+MetricsRing* metrics_ring_attach(int fd)
+{
+    MetricsRing* ring = mmap(NULL, sizeof(MetricsRing), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ring == MAP_FAILED)
+    {
+        perror("mmap failed");
+        return NULL;
+    }
+    if (ring->magic != METRICS_RING_MAGIC)
+    {
+        fprintf(stderr, "metrics ring is not initialized\n");
+        munmap(ring, sizeof(MetricsRing));
+        return NULL;
+    }
+    return ring;
+}
+
+void metrics_ring_unmap(MetricsRing* ring)
+{
+    if (ring)
+    {
+        munmap(ring, sizeof(MetricsRing));
+    }
+}
+
+static void begin_write(MetricsRing* ring)
+{
+    uint64_t sequence = atomic_load_explicit(&ring->sequence, memory_order_relaxed);
+    atomic_store_explicit(&ring->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static void end_write(MetricsRing* ring)
+{
+    uint64_t sequence = atomic_load_explicit(&ring->sequence, memory_order_relaxed);
+    atomic_store_explicit(&ring->sequence, sequence + 1, memory_order_release);
+}
+
+void metrics_ring_set_names(MetricsRing* ring, const char* list)
+{
+    begin_write(ring);
+    uint32_t count = 0;
+    const char* p = list;
+    while (*p && count < METRICS_MAX_NAMES)
+    {
+        p += strspn(p, " \t,");
+        size_t length = strcspn(p, ",");
+        size_t trimmed = length;
+        while (trimmed > 0 && (p[trimmed - 1] == ' ' || p[trimmed - 1] == '\t'))
+        {
+            trimmed--;
+        }
+        if (trimmed > 0)
+        {
+            snprintf(ring->names[count++], METRICS_NAME_SIZE, "%.*s", (int)trimmed, p);
+        }
+        p += length;
+    }
+    ring->num_names = count;
+    memset(ring->latest, 0, sizeof(ring->latest));
+    end_write(ring);
+}
+
+void metrics_ring_publish(MetricsRing* ring, const MetricRecord* records, size_t count)
+{
+    begin_write(ring);
+    for (size_t i = 0; i < count; i++)
+    {
+        if (records[i].metric_id >= ring->num_names)
+        {
+            continue;
+        }
+        ring->records[ring->head % METRICS_RING_CAPACITY] = records[i];
+        ring->latest[records[i].metric_id] = records[i];
+        ring->head++;
+    }
+    end_write(ring);
+}
+
+/**
+ * @brief Starts a read section.
+ *
+ * A writer that died mid-write leaves the sequence odd for good, so the wait for it is bounded.
+ *
+ * @return true with the even sequence number the section began at, false if a write never finished.
+ */
+static bool begin_read(const MetricsRing* ring, uint64_t* sequence)
+{
+    for (int spin = 0; spin < METRICS_READ_SPINS; spin++)
+    {
+        *sequence = atomic_load_explicit(&ring->sequence, memory_order_acquire);
+        if ((*sequence & 1) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Ends a read section.
+ *
+ * @return true if no write overlapped it, so the copied data is consistent.
+ */
+static bool end_read(const MetricsRing* ring, uint64_t sequence)
+{
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&ring->sequence, memory_order_relaxed) == sequence;
+}
+
+int metrics_ring_snapshot(const MetricsRing* ring, MetricsSnapshot* snapshot)
+{
+    for (int attempt = 0; attempt < METRICS_READ_RETRIES; attempt++)
+    {
+        uint64_t sequence;
+        if (!begin_read(ring, &sequence))
+        {
+            break;
+        }
+        uint32_t num_names = ring->num_names < METRICS_MAX_NAMES ? ring->num_names : METRICS_MAX_NAMES;
+        snapshot->num_names = num_names;
+        snapshot->head = ring->head;
+        memcpy(snapshot->names, ring->names, num_names * sizeof(ring->names[0]));
+        memcpy(snapshot->latest, ring->latest, num_names * sizeof(ring->latest[0]));
+        if (end_read(ring, sequence))
+        {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+ssize_t metrics_ring_last(const MetricsRing* ring, MetricRecord* records, size_t count)
+{
+    for (int attempt = 0; attempt < METRICS_READ_RETRIES; attempt++)
+    {
+        uint64_t sequence;
+        if (!begin_read(ring, &sequence))
+        {
+            break;
+        }
+        uint64_t head = ring->head;
+        size_t available = head < METRICS_RING_CAPACITY ? (size_t)head : METRICS_RING_CAPACITY;
+        size_t copied = count < available ? count : available;
+        for (size_t i = 0; i < copied; i++)
+        {
+            records[i] = ring->records[(head - copied + i) % METRICS_RING_CAPACITY];
+        }
+        if (end_read(ring, sequence))
+        {
+            return (ssize_t)copied;
+        }
+    }
+    return -1;
+}
+
+ssize_t metrics_ring_since(const MetricsRing* ring, uint64_t* cursor, MetricRecord* records, size_t count)
+{
+    for (int attempt = 0; attempt < METRICS_READ_RETRIES; attempt++)
+    {
+        uint64_t sequence;
+        if (!begin_read(ring, &sequence))
+        {
+            break;
+        }
+        uint64_t head = ring->head;
+        uint64_t start = *cursor < head ? *cursor : head;
+        if (head - start > METRICS_RING_CAPACITY)
+        {
+            start = head - METRICS_RING_CAPACITY;
+        }
+        size_t copied = head - start < count ? (size_t)(head - start) : count;
+        for (size_t i = 0; i < copied; i++)
+        {
+            records[i] = ring->records[(start + i) % METRICS_RING_CAPACITY];
+        }
+        if (end_read(ring, sequence))
+        {
+            *cursor = start + copied;
+            return (ssize_t)copied;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,311 @@
+/**
+ * @file monitor.c
+ * @brief Implementation of the monitor supervision and control channel.
+ */
+#include "monitor.h"
+#include "event_loop.h"
+#include "jobs.h"
+#include "monitor_channel.h"
+#include "sampler.h"
+#include "series.h"
+#include "spawner.h"
+#include "utils.h"
+#include <poll.h>
+#include <stddef.h>
+#include <sys/socket.h>
+
+#define MONITOR_REPLY_TIMEOUT_MS 1000 /**< How long to wait for the monitor to answer a request. */
+#define MONITOR_COLLECT_MS 1000       /**< How often published samples are added to the time series. */
+
+static int control_fd = -1;
+static pid_t supervised_pid = -1;
+static int monitor_job_id = 0;
+static MetricsRing* metrics_ring = NULL; /**< Ring the monitor publishes into, kept across restarts. */
+static int metrics_ring_fd = -1;
+static bool builtin = false;   /**< Whether the monitor is the shell's own /proc sampler rather than a child. */
+static uint64_t collected = 0; /**< Ring records already added to the time series. */
+static int collect_timer = -1; /**< Timer running monitor_collect while a monitor runs. */
+
+static void close_channel(void)
+{
+    if (control_fd != -1)
+    {
+        event_loop_remove(control_fd);
+        close(control_fd);
+        control_fd = -1;
+    }
+}
+
+/**
+ * @brief Drops the control socket once the monitor hangs up; the job reaper reports the exit itself.
+ */
+static void handle_hangup(int fd, uint32_t events, void* data)
+{
+    close_channel();
+}
+
+void monitor_collect(void)
+{
+    static MetricRecord records[METRICS_RING_CAPACITY];
+    MetricsSnapshot snapshot;
+    ssize_t count = metrics_ring ? metrics_ring_since(metrics_ring, &collected, records, METRICS_RING_CAPACITY) : 0;
+    if (count <= 0 || metrics_ring_snapshot(metrics_ring, &snapshot) == -1)
+    {
+        return;
+    }
+    for (size_t i = 0; i < (size_t)count; i++)
+    {
+        if (records[i].metric_id < snapshot.num_names)
+        {
+            series_add(snapshot.names[records[i].metric_id], records[i].timestamp_ns, records[i].value);
+        }
+    }
+}
+
+static void handle_collect_timer(int fd, uint32_t events, void* data)
+{
+    monitor_collect();
+}
+
+int monitor_start(const char* path)
+{
+    if (monitor_running())
+    {
+        fprintf(stderr, "Monitor already running with PID %d\n", supervised_pid);
+        return -1;
+    }
+    if (metrics_ring == NULL)
+    {
+        metrics_ring = metrics_ring_create(&metrics_ring_fd);
+    }
+    if (collect_timer == -1 && event_loop_active())
+    {
+        collect_timer = event_loop_add_timer(MONITOR_COLLECT_MS, true, handle_collect_timer, NULL);
+    }
+    if (access(path, X_OK) == -1)
+    {
+        // No monitor binary, e.g. the submodule is not checked out: sample /proc from the shell itself.
+        if (metrics_ring == NULL || sampler_start(metrics_ring, interval > 0 ? interval : DEFAULT_INTERVAL) == -1)
+        {
+            fprintf(stderr, "Failed to start the built-in sampler\n");
+            return -1;
+        }
+        builtin = true;
+        return 0;
+    }
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) == -1)
+    {
+        perror("socketpair failed");
+        return -1;
+    }
+    fflush(stdout);
+    pid_t pid = fork_shell();
+    if (pid < 0)
+    {
+        perror("fork failed");
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    else if (pid == 0)
+    {
+        setpgid(0, 0); // Out of the shell's group, so Ctrl-C at the prompt does not reach it.
+        reset_signal_mask();
+        event_loop_detach();
+        char fd_string[16];
+        snprintf(fd_string, sizeof(fd_string), "%d", fds[1]);
+        fcntl(fds[1], F_SETFD, 0);
+        setenv(MONITOR_CONTROL_ENV, fd_string, 1);
+        if (metrics_ring)
+        {
+            snprintf(fd_string, sizeof(fd_string), "%d", metrics_ring_fd);
+            fcntl(metrics_ring_fd, F_SETFD, 0);
+            setenv(METRICS_SHM_ENV, fd_string, 1);
+        }
+        execl(path, path, (char*)NULL);
+        perror("execl failed");
+        _exit(EXIT_FAILURE);
+    }
+    setpgid(pid, pid);
+    close(fds[1]);
+    control_fd = fds[0];
+    supervised_pid = pid;
+    Job* job = create_job(&pid, 1, "monitor", true);
+    monitor_job_id = job ? job->job_id : 0;
+    if (event_loop_active())
+    {
+        event_loop_add(control_fd, EPOLLRDHUP, 0, handle_hangup, NULL);
+    }
+    return 0;
+}
+
+bool monitor_running(void)
+{
+    if (builtin)
+    {
+        return sampler_running();
+    }
+    if (control_fd == -1 || monitor_job_id == 0)
+    {
+        return false;
+    }
+    const Job* job = &jobs[monitor_job_id - 1];
+    return job->job_id && job->pids[0] == supervised_pid && job->state != JOB_DONE;
+}
+
+pid_t monitor_pid(void)
+{
+    return builtin ? getpid() : supervised_pid;
+}
+
+bool monitor_is_builtin(void)
+{
+    return builtin && sampler_running();
+}
+
+/**
+ * @brief Applies a request to the built-in sampler, answering it the way the monitor would.
+ */
+static int builtin_request(MonitorMessageType type, uint32_t value, const char* payload, MonitorMessage* reply)
+{
+    MonitorMessage message = {.type = MONITOR_MSG_ACK};
+    int result = 0;
+    MetricsSnapshot snapshot;
+    switch (type)
+    {
+    case MONITOR_MSG_SET_INTERVAL:
+        result = value > 0 && value <= INT32_MAX ? sampler_set_interval((int)value) : -1;
+        snprintf(message.payload, sizeof(message.payload), "%s", result == -1 ? "invalid interval" : "");
+        break;
+    case MONITOR_MSG_SET_METRICS:
+        result = sampler_set_metrics(payload ? payload : "", message.payload, sizeof(message.payload));
+        break;
+    case MONITOR_MSG_SNAPSHOT:
+        message.type = MONITOR_MSG_SNAPSHOT;
+        sampler_sample();
+        if (metrics_ring_snapshot(metrics_ring, &snapshot) == 0)
+        {
+            size_t used = 0;
+            for (uint32_t i = 0; i < snapshot.num_names && used < sizeof(message.payload); i++)
+            {
+                int written = snprintf(message.payload + used, sizeof(message.payload) - used, "%s: %.3f\n",
+                                       snapshot.names[i], snapshot.latest[i].value);
+                used += written > 0 ? (size_t)written : 0;
+            }
+        }
+        break;
+    case MONITOR_MSG_STOP:
+        sampler_stop();
+        builtin = false;
+        break;
+    default:
+        result = -1;
+        snprintf(message.payload, sizeof(message.payload), "unsupported request %u", (unsigned int)type);
+        break;
+    }
+    if (result == -1)
+    {
+        message.type = MONITOR_MSG_ERROR;
+        fprintf(stderr, "Monitor: %s\n", message.payload);
+    }
+    if (reply)
+    {
+        *reply = message;
+    }
+    return result;
+}
+
+const MetricsRing* monitor_metrics(void)
+{
+    return metrics_ring;
+}
+
+int monitor_request(MonitorMessageType type, uint32_t value, const char* payload, MonitorMessage* reply)
+{
+    if (!monitor_running())
+    {
+        fprintf(stderr, "Monitor is not running\n");
+        return -1;
+    }
+    if (type == MONITOR_MSG_SET_METRICS)
+    {
+        monitor_collect(); // Record ids refer to the name table the request is about to replace.
+    }
+    if (builtin)
+    {
+        return builtin_request(type, value, payload, reply);
+    }
+    // Replies to requests that timed out earlier would otherwise be taken for this one's.
+    MonitorMessage message;
+    while (recv(control_fd, &message, sizeof(message), MSG_DONTWAIT) > 0)
+    {
+    }
+
+    message.type = type;
+    message.value = value;
+    snprintf(message.payload, sizeof(message.payload), "%s", payload ? payload : "");
+    size_t length = offsetof(MonitorMessage, payload) + strlen(message.payload) + 1;
+    if (send(control_fd, &message, length, MSG_NOSIGNAL) == -1)
+    {
+        perror("send to monitor failed");
+        return -1;
+    }
+
+    struct pollfd pfd = {.fd = control_fd, .events = POLLIN};
+    int ready;
+    while ((ready = poll(&pfd, 1, MONITOR_REPLY_TIMEOUT_MS)) == -1 && errno == EINTR)
+    {
+    }
+    ssize_t received = ready > 0 ? recv(control_fd, &message, sizeof(message), 0) : -1;
+    if (received < (ssize_t)offsetof(MonitorMessage, payload))
+    {
+        fprintf(stderr, "Monitor did not answer\n");
+        return -1;
+    }
+    message.payload[sizeof(message.payload) - 1] = '\0';
+    if ((ssize_t)sizeof(message) > received)
+    {
+        message.payload[received - (ssize_t)offsetof(MonitorMessage, payload)] = '\0';
+    }
+    if (reply)
+    {
+        *reply = message;
+    }
+    if (message.type == MONITOR_MSG_ERROR)
+    {
+        fprintf(stderr, "Monitor: %s\n", message.payload);
+        return -1;
+    }
+    return 0;
+}
+
+int monitor_stop(void)
+{
+    if (!monitor_running())
+    {
+        return -1;
+    }
+    monitor_collect();
+    if (collect_timer != -1)
+    {
+        event_loop_remove_timer(collect_timer);
+        collect_timer = -1;
+    }
+    if (builtin)
+    {
+        sampler_stop();
+        builtin = false;
+        return 0;
+    }
+    if (monitor_request(MONITOR_MSG_STOP, 0, NULL, NULL) == -1)
+    {
+        // A monitor that does not speak the protocol is stopped the old way.
+        kill(supervised_pid, SIGINT);
+    }
+    wait_for_job(&jobs[monitor_job_id - 1]);
+    monitor_job_id = 0;
+    close_channel();
+    monitor_fifo_cancel();
+    return 0;
+}
@@ -0,0 +1,111 @@
+/**
+ * @file monitor_channel.c
+ * @brief Implementation of the event-driven channels between the shell and the monitor.
+ */
+#include "monitor_channel.h"
+#include "event_loop.h"
+#include "utils.h"
+#include <libgen.h>
+#include <sys/inotify.h>
+
+static int inotify_fd = -1;
+static int status_dir_wd = -1;
+static char status_name[MAX_PATH];  /**< Base name of the status file inside the watched directory. */
+static int fifo_wd = -1;            /**< Watch on the FIFO with a pending send. */
+static int fifo_fd = -1;            /**< Our end of the FIFO with a pending send. */
+static time_t status_updated = 0;
+
+static void handle_inotify(int fd, uint32_t events, void* data)
+{
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t length;
+    while ((length = read(fd, buffer, sizeof(buffer))) > 0)
+    {
+        for (char* p = buffer; p < buffer + length;)
+        {
+            const struct inotify_event* event = (const struct inotify_event*)p;
+            if (event->wd == status_dir_wd && event->len && strcmp(event->name, status_name) == 0)
+            {
+                status_updated = time(NULL);
+            }
+            else if (event->wd == fifo_wd && (event->mask & IN_OPEN))
+            {
+                // The reader has the FIFO open now, so the queued data survives our close.
+                monitor_fifo_cancel();
+            }
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+}
+
+int monitor_channel_init(void)
+{
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd == -1)
+    {
+        perror("inotify_init1 failed");
+        return -1;
+    }
+    char status_path[MAX_PATH];
+    snprintf(status_path, sizeof(status_path), "%s", STATUS_FILE);
+    snprintf(status_name, sizeof(status_name), "%s", basename(status_path));
+    status_dir_wd = inotify_add_watch(inotify_fd, dirname(status_path), IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (status_dir_wd == -1)
+    {
+        perror("inotify_add_watch failed");
+    }
+    return event_loop_add(inotify_fd, EPOLLIN, 0, handle_inotify, NULL);
+}
+
+int monitor_fifo_send(const char* path, const char* data)
+{
+    if (inotify_fd == -1 || fifo_fd != -1)
+    {
+        return -1;
+    }
+    if (create_fifo(path, 0666) == -1)
+    {
+        return -1;
+    }
+    fifo_fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fifo_fd == -1)
+    {
+        perror("open fifo failed");
+        return -1;
+    }
+    size_t length = strlen(data);
+    if (write(fifo_fd, data, length) != (ssize_t)length)
+    {
+        perror("write to fifo failed");
+        monitor_fifo_cancel();
+        return -1;
+    }
+    // Watch only after our own open, so the first IN_OPEN is the reader's.
+    fifo_wd = inotify_add_watch(inotify_fd, path, IN_OPEN);
+    if (fifo_wd == -1)
+    {
+        perror("inotify_add_watch failed");
+        monitor_fifo_cancel();
+        return -1;
+    }
+    return 0;
+}
+
+void monitor_fifo_cancel(void)
+{
+    if (fifo_wd != -1)
+    {
+        inotify_rm_watch(inotify_fd, fifo_wd);
+        fifo_wd = -1;
+    }
+    if (fifo_fd != -1)
+    {
+        close(fifo_fd);
+        fifo_fd = -1;
+    }
+}
+
+time_t monitor_status_updated(void)
+{
+    return status_updated;
+}
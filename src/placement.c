@@ -0,0 +1,277 @@
+/**
+ * @file placement.c
+ * @brief Implementation of the CPU and NUMA placement of launched jobs.
+ */
+#include "placement.h"
+#include <dirent.h>
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+
+#define NODE_DIR "/sys/devices/system/node" /**< Where the kernel lists NUMA nodes and their CPUs. */
+#define CPU_LIST_SIZE 4096                  /**< Largest cpulist file read from sysfs. */
+
+static bool topology_loaded = false;
+static cpu_set_t allowed;                        /**< CPUs the shell may run on. */
+static int cpu_ids[CPU_SETSIZE];                 /**< The allowed CPUs, in order. */
+static int num_cpus = 0;
+static cpu_set_t node_cpus[PLACEMENT_MAX_NODES]; /**< Allowed CPUs of each node that has any. */
+static int node_ids[PLACEMENT_MAX_NODES];
+static int num_nodes = 0;
+static size_t next_cpu = 0;                      /**< Round-robin position when spreading over cores. */
+static size_t next_node = 0;                     /**< Round-robin position when spreading over nodes. */
+
+/**
+ * @brief Parses a kernel-style CPU list, e.g. "0-3,8", into a set.
+ *
+ * @return 0 on success, -1 if the list is malformed or names a CPU beyond CPU_SETSIZE.
+ */
+static int parse_cpu_list(const char* list, cpu_set_t* set)
+{
+    CPU_ZERO(set);
+    const char* p = list;
+    while (*p && *p != '\n')
+    {
+        char* end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (end == p || first < 0)
+        {
+            return -1;
+        }
+        p = end;
+        if (*p == '-')
+        {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1 || last < first)
+            {
+                return -1;
+            }
+            p = end;
+        }
+        if (last >= CPU_SETSIZE)
+        {
+            return -1;
+        }
+        for (long cpu = first; cpu <= last; cpu++)
+        {
+            CPU_SET((size_t)cpu, set);
+        }
+        if (*p == ',')
+        {
+            p++;
+        }
+        else if (*p && *p != '\n')
+        {
+            return -1;
+        }
+    }
+    return p == list ? -1 : 0;
+}
+
+/**
+ * @brief Formats a set as a kernel-style CPU list, e.g. "0-3,8", ending in "..." if it does not fit.
+ */
+static void format_cpu_list(const cpu_set_t* set, char* list, size_t size)
+{
+    size_t used = 0;
+    list[0] = '\0';
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (!CPU_ISSET((size_t)cpu, set))
+        {
+            continue;
+        }
+        int last = cpu;
+        while (last + 1 < CPU_SETSIZE && CPU_ISSET((size_t)(last + 1), set))
+        {
+            last++;
+        }
+        const char* separator = used ? "," : "";
+        int written = last == cpu ? snprintf(list + used, size - used, "%s%d", separator, cpu)
+                                  : snprintf(list + used, size - used, "%s%d-%d", separator, cpu, last);
+        if (written < 0 || (size_t)written >= size - used)
+        {
+            // Keep the ranges that fit and mark the rest as left out.
+            size_t end = used + 4 <= size ? used : size - 4;
+            memcpy(list + end, "...", 4);
+            return;
+        }
+        used += (size_t)written;
+        cpu = last;
+    }
+}
+
+/**
+ * @brief Reads the node's CPUs from sysfs, keeping those the shell may run on.
+ */
+static int read_node_cpus(int node, cpu_set_t* set)
+{
+    char path[64];
+    char list[CPU_LIST_SIZE];
+    snprintf(path, sizeof(path), NODE_DIR "/node%d/cpulist", node);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return -1;
+    }
+    ssize_t length = read(fd, list, sizeof(list) - 1);
+    close(fd);
+    if (length <= 0)
+    {
+        return -1;
+    }
+    list[length] = '\0';
+    if (parse_cpu_list(list, set) == -1)
+    {
+        return -1;
+    }
+    CPU_AND(set, set, &allowed);
+    return CPU_COUNT(set) > 0 ? 0 : -1;
+}
+
+/**
+ * @brief Reads the shell's affinity and the NUMA nodes, once.
+ */
+static int load_topology(void)
+{
+    if (topology_loaded)
+    {
+        return 0;
+    }
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1)
+    {
+        perror("sched_getaffinity failed");
+        return -1;
+    }
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (CPU_ISSET((size_t)cpu, &allowed))
+        {
+            cpu_ids[num_cpus++] = cpu;
+        }
+    }
+    DIR* dir = opendir(NODE_DIR);
+    struct dirent* entry;
+    while (dir && (entry = readdir(dir)) != NULL)
+    {
+        char* end;
+        long node = strncmp(entry->d_name, "node", 4) == 0 ? strtol(entry->d_name + 4, &end, 10) : -1;
+        if (node < 0 || node >= PLACEMENT_MAX_NODES || *end != '\0' || num_nodes == PLACEMENT_MAX_NODES)
+        {
+            continue;
+        }
+        if (read_node_cpus((int)node, &node_cpus[num_nodes]) == 0)
+        {
+            node_ids[num_nodes++] = (int)node;
+        }
+    }
+    if (dir)
+    {
+        closedir(dir);
+    }
+    // readdir order is arbitrary; keep the nodes sorted so the round-robin goes 0, 1, 2...
+    for (int i = 1; i < num_nodes; i++)
+    {
+        for (int j = i; j > 0 && node_ids[j - 1] > node_ids[j]; j--)
+        {
+            int id = node_ids[j];
+            node_ids[j] = node_ids[j - 1];
+            node_ids[j - 1] = id;
+            cpu_set_t cpus = node_cpus[j];
+            node_cpus[j] = node_cpus[j - 1];
+            node_cpus[j - 1] = cpus;
+        }
+    }
+    if (num_nodes == 0)
+    {
+        // No NUMA information: everything is one node.
+        node_ids[0] = 0;
+        node_cpus[0] = allowed;
+        num_nodes = 1;
+    }
+    topology_loaded = true;
+    return 0;
+}
+
+int placement_parse(const char* list, Placement* placement)
+{
+    if (load_topology() == -1)
+    {
+        return -1;
+    }
+    if (parse_cpu_list(list, &placement->cpus) == -1)
+    {
+        fprintf(stderr, "pin: %s: not a list of CPUs\n", list);
+        return -1;
+    }
+    CPU_AND(&placement->cpus, &placement->cpus, &allowed);
+    if (CPU_COUNT(&placement->cpus) == 0)
+    {
+        char allowed_list[CPU_LIST_SIZE];
+        format_cpu_list(&allowed, allowed_list, sizeof(allowed_list));
+        fprintf(stderr, "pin: %s: none of these CPUs is available to the shell, which may run on %s\n", list,
+                allowed_list);
+        return -1;
+    }
+    placement->node = -1;
+    // Label the CPUs the job really gets, not the ones asked for.
+    size_t prefix = (size_t)snprintf(placement->label, sizeof(placement->label), "cpus ");
+    format_cpu_list(&placement->cpus, placement->label + prefix, sizeof(placement->label) - prefix);
+    return 0;
+}
+
+int placement_next(PlacementSpread spread, Placement* placement)
+{
+    if (spread == PLACEMENT_SPREAD_OFF || load_topology() == -1 || num_cpus == 0)
+    {
+        return -1;
+    }
+    if (spread == PLACEMENT_SPREAD_CORES)
+    {
+        int cpu = cpu_ids[next_cpu++ % (size_t)num_cpus];
+        CPU_ZERO(&placement->cpus);
+        CPU_SET((size_t)cpu, &placement->cpus);
+        placement->node = -1;
+        snprintf(placement->label, sizeof(placement->label), "cpu %d", cpu);
+        return 0;
+    }
+    size_t index = next_node++ % (size_t)num_nodes;
+    placement->cpus = node_cpus[index];
+    placement->node = node_ids[index];
+    snprintf(placement->label, sizeof(placement->label), "node %d", node_ids[index]);
+    return 0;
+}
+
+int placement_apply(const Placement* placement)
+{
+    if (sched_setaffinity(0, sizeof(placement->cpus), &placement->cpus) == -1)
+    {
+        perror("sched_setaffinity failed");
+        return -1;
+    }
+    if (placement->node >= 0)
+    {
+        unsigned long nodes[PLACEMENT_MAX_NODES / (8 * sizeof(unsigned long))] = {0};
+        nodes[(size_t)placement->node / (8 * sizeof(unsigned long))] |=
+            1ul << ((size_t)placement->node % (8 * sizeof(unsigned long)));
+        // Through the system call, so the shell does not need libnuma.
+        if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, nodes, (unsigned long)PLACEMENT_MAX_NODES + 1) == -1)
+        {
+            perror("set_mempolicy failed");
+        }
+    }
+    return 0;
+}
+
+const char* placement_spread_name(PlacementSpread spread)
+{
+    switch (spread)
+    {
+    case PLACEMENT_SPREAD_CORES:
+        return "cores";
+    case PLACEMENT_SPREAD_NODES:
+        return "nodes";
+    default:
+        return "off";
+    }
+}
@@ -0,0 +1,529 @@
+/**
+ * @file sampler.c
+ * @brief Implementation of the built-in /proc metrics sampler.
+ */
+#include "sampler.h"
+#include "event_loop.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SAMPLER_BUFFER_INITIAL 16384 /**< Initial size of the read buffer; it doubles while a file does not fit. */
+
+/**
+ * @enum ProcSource
+ * @brief The /proc files the sampler reads.
+ */
+typedef enum
+{
+    SOURCE_STAT,
+    SOURCE_MEMINFO,
+    SOURCE_DISKSTATS,
+    SOURCE_NETDEV,
+    SOURCE_COUNT
+} ProcSource;
+
+/**
+ * @enum MetricId
+ * @brief The metrics the sampler computes, in the order of the metric table.
+ */
+typedef enum
+{
+    METRIC_CPU_USAGE,
+    METRIC_CPU_IOWAIT,
+    METRIC_CONTEXT_SWITCHES,
+    METRIC_PROCESSES_RUNNING,
+    METRIC_MEMORY_USAGE,
+    METRIC_MEMORY_AVAILABLE,
+    METRIC_SWAP_USED,
+    METRIC_DISK_READS,
+    METRIC_DISK_WRITES,
+    METRIC_DISK_READ_KB,
+    METRIC_DISK_WRITE_KB,
+    METRIC_NET_RX_KB,
+    METRIC_NET_TX_KB,
+    METRIC_COUNT
+} MetricId;
+
+/**
+ * @struct NativeMetric
+ * @brief Name of a metric and the file it comes from.
+ */
+typedef struct
+{
+    const char* name;  /**< Name used by set_metrics and shown by status_monitor. */
+    ProcSource source; /**< File the metric is computed from. */
+} NativeMetric;
+
+static const NativeMetric native_metrics[METRIC_COUNT] = {
+    {"cpu_usage", SOURCE_STAT},          // % of CPU time not idle since the last sample
+    {"cpu_iowait", SOURCE_STAT},         // % of CPU time waiting for I/O
+    {"context_switches", SOURCE_STAT},   // per second
+    {"processes_running", SOURCE_STAT},  // runnable tasks
+    {"memory_usage", SOURCE_MEMINFO},    // % of memory not available
+    {"memory_available_mb", SOURCE_MEMINFO},
+    {"swap_used_mb", SOURCE_MEMINFO},
+    {"disk_reads", SOURCE_DISKSTATS},    // completed reads per second, whole disks only
+    {"disk_writes", SOURCE_DISKSTATS},   // completed writes per second
+    {"disk_read_kb", SOURCE_DISKSTATS},  // KiB read per second
+    {"disk_write_kb", SOURCE_DISKSTATS}, // KiB written per second
+    {"net_rx_kb", SOURCE_NETDEV},        // KiB received per second, loopback excluded
+    {"net_tx_kb", SOURCE_NETDEV},        // KiB sent per second
+};
+
+static const char* const source_paths[SOURCE_COUNT] = {"/proc/stat", "/proc/meminfo", "/proc/diskstats",
+                                                       "/proc/net/dev"};
+
+/**
+ * @struct Readings
+ * @brief Raw counters of one sample, from which the metrics are computed.
+ */
+typedef struct
+{
+    double seconds;              /**< Monotonic time of the sample. */
+    uint64_t cpu_total;          /**< Jiffies spent in every state. */
+    uint64_t cpu_idle;           /**< Jiffies idle or waiting for I/O. */
+    uint64_t cpu_iowait;         /**< Jiffies waiting for I/O. */
+    uint64_t context_switches;   /**< Context switches since boot. */
+    uint64_t procs_running;      /**< Runnable tasks. */
+    uint64_t mem_total_kb;       /**< MemTotal. */
+    uint64_t mem_available_kb;   /**< MemAvailable. */
+    uint64_t swap_total_kb;      /**< SwapTotal. */
+    uint64_t swap_free_kb;       /**< SwapFree. */
+    uint64_t disk_reads;         /**< Reads completed. */
+    uint64_t disk_writes;        /**< Writes completed. */
+    uint64_t disk_read_sectors;  /**< 512-byte sectors read. */
+    uint64_t disk_write_sectors; /**< 512-byte sectors written. */
+    uint64_t net_rx_bytes;       /**< Bytes received. */
+    uint64_t net_tx_bytes;       /**< Bytes sent. */
+} Readings;
+
+static MetricsRing* sampler_ring = NULL;
+static int sampler_timer = -1;
+static int interval_ms = 1000;
+static int source_fds[SOURCE_COUNT] = {-1, -1, -1, -1};
+static char* buffer = NULL;
+static size_t buffer_size = 0;
+static MetricId selected[METRICS_MAX_NAMES]; /**< Metric of each entry of the ring's name table. */
+static uint32_t num_selected = 0;
+static Readings previous;
+static bool have_previous = false;
+
+/**
+ * @brief Reads a /proc file from the start into the buffer, opening it on first use.
+ *
+ * @return The contents, NUL-terminated, or NULL on failure.
+ */
+static const char* read_source(ProcSource source)
+{
+    if (source_fds[source] == -1 && (source_fds[source] = open(source_paths[source], O_RDONLY | O_CLOEXEC)) == -1)
+    {
+        return NULL;
+    }
+    while (1)
+    {
+        if (buffer_size == 0)
+        {
+            buffer = malloc(SAMPLER_BUFFER_INITIAL);
+            buffer_size = buffer ? SAMPLER_BUFFER_INITIAL : 0;
+        }
+        if (buffer == NULL)
+        {
+            return NULL;
+        }
+        // /proc files are generated on read, so a read from offset 0 is a fresh copy without an lseek.
+        ssize_t length = pread(source_fds[source], buffer, buffer_size - 1, 0);
+        if (length == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (length == -1)
+        {
+            return NULL;
+        }
+        if ((size_t)length < buffer_size - 1)
+        {
+            buffer[length] = '\0';
+            return buffer;
+        }
+        char* grown = realloc(buffer, buffer_size * 2);
+        if (grown == NULL)
+        {
+            return NULL;
+        }
+        buffer = grown;
+        buffer_size *= 2;
+    }
+}
+
+/**
+ * @brief Parses an unsigned decimal number after optional blanks.
+ *
+ * @return The position after the number.
+ */
+static const char* parse_number(const char* p, uint64_t* value)
+{
+    while (*p == ' ' || *p == '\t')
+    {
+        p++;
+    }
+    uint64_t result = 0;
+    while (*p >= '0' && *p <= '9')
+    {
+        result = result * 10 + (uint64_t)(*p++ - '0');
+    }
+    *value = result;
+    return p;
+}
+
+/**
+ * @brief Finds the line that starts with a key.
+ *
+ * @return The position right after the key, or NULL if no line starts with it.
+ */
+static const char* find_line(const char* text, const char* key)
+{
+    size_t key_length = strlen(key);
+    for (const char* line = text; line && *line; line = strchr(line, '\n'), line = line ? line + 1 : NULL)
+    {
+        if (strncmp(line, key, key_length) == 0)
+        {
+            return line + key_length;
+        }
+    }
+    return NULL;
+}
+
+static uint64_t line_value(const char* text, const char* key)
+{
+    uint64_t value = 0;
+    const char* p = find_line(text, key);
+    if (p)
+    {
+        parse_number(p, &value);
+    }
+    return value;
+}
+
+static void read_stat(Readings* readings)
+{
+    const char* text = read_source(SOURCE_STAT);
+    const char* p = text ? find_line(text, "cpu ") : NULL;
+    if (p == NULL)
+    {
+        return;
+    }
+    // user nice system idle iowait irq softirq steal; guest time is already counted in user and nice.
+    uint64_t fields[8] = {0};
+    for (int i = 0; i < 8; i++)
+    {
+        p = parse_number(p, &fields[i]);
+        readings->cpu_total += fields[i];
+    }
+    readings->cpu_idle = fields[3] + fields[4];
+    readings->cpu_iowait = fields[4];
+    readings->context_switches = line_value(text, "ctxt ");
+    readings->procs_running = line_value(text, "procs_running ");
+}
+
+static void read_meminfo(Readings* readings)
+{
+    const char* text = read_source(SOURCE_MEMINFO);
+    if (text == NULL)
+    {
+        return;
+    }
+    readings->mem_total_kb = line_value(text, "MemTotal:");
+    readings->mem_available_kb = line_value(text, "MemAvailable:");
+    readings->swap_total_kb = line_value(text, "SwapTotal:");
+    readings->swap_free_kb = line_value(text, "SwapFree:");
+}
+
+/**
+ * @brief Sums the I/O of whole disks. Loop, RAM and device-mapper devices are skipped, as their I/O is either
+ * not disk I/O or already counted on the disks below them, and so are partitions, which the kernel lists
+ * right after their disk with the disk's name as a prefix.
+ */
+static void read_diskstats(Readings* readings)
+{
+    const char* text = read_source(SOURCE_DISKSTATS);
+    char disk[64] = "";
+    for (const char* line = text; line && *line;)
+    {
+        const char* end = strchr(line, '\n');
+        uint64_t major, minor;
+        const char* p = parse_number(parse_number(line, &major), &minor);
+        p += strspn(p, " ");
+        size_t name_length = strcspn(p, " \n");
+        const char* name = p;
+        p += name_length;
+        bool partition = disk[0] && strlen(disk) < name_length && strncmp(name, disk, strlen(disk)) == 0;
+        bool pseudo = strncmp(name, "loop", 4) == 0 || strncmp(name, "ram", 3) == 0 || strncmp(name, "zram", 4) == 0 ||
+                      strncmp(name, "dm-", 3) == 0;
+        if (name_length > 0 && !partition && !pseudo)
+        {
+            snprintf(disk, sizeof(disk), "%.*s", (int)name_length, name);
+            // reads merged sectors ms writes merged sectors
+            uint64_t fields[7];
+            for (int i = 0; i < 7; i++)
+            {
+                p = parse_number(p, &fields[i]);
+            }
+            readings->disk_reads += fields[0];
+            readings->disk_read_sectors += fields[2];
+            readings->disk_writes += fields[4];
+            readings->disk_write_sectors += fields[6];
+        }
+        line = end ? end + 1 : NULL;
+    }
+}
+
+static void read_netdev(Readings* readings)
+{
+    const char* text = read_source(SOURCE_NETDEV);
+    for (const char* line = text; line && *line;)
+    {
+        const char* end = strchr(line, '\n');
+        const char* colon = strchr(line, ':');
+        if (colon && (end == NULL || colon < end))
+        {
+            const char* name = line + strspn(line, " ");
+            if (!(colon - name == 2 && strncmp(name, "lo", 2) == 0))
+            {
+                // Receive: bytes packets errs drop fifo frame compressed multicast; then transmit bytes.
+                uint64_t fields[9];
+                const char* p = colon + 1;
+                for (int i = 0; i < 9; i++)
+                {
+                    p = parse_number(p, &fields[i]);
+                }
+                readings->net_rx_bytes += fields[0];
+                readings->net_tx_bytes += fields[8];
+            }
+        }
+        line = end ? end + 1 : NULL;
+    }
+}
+
+static double rate(uint64_t current, uint64_t last, double seconds)
+{
+    return seconds > 0 && current >= last ? (double)(current - last) / seconds : 0;
+}
+
+static double metric_value(MetricId metric, const Readings* now, const Readings* last)
+{
+    double seconds = have_previous ? now->seconds - last->seconds : 0;
+    uint64_t cpu_delta = have_previous && now->cpu_total > last->cpu_total ? now->cpu_total - last->cpu_total : 0;
+    switch (metric)
+    {
+    case METRIC_CPU_USAGE:
+        return cpu_delta ? 100.0 * (1.0 - (double)(now->cpu_idle - last->cpu_idle) / (double)cpu_delta) : 0;
+    case METRIC_CPU_IOWAIT:
+        return cpu_delta ? 100.0 * (double)(now->cpu_iowait - last->cpu_iowait) / (double)cpu_delta : 0;
+    case METRIC_CONTEXT_SWITCHES:
+        return rate(now->context_switches, last->context_switches, seconds);
+    case METRIC_PROCESSES_RUNNING:
+        return (double)now->procs_running;
+    case METRIC_MEMORY_USAGE:
+        return now->mem_total_kb
+                   ? 100.0 * (double)(now->mem_total_kb - now->mem_available_kb) / (double)now->mem_total_kb
+                   : 0;
+    case METRIC_MEMORY_AVAILABLE:
+        return (double)now->mem_available_kb / 1024.0;
+    case METRIC_SWAP_USED:
+        return (double)(now->swap_total_kb - now->swap_free_kb) / 1024.0;
+    case METRIC_DISK_READS:
+        return rate(now->disk_reads, last->disk_reads, seconds);
+    case METRIC_DISK_WRITES:
+        return rate(now->disk_writes, last->disk_writes, seconds);
+    case METRIC_DISK_READ_KB:
+        return rate(now->disk_read_sectors, last->disk_read_sectors, seconds) / 2.0;
+    case METRIC_DISK_WRITE_KB:
+        return rate(now->disk_write_sectors, last->disk_write_sectors, seconds) / 2.0;
+    case METRIC_NET_RX_KB:
+        return rate(now->net_rx_bytes, last->net_rx_bytes, seconds) / 1024.0;
+    case METRIC_NET_TX_KB:
+        return rate(now->net_tx_bytes, last->net_tx_bytes, seconds) / 1024.0;
+    default:
+        return 0;
+    }
+}
+
+int sampler_sample(void)
+{
+    if (sampler_ring == NULL)
+    {
+        return -1;
+    }
+    bool needed[SOURCE_COUNT] = {false};
+    for (uint32_t i = 0; i < num_selected; i++)
+    {
+        needed[native_metrics[selected[i]].source] = true;
+    }
+    Readings now;
+    memset(&now, 0, sizeof(now));
+    struct timespec monotonic;
+    clock_gettime(CLOCK_MONOTONIC, &monotonic);
+    now.seconds = (double)monotonic.tv_sec + (double)monotonic.tv_nsec / 1e9;
+    if (needed[SOURCE_STAT])
+    {
+        read_stat(&now);
+    }
+    if (needed[SOURCE_MEMINFO])
+    {
+        read_meminfo(&now);
+    }
+    if (needed[SOURCE_DISKSTATS])
+    {
+        read_diskstats(&now);
+    }
+    if (needed[SOURCE_NETDEV])
+    {
+        read_netdev(&now);
+    }
+
+    struct timespec realtime;
+    clock_gettime(CLOCK_REALTIME, &realtime);
+    uint64_t timestamp = (uint64_t)realtime.tv_sec * 1000000000u + (uint64_t)realtime.tv_nsec;
+    MetricRecord records[METRICS_MAX_NAMES];
+    for (uint32_t i = 0; i < num_selected; i++)
+    {
+        records[i].timestamp_ns = timestamp;
+        records[i].metric_id = i;
+        records[i].reserved = 0;
+        records[i].value = metric_value(selected[i], &now, &previous);
+    }
+    metrics_ring_publish(sampler_ring, records, num_selected);
+    previous = now;
+    have_previous = true;
+    return (int)num_selected;
+}
+
+static void handle_sampler_timer(int fd, uint32_t events, void* data)
+{
+    sampler_sample();
+}
+
+int sampler_start(MetricsRing* ring, int interval_seconds)
+{
+    if (ring == NULL || interval_seconds <= 0 || interval_seconds > SAMPLER_MAX_INTERVAL)
+    {
+        return -1;
+    }
+    sampler_ring = ring;
+    interval_ms = interval_seconds * 1000;
+    num_selected = 0;
+    have_previous = false;
+    metrics_ring_set_names(ring, "");
+    if (event_loop_active() && sampler_timer == -1)
+    {
+        sampler_timer = event_loop_add_timer((unsigned int)interval_ms, true, handle_sampler_timer, NULL);
+    }
+    return 0;
+}
+
+bool sampler_running(void)
+{
+    return sampler_ring != NULL;
+}
+
+int sampler_set_interval(int interval_seconds)
+{
+    if (interval_seconds <= 0 || interval_seconds > SAMPLER_MAX_INTERVAL)
+    {
+        return -1;
+    }
+    interval_ms = interval_seconds * 1000;
+    if (sampler_timer != -1)
+    {
+        event_loop_set_timer(sampler_timer, (unsigned int)interval_ms, true);
+    }
+    return 0;
+}
+
+int sampler_set_metrics(const char* list, char* error, size_t error_size)
+{
+    MetricId chosen[METRICS_MAX_NAMES];
+    uint32_t count = 0;
+    const char* p = list;
+    while (*p)
+    {
+        p += strspn(p, " \t,");
+        size_t length = strcspn(p, ", \t");
+        if (length == 0)
+        {
+            break;
+        }
+        size_t metric = 0;
+        while (metric < METRIC_COUNT &&
+               !(strlen(native_metrics[metric].name) == length && strncmp(native_metrics[metric].name, p, length) == 0))
+        {
+            metric++;
+        }
+        if (metric == METRIC_COUNT)
+        {
+            snprintf(error, error_size, "unknown metric '%.*s'", (int)length, p);
+            return -1;
+        }
+        if (count == METRICS_MAX_NAMES)
+        {
+            snprintf(error, error_size, "too many metrics");
+            return -1;
+        }
+        chosen[count++] = (MetricId)metric;
+        p += length;
+    }
+    memcpy(selected, chosen, count * sizeof(MetricId));
+    num_selected = count;
+    char names[METRICS_MAX_NAMES * METRICS_NAME_SIZE] = "";
+    size_t used = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        used += (size_t)snprintf(names + used, sizeof(names) - used, "%s%s", i ? "," : "",
+                                 native_metrics[selected[i]].name);
+    }
+    if (sampler_ring)
+    {
+        metrics_ring_set_names(sampler_ring, names);
+        have_previous = false;
+        sampler_sample(); // Primes the rates, so the first timed sample already shows them.
+    }
+    return 0;
+}
+
+void sampler_stop(void)
+{
+    if (sampler_timer != -1)
+    {
+        event_loop_remove_timer(sampler_timer);
+        sampler_timer = -1;
+    }
+    for (int i = 0; i < SOURCE_COUNT; i++)
+    {
+        if (source_fds[i] != -1)
+        {
+            close(source_fds[i]);
+            source_fds[i] = -1;
+        }
+    }
+    free(buffer);
+    buffer = NULL;
+    buffer_size = 0;
+    sampler_ring = NULL;
+    num_selected = 0;
+}
+
+size_t sampler_metric_count(void)
+{
+    return METRIC_COUNT;
+}
+
+const char* sampler_metric_name(size_t index)
+{
+    return native_metrics[index].name;
+}
@@ -0,0 +1,220 @@
+/**
+ * @file scheduler.c
+ * @brief Implementation of the background job scheduler.
+ */
+#include "scheduler.h"
+#include "execution.h"
+#include "jobs.h"
+#include "utils.h"
+
+/**
+ * @struct QueuedCommand
+ * @brief The command line of a queued job, parsed again into an arena of its own.
+ */
+typedef struct QueuedCommand
+{
+    struct QueuedCommand* next; /**< Next entry, in submission order. */
+    int job_id;                 /**< ID of the queued job holding the line's place in the job table. */
+    Arena arena;                /**< Arena holding parsed_cmd. */
+    ParsedCommand parsed_cmd;   /**< The line, as it will be launched. */
+} QueuedCommand;
+
+static QueuedCommand* queue_head = NULL;
+static QueuedCommand** queue_tail = &queue_head;
+static size_t queue_length = 0;
+static size_t max_running = 0; /**< Limit of running scheduled jobs, 0 for none. */
+static pid_t owner = 0;        /**< Process the limit was set in; its forked children never queue. */
+static bool starting = false;  /**< Set while a job is being launched, so the reaper does not start more. */
+static PlacementSpread spread = PLACEMENT_SPREAD_OFF;
+
+static int nice_of(const ParsedCommand* parsed_cmd)
+{
+    return parsed_cmd->has_priority ? parsed_cmd->priority : 0;
+}
+
+static bool limited(void)
+{
+    return max_running > 0 && getpid() == owner;
+}
+
+/**
+ * @brief Finds the queue link pointing at a job's entry.
+ */
+static QueuedCommand** find_entry(int job_id)
+{
+    QueuedCommand** link = &queue_head;
+    while (*link && (*link)->job_id != job_id)
+    {
+        link = &(*link)->next;
+    }
+    return *link ? link : NULL;
+}
+
+static QueuedCommand* unlink_entry(QueuedCommand** link)
+{
+    QueuedCommand* entry = *link;
+    *link = entry->next;
+    if (queue_tail == &entry->next)
+    {
+        queue_tail = link;
+    }
+    queue_length--;
+    return entry;
+}
+
+static void free_entry(QueuedCommand* entry)
+{
+    arena_destroy(&entry->arena);
+    free(entry);
+}
+
+/**
+ * @brief Launches a line as the given queued job, which is removed if no job came out of the launch.
+ *
+ * @return The status of the launch.
+ */
+static int launch_queued(int job_id, ParsedCommand* parsed_cmd)
+{
+    const Placement* pinned = parsed_cmd->placement;
+    Placement placement;
+    if (pinned == NULL && placement_next(spread, &placement) == 0)
+    {
+        parsed_cmd->placement = &placement;
+    }
+    bool was_starting = starting;
+    starting = true;
+    job_reserve_slot(&jobs[job_id - 1]);
+    int status = launch_command(parsed_cmd);
+    job_reserve_slot(NULL);
+    starting = was_starting;
+    parsed_cmd->placement = pinned;
+    if (jobs[job_id - 1].state == JOB_QUEUED)
+    {
+        remove_job(&jobs[job_id - 1]);
+    }
+    return status;
+}
+
+int scheduler_submit(ParsedCommand* parsed_cmd)
+{
+    Job* job = create_queued_job(parsed_cmd->text);
+    if (job == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+    int job_id = job->job_id;
+    if (!limited() || scheduler_running() < max_running)
+    {
+        return launch_queued(job_id, parsed_cmd);
+    }
+    // The caller releases its arena once this returns, so the entry needs a copy of its own.
+    QueuedCommand* entry = malloc(sizeof(QueuedCommand));
+    if (entry)
+    {
+        arena_init(&entry->arena);
+    }
+    if (entry == NULL || parse_command_line(parsed_cmd->text, &entry->parsed_cmd, &entry->arena) == -1)
+    {
+        fprintf(stderr, "Unable to queue job.\n");
+        if (entry)
+        {
+            free_entry(entry);
+        }
+        remove_job(&jobs[job_id - 1]);
+        return EXIT_FAILURE;
+    }
+    entry->parsed_cmd.is_background = 1;
+    entry->job_id = job_id;
+    entry->next = NULL;
+    *queue_tail = entry;
+    queue_tail = &entry->next;
+    queue_length++;
+    printf("[Queued] Job %d, %zu waiting\n", job_id, queue_length);
+    return 0;
+}
+
+void scheduler_pump(void)
+{
+    if (starting || queue_head == NULL || getpid() != owner)
+    {
+        return;
+    }
+    while (queue_head && (max_running == 0 || scheduler_running() < max_running))
+    {
+        QueuedCommand** best = &queue_head;
+        for (QueuedCommand** link = &queue_head->next; *link; link = &(*link)->next)
+        {
+            if (nice_of(&(*link)->parsed_cmd) < nice_of(&(*best)->parsed_cmd))
+            {
+                best = link;
+            }
+        }
+        QueuedCommand* entry = unlink_entry(best);
+        launch_queued(entry->job_id, &entry->parsed_cmd);
+        free_entry(entry);
+    }
+}
+
+int scheduler_start(Job* job)
+{
+    int job_id = job->job_id;
+    QueuedCommand** link = find_entry(job_id);
+    if (link == NULL)
+    {
+        return -1;
+    }
+    QueuedCommand* entry = unlink_entry(link);
+    launch_queued(job_id, &entry->parsed_cmd);
+    free_entry(entry);
+    return jobs[job_id - 1].job_id == job_id ? 0 : -1;
+}
+
+void scheduler_cancel(Job* job)
+{
+    QueuedCommand** link = find_entry(job->job_id);
+    if (link)
+    {
+        free_entry(unlink_entry(link));
+    }
+    remove_job(job);
+}
+
+void scheduler_set_limit(size_t limit)
+{
+    max_running = limit;
+    owner = getpid();
+    scheduler_pump();
+}
+
+void scheduler_set_spread(PlacementSpread mode)
+{
+    spread = mode;
+}
+
+PlacementSpread scheduler_spread(void)
+{
+    return spread;
+}
+
+size_t scheduler_limit(void)
+{
+    return max_running;
+}
+
+size_t scheduler_running(void)
+{
+    size_t running = 0;
+    for (size_t i = 0; i < job_capacity; i++)
+    {
+        if (jobs[i].job_id && jobs[i].scheduled && jobs[i].state == JOB_RUNNING)
+        {
+            running++;
+        }
+    }
+    return running;
+}
+
+size_t scheduler_queued(void)
+{
+    return queue_length;
+}
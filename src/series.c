@@ -0,0 +1,374 @@
+/**
+ * @file series.c
+ * @brief Implementation of the shell's in-memory time series of monitored metrics.
+ */
+#include "series.h"
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SERIES_FILE_MAGIC "SHTS"              /**< First bytes of a saved store. */
+#define SERIES_FILE_VERSION 1u                /**< Layout of a saved store. */
+#define NS_PER_MINUTE (60ull * 1000000000ull) /**< Width of a minute bucket. */
+#define NS_PER_HOUR (60ull * NS_PER_MINUTE)   /**< Width of an hour bucket. */
+#define NS_PER_DAY (24ull * NS_PER_HOUR)      /**< Range beyond which hour buckets answer. */
+
+/**
+ * @struct SeriesPoint
+ * @brief One raw sample.
+ */
+typedef struct
+{
+    uint64_t timestamp_ns; /**< CLOCK_REALTIME time of the sample. */
+    double value;          /**< The sample. */
+} SeriesPoint;
+
+/**
+ * @struct Series
+ * @brief The rings of one metric, allocated together on its first sample.
+ */
+typedef struct
+{
+    char name[SERIES_NAME_SIZE];              /**< Name of the metric. */
+    uint64_t written[SERIES_TIER_COUNT];      /**< Entries ever written per tier; slot written % capacity is next. */
+    SeriesPoint* raw;                         /**< Ring of raw samples. */
+    SeriesBucket* rollups[SERIES_TIER_COUNT]; /**< Rings of the minute and hour tiers; the raw entry is unused. */
+} Series;
+
+/**
+ * @struct SeriesFileHeader
+ * @brief Start of a saved store, followed by every series.
+ */
+typedef struct
+{
+    char magic[4];    /**< SERIES_FILE_MAGIC. */
+    uint32_t version; /**< SERIES_FILE_VERSION. */
+    uint32_t count;   /**< Number of series that follow. */
+    uint32_t reserved;
+} SeriesFileHeader;
+
+/**
+ * @struct SeriesFileEntry
+ * @brief Start of a saved series, followed by its retained entries per tier, oldest first.
+ */
+typedef struct
+{
+    char name[SERIES_NAME_SIZE];         /**< Name of the metric. */
+    uint64_t written[SERIES_TIER_COUNT]; /**< Entries ever written per tier. */
+} SeriesFileEntry;
+
+static const uint64_t tier_capacity[SERIES_TIER_COUNT] = {SERIES_RAW_CAPACITY, SERIES_MINUTE_CAPACITY,
+                                                          SERIES_HOUR_CAPACITY};
+static const uint64_t tier_width[SERIES_TIER_COUNT] = {0, NS_PER_MINUTE, NS_PER_HOUR};
+
+static Series table[SERIES_MAX];
+static size_t used = 0;
+
+/**
+ * @brief Finds a metric's series, creating it if asked to.
+ */
+static Series* find_series(const char* metric, bool create)
+{
+    for (size_t i = 0; i < used; i++)
+    {
+        if (strcmp(table[i].name, metric) == 0)
+        {
+            return &table[i];
+        }
+    }
+    if (!create || used == SERIES_MAX)
+    {
+        return NULL;
+    }
+    Series* series = &table[used];
+    memset(series, 0, sizeof(*series));
+    void* block = calloc(1, SERIES_RAW_CAPACITY * sizeof(SeriesPoint) +
+                                (SERIES_MINUTE_CAPACITY + SERIES_HOUR_CAPACITY) * sizeof(SeriesBucket));
+    if (block == NULL)
+    {
+        perror("calloc failed");
+        return NULL;
+    }
+    series->raw = block;
+    series->rollups[SERIES_MINUTE] = (SeriesBucket*)(series->raw + SERIES_RAW_CAPACITY);
+    series->rollups[SERIES_HOUR] = series->rollups[SERIES_MINUTE] + SERIES_MINUTE_CAPACITY;
+    snprintf(series->name, sizeof(series->name), "%s", metric);
+    used++;
+    return series;
+}
+
+/**
+ * @brief Returns the entry at an absolute index of a tier, raw samples as buckets of one.
+ */
+static SeriesBucket entry_at(const Series* series, SeriesTier tier, uint64_t index)
+{
+    if (tier == SERIES_RAW)
+    {
+        const SeriesPoint* point = &series->raw[index % SERIES_RAW_CAPACITY];
+        return (SeriesBucket){point->timestamp_ns, point->value, point->value, point->value, 1};
+    }
+    return series->rollups[tier][index % tier_capacity[tier]];
+}
+
+/**
+ * @brief Returns the absolute index of the oldest entry a tier still holds.
+ */
+static uint64_t oldest_index(const Series* series, SeriesTier tier)
+{
+    uint64_t written = series->written[tier];
+    return written > tier_capacity[tier] ? written - tier_capacity[tier] : 0;
+}
+
+/**
+ * @brief Adds a sample to the newest bucket of a rollup tier, or starts a bucket when its interval is over.
+ */
+static void roll_up(Series* series, SeriesTier tier, uint64_t timestamp_ns, double value)
+{
+    SeriesBucket* ring = series->rollups[tier];
+    uint64_t start = timestamp_ns - timestamp_ns % tier_width[tier];
+    uint64_t written = series->written[tier];
+    SeriesBucket* newest = written ? &ring[(written - 1) % tier_capacity[tier]] : NULL;
+    if (newest && newest->start_ns == start)
+    {
+        newest->min = value < newest->min ? value : newest->min;
+        newest->max = value > newest->max ? value : newest->max;
+        newest->sum += value;
+        newest->count++;
+        return;
+    }
+    ring[written % tier_capacity[tier]] = (SeriesBucket){start, value, value, value, 1};
+    series->written[tier]++;
+}
+
+int series_add(const char* metric, uint64_t timestamp_ns, double value)
+{
+    Series* series = find_series(metric, true);
+    if (series == NULL)
+    {
+        return -1;
+    }
+    uint64_t written = series->written[SERIES_RAW];
+    if (written && timestamp_ns < series->raw[(written - 1) % SERIES_RAW_CAPACITY].timestamp_ns)
+    {
+        return -1; // Buckets already closed cannot take it, and queries rely on the order.
+    }
+    series->raw[written % SERIES_RAW_CAPACITY] = (SeriesPoint){timestamp_ns, value};
+    series->written[SERIES_RAW]++;
+    roll_up(series, SERIES_MINUTE, timestamp_ns, value);
+    roll_up(series, SERIES_HOUR, timestamp_ns, value);
+    return 0;
+}
+
+/**
+ * @brief Tells whether an entry reaches into a range starting at since_ns.
+ */
+static bool reaches(const Series* series, SeriesTier tier, uint64_t index, uint64_t since_ns)
+{
+    SeriesBucket entry = entry_at(series, tier, index);
+    return tier == SERIES_RAW ? entry.start_ns >= since_ns : entry.start_ns + tier_width[tier] > since_ns;
+}
+
+long series_query(const char* metric, uint64_t since_ns, SeriesTier* tier, SeriesBucket* buckets, size_t capacity)
+{
+    const Series* series = find_series(metric, false);
+    if (series == NULL)
+    {
+        return -1;
+    }
+    uint64_t newest = 0;
+    if (series->written[SERIES_RAW])
+    {
+        newest = series->raw[(series->written[SERIES_RAW] - 1) % SERIES_RAW_CAPACITY].timestamp_ns;
+    }
+    uint64_t range = newest > since_ns ? newest - since_ns : 0;
+    SeriesTier chosen = range <= NS_PER_HOUR ? SERIES_RAW : range <= NS_PER_DAY ? SERIES_MINUTE : SERIES_HOUR;
+    // A tier that has dropped entries newer than the start of the range cannot answer it; a coarser one might.
+    while (chosen < SERIES_HOUR && series->written[chosen] > tier_capacity[chosen] &&
+           entry_at(series, chosen, oldest_index(series, chosen)).start_ns > since_ns)
+    {
+        chosen++;
+    }
+    *tier = chosen;
+
+    uint64_t low = oldest_index(series, chosen);
+    uint64_t high = series->written[chosen];
+    while (low < high)
+    {
+        uint64_t middle = low + (high - low) / 2;
+        if (reaches(series, chosen, middle, since_ns))
+        {
+            high = middle;
+        }
+        else
+        {
+            low = middle + 1;
+        }
+    }
+    uint64_t end = series->written[chosen];
+    if (end - low > capacity)
+    {
+        low = end - capacity;
+    }
+    for (uint64_t i = low; i < end; i++)
+    {
+        buckets[i - low] = entry_at(series, chosen, i);
+    }
+    return (long)(end - low);
+}
+
+size_t series_count(void)
+{
+    return used;
+}
+
+const char* series_name(size_t index, uint64_t* samples)
+{
+    *samples = table[index].written[SERIES_RAW];
+    return table[index].name;
+}
+
+void series_clear(void)
+{
+    for (size_t i = 0; i < used; i++)
+    {
+        free(table[i].raw); // The rollup rings share its block.
+    }
+    memset(table, 0, sizeof(table));
+    used = 0;
+}
+
+/**
+ * @brief Returns the address and size of the entry at an absolute index of a tier, as stored.
+ */
+static void* slot_at(const Series* series, SeriesTier tier, uint64_t index, size_t* size)
+{
+    if (tier == SERIES_RAW)
+    {
+        *size = sizeof(SeriesPoint);
+        return &series->raw[index % SERIES_RAW_CAPACITY];
+    }
+    *size = sizeof(SeriesBucket);
+    return &series->rollups[tier][index % tier_capacity[tier]];
+}
+
+int series_save(const char* path)
+{
+    if (path == NULL || *path == '\0')
+    {
+        return 0;
+    }
+    char temp_path[PATH_MAX + 8];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+    FILE* file = fopen(temp_path, "wbe");
+    if (file == NULL)
+    {
+        perror("fopen");
+        return -1;
+    }
+    SeriesFileHeader header = {.version = SERIES_FILE_VERSION, .count = (uint32_t)used};
+    memcpy(header.magic, SERIES_FILE_MAGIC, sizeof(header.magic));
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (size_t i = 0; ok && i < used; i++)
+    {
+        const Series* series = &table[i];
+        SeriesFileEntry entry = {0};
+        memcpy(entry.name, series->name, sizeof(entry.name));
+        memcpy(entry.written, series->written, sizeof(entry.written));
+        ok = fwrite(&entry, sizeof(entry), 1, file) == 1;
+        for (int tier = 0; ok && tier < SERIES_TIER_COUNT; tier++)
+        {
+            for (uint64_t j = oldest_index(series, tier); ok && j < series->written[tier]; j++)
+            {
+                size_t size;
+                const void* slot = slot_at(series, tier, j, &size);
+                ok = fwrite(slot, size, 1, file) == 1;
+            }
+        }
+    }
+    ok = ok && fflush(file) == 0 && fsync(fileno(file)) == 0;
+    if (!ok)
+    {
+        perror("Failed to write metric history");
+    }
+    if (fclose(file) != 0 || !ok || rename(temp_path, path) == -1)
+    {
+        if (ok)
+        {
+            perror("Failed to save metric history");
+        }
+        unlink(temp_path);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Reads one saved series into a new series of the store.
+ */
+static bool load_series(FILE* file)
+{
+    SeriesFileEntry entry;
+    if (fread(&entry, sizeof(entry), 1, file) != 1 || memchr(entry.name, '\0', sizeof(entry.name)) == NULL ||
+        find_series(entry.name, false) != NULL)
+    {
+        return false;
+    }
+    Series* series = find_series(entry.name, true);
+    if (series == NULL)
+    {
+        return false;
+    }
+    memcpy(series->written, entry.written, sizeof(series->written));
+    for (int tier = 0; tier < SERIES_TIER_COUNT; tier++)
+    {
+        for (uint64_t j = oldest_index(series, tier); j < series->written[tier]; j++)
+        {
+            size_t size;
+            void* slot = slot_at(series, tier, j, &size);
+            if (fread(slot, size, 1, file) != 1)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int series_load(const char* path)
+{
+    if (path == NULL || *path == '\0')
+    {
+        return 0;
+    }
+    FILE* file = fopen(path, "rbe");
+    if (file == NULL)
+    {
+        if (errno == ENOENT)
+        {
+            return 0;
+        }
+        perror("fopen");
+        return -1;
+    }
+    series_clear();
+    SeriesFileHeader header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+              memcmp(header.magic, SERIES_FILE_MAGIC, sizeof(header.magic)) == 0 &&
+              header.version == SERIES_FILE_VERSION && header.count <= SERIES_MAX;
+    for (uint32_t i = 0; ok && i < header.count; i++)
+    {
+        ok = load_series(file);
+    }
+    fclose(file);
+    if (!ok)
+    {
+        fprintf(stderr, "%s is not a metric history file, ignoring it\n", path);
+        series_clear();
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,301 @@
+/**
+ * @file server.c
+ * @brief Implementation of the shell's command server.
+ */
+#include "server.h"
+#include "event_loop.h"
+#include "execution.h"
+#include "server_protocol.h"
+#include "utils.h"
+#include <poll.h>
+#include <stddef.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define SERVER_BACKLOG 64              /**< Connections the kernel queues while a request runs. */
+#define SERVER_REQUEST_TIMEOUT_MS 1000 /**< How long a connected client may take to send its request. */
+
+static int listen_fd = -1;
+static int terminate_fd = -1;
+static char socket_path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+
+static void handle_connection(int fd, uint32_t events, void* data)
+{
+    server_serve();
+}
+
+static void handle_terminate(int fd, uint32_t events, void* data)
+{
+    struct signalfd_siginfo info;
+    while (read(fd, &info, sizeof(info)) == sizeof(info))
+    {
+    }
+    event_loop_stop();
+}
+
+/**
+ * @brief Fills a socket address, failing if the path does not fit.
+ */
+static int socket_address(const char* path, struct sockaddr_un* address)
+{
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address->sun_path))
+    {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return -1;
+    }
+    memcpy(address->sun_path, path, strlen(path) + 1);
+    return 0;
+}
+
+int server_start(const char* path)
+{
+    struct sockaddr_un address;
+    if (socket_address(path, &address) == -1)
+    {
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+    {
+        perror("socket failed");
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr*)&address, sizeof(address)) == 0)
+    {
+        fprintf(stderr, "A server is already listening on %s\n", path);
+        close(fd);
+        return -1;
+    }
+    struct stat info;
+    if (lstat(path, &info) == 0 && S_ISSOCK(info.st_mode))
+    {
+        unlink(path); // Nobody answers on it, so it was left behind.
+    }
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) == -1 || listen(fd, SERVER_BACKLOG) == -1)
+    {
+        perror("bind failed");
+        close(fd);
+        return -1;
+    }
+    listen_fd = fd;
+    memcpy(socket_path, address.sun_path, sizeof(socket_path));
+    // Children get the default dispositions and an empty mask back before they exec.
+    signal(SIGPIPE, SIG_IGN);
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    if (event_loop_active())
+    {
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigaddset(&mask, SIGTERM);
+        sigprocmask(SIG_BLOCK, &mask, NULL);
+        terminate_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+        // Both are input sources, so neither is handled in the middle of a request.
+        if (terminate_fd == -1 ||
+            event_loop_add(terminate_fd, EPOLLIN, EVENT_LOOP_INPUT, handle_terminate, NULL) == -1 ||
+            event_loop_add(listen_fd, EPOLLIN, EVENT_LOOP_INPUT, handle_connection, NULL) == -1)
+        {
+            server_stop();
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Receives a request and the descriptors passed with it.
+ *
+ * @return 0 on success, -1 if the client sent nothing in time, something else, or the wrong descriptors.
+ */
+static int receive_request(int client, ServerMessage* request, int fds[SERVER_FD_COUNT])
+{
+    struct pollfd pfd = {.fd = client, .events = POLLIN};
+    int ready;
+    while ((ready = poll(&pfd, 1, SERVER_REQUEST_TIMEOUT_MS)) == -1 && errno == EINTR)
+    {
+    }
+    union
+    {
+        char buffer[CMSG_SPACE(sizeof(int) * SERVER_FD_COUNT)];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = {.iov_base = request, .iov_len = sizeof(*request)};
+    struct msghdr message = {
+        .msg_iov = &iov, .msg_iovlen = 1, .msg_control = control.buffer, .msg_controllen = sizeof(control.buffer)};
+    ssize_t received = ready > 0 ? recvmsg(client, &message, MSG_CMSG_CLOEXEC) : -1;
+    size_t count = 0;
+    for (struct cmsghdr* header = received >= 0 ? CMSG_FIRSTHDR(&message) : NULL; header;
+         header = CMSG_NXTHDR(&message, header))
+    {
+        if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS)
+        {
+            size_t passed = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for (size_t i = 0; i < passed; i++)
+            {
+                int fd;
+                memcpy(&fd, CMSG_DATA(header) + i * sizeof(int), sizeof(int));
+                if (count < SERVER_FD_COUNT)
+                {
+                    fds[count++] = fd;
+                }
+                else
+                {
+                    close(fd);
+                }
+            }
+        }
+    }
+    if (received < (ssize_t)offsetof(ServerMessage, payload) || request->type != SERVER_MSG_RUN ||
+        count != SERVER_FD_COUNT || (message.msg_flags & (MSG_TRUNC | MSG_CTRUNC)))
+    {
+        if (received > 0)
+        {
+            fprintf(stderr, "Server: dropped a malformed request\n");
+        }
+        for (size_t i = 0; i < count; i++)
+        {
+            close(fds[i]);
+        }
+        return -1;
+    }
+    request->payload[sizeof(request->payload) - 1] = '\0';
+    if ((ssize_t)sizeof(*request) > received)
+    {
+        request->payload[received - (ssize_t)offsetof(ServerMessage, payload)] = '\0';
+    }
+    return 0;
+}
+
+/**
+ * @brief Runs one line of a request, unless it is 'quit', which only ends the request.
+ *
+ * @return true if the request should stop here.
+ */
+static bool run_request_line(char* line, int* status)
+{
+    const char* word = line + strspn(line, " \t");
+    if (strncmp(word, "quit", 4) == 0 && strchr(" \t", word[4]) != NULL)
+    {
+        return true;
+    }
+    if (clean_and_check_input(line))
+    {
+        *status = execute_line(line);
+    }
+    fflush(stdout);
+    return false;
+}
+
+/**
+ * @brief Runs a request with the client's descriptors as standard input, output and error.
+ */
+static int run_request(ServerMessage* request, const int fds[SERVER_FD_COUNT])
+{
+    int saved[SERVER_FD_COUNT];
+    fflush(stdout);
+    fflush(stderr);
+    for (int i = 0; i < SERVER_FD_COUNT; i++)
+    {
+        saved[i] = fcntl(i, F_DUPFD_CLOEXEC, SERVER_FD_COUNT);
+        dup2(fds[i], i);
+    }
+
+    int status = 0;
+    bool done = false;
+    if (request->payload[0])
+    {
+        char* next = request->payload;
+        while (!done && next)
+        {
+            char* line = next;
+            next = strchr(line, '\n');
+            if (next)
+            {
+                *next++ = '\0';
+            }
+            done = run_request_line(line, &status);
+        }
+    }
+    else
+    {
+        LineReader reader;
+        line_reader_init(&reader, STDIN_FILENO);
+        while (!done)
+        {
+            char* line;
+            while (!done && (line = line_reader_next(&reader)) != NULL)
+            {
+                done = run_request_line(line, &status);
+            }
+            if (done || reader.eof)
+            {
+                break;
+            }
+            line_reader_fill(&reader);
+        }
+        line_reader_free(&reader);
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    for (int i = 0; i < SERVER_FD_COUNT; i++)
+    {
+        if (saved[i] == -1)
+        {
+            close(i);
+            continue;
+        }
+        dup2(saved[i], i);
+        close(saved[i]);
+    }
+    return status;
+}
+
+int server_serve(void)
+{
+    int client = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (client == -1)
+    {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        {
+            perror("accept failed");
+        }
+        return -1;
+    }
+    ServerMessage request;
+    int fds[SERVER_FD_COUNT];
+    if (receive_request(client, &request, fds) == -1)
+    {
+        close(client);
+        return -1;
+    }
+    int status = run_request(&request, fds);
+    for (int i = 0; i < SERVER_FD_COUNT; i++)
+    {
+        close(fds[i]);
+    }
+    ServerMessage reply = {.type = SERVER_MSG_STATUS, .value = (uint32_t)status};
+    // The client may be gone already; its commands ran all the same.
+    send(client, &reply, offsetof(ServerMessage, payload) + 1, MSG_NOSIGNAL);
+    close(client);
+    return 0;
+}
+
+void server_stop(void)
+{
+    if (terminate_fd != -1)
+    {
+        event_loop_remove(terminate_fd);
+        close(terminate_fd);
+        terminate_fd = -1;
+    }
+    if (listen_fd != -1)
+    {
+        event_loop_remove(listen_fd);
+        close(listen_fd);
+        listen_fd = -1;
+        unlink(socket_path);
+    }
+}
@@ -0,0 +1,231 @@
+/**
+ * @file spawner.c
+ * @brief Implementation of the process spawning layer.
+ */
+#include "spawner.h"
+#include "command_hash.h"
+#include "placement.h"
+#include "stats.h"
+#include "utils.h"
+#include <spawn.h>
+
+void spawn_options_init(SpawnOptions* options)
+{
+    options->stdin_fd = -1;
+    options->stdout_fd = -1;
+    options->input_file = NULL;
+    options->output_file = NULL;
+    options->append_output = false;
+    options->error_file = NULL;
+    options->pgid = -1;
+    options->placement = NULL;
+}
+
+/**
+ * @brief Checks an argument vector against the kernel's limits, so an oversized command gets a clear error
+ * instead of a bare E2BIG from exec.
+ *
+ * Linux refuses a single string longer than 32 pages, and argv plus the environment, strings and pointers
+ * together, larger than ARG_MAX.
+ */
+static bool arguments_fit(char* const argv[])
+{
+    long page_size = sysconf(_SC_PAGESIZE);
+    size_t max_string = (size_t)(page_size > 0 ? page_size : 4096) * 32;
+    long arg_max = sysconf(_SC_ARG_MAX);
+    size_t total = 0;
+    for (char* const* env = environ; *env; env++)
+    {
+        total += strlen(*env) + 1 + sizeof(char*);
+    }
+    size_t argc = 0;
+    for (; argv[argc]; argc++)
+    {
+        size_t length = strlen(argv[argc]) + 1;
+        if (length > max_string)
+        {
+            fprintf(stderr, "%s: argument %zu is too long (%zu bytes, limit %zu)\n", argv[0], argc, length, max_string);
+            return false;
+        }
+        total += length + sizeof(char*);
+    }
+    if (arg_max > 0 && total > (size_t)arg_max)
+    {
+        fprintf(stderr, "%s: argument list too long (%zu arguments, %zu bytes with the environment, limit %ld)\n",
+                argv[0], argc, total, arg_max);
+        return false;
+    }
+    return true;
+}
+
+static int output_flags(const SpawnOptions* options)
+{
+    return O_WRONLY | O_CREAT | (options->append_output ? O_APPEND : O_TRUNC);
+}
+
+pid_t spawn_command(char* const argv[], const SpawnOptions* options)
+{
+    if (options->placement)
+    {
+        return fork_command(argv, options);
+    }
+    STATS_START(start);
+    const char* path = command_hash_lookup(argv[0]);
+    if (path == NULL)
+    {
+        fprintf(stderr, "%s: command not found\n", argv[0]);
+        return -1;
+    }
+    if (!arguments_fit(argv))
+    {
+        return -1;
+    }
+    // Anything the shell printed so far must reach the stream before the child's output does.
+    fflush(stdout);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawnattr_init(&attr);
+
+    STATS_START(redirect_start);
+    if (options->stdin_fd != -1)
+    {
+        posix_spawn_file_actions_adddup2(&actions, options->stdin_fd, STDIN_FILENO);
+    }
+    if (options->stdout_fd != -1)
+    {
+        posix_spawn_file_actions_adddup2(&actions, options->stdout_fd, STDOUT_FILENO);
+    }
+    if (options->input_file)
+    {
+        posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, options->input_file, O_RDONLY, 0);
+    }
+    if (options->output_file)
+    {
+        posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, options->output_file, output_flags(options), 0644);
+    }
+    if (options->error_file)
+    {
+        posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, options->error_file,
+                                         O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    STATS_STOP(STATS_REDIRECT, redirect_start);
+
+    short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+    sigset_t signals;
+    sigemptyset(&signals);
+    posix_spawnattr_setsigmask(&attr, &signals);
+    job_control_signals(&signals);
+    posix_spawnattr_setsigdefault(&attr, &signals);
+    if (options->pgid >= 0)
+    {
+        flags |= POSIX_SPAWN_SETPGROUP;
+        posix_spawnattr_setpgroup(&attr, options->pgid);
+    }
+    posix_spawnattr_setflags(&attr, flags);
+
+    pid_t pid;
+    int error = posix_spawn(&pid, path, &actions, &attr, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    if (error != 0)
+    {
+        fprintf(stderr, "%s: %s\n", argv[0], strerror(error));
+        return -1;
+    }
+    STATS_COUNT(STATS_SPAWNS);
+    STATS_COUNT(STATS_EXECS);
+    STATS_STOP(STATS_SPAWN, start);
+    return pid;
+}
+
+pid_t fork_command(char* const argv[], const SpawnOptions* options)
+{
+    STATS_START(start);
+    const char* path = command_hash_lookup(argv[0]);
+    if (path == NULL)
+    {
+        fprintf(stderr, "%s: command not found\n", argv[0]);
+        return -1;
+    }
+    if (!arguments_fit(argv))
+    {
+        return -1;
+    }
+    fflush(stdout);
+
+    pid_t pid = fork_shell();
+    if (pid != 0)
+    {
+        if (pid < 0)
+        {
+            perror("Fork failed");
+            return pid;
+        }
+        // The exec happens in the child, whose counters are lost, so it is counted here.
+        STATS_COUNT(STATS_EXECS);
+        STATS_STOP(STATS_SPAWN, start);
+        return pid;
+    }
+    reset_signal_mask();
+    if (options->pgid >= 0)
+    {
+        setpgid(0, options->pgid);
+    }
+    if (options->placement && placement_apply(options->placement) == -1)
+    {
+        _exit(EXIT_FAILURE);
+    }
+    if (options->stdin_fd != -1)
+    {
+        dup2(options->stdin_fd, STDIN_FILENO);
+    }
+    if (options->stdout_fd != -1)
+    {
+        dup2(options->stdout_fd, STDOUT_FILENO);
+    }
+    if (options->input_file)
+    {
+        int fd = open(options->input_file, O_RDONLY);
+        if (fd == -1 || dup2(fd, STDIN_FILENO) == -1)
+        {
+            perror("Input file open failed");
+            _exit(EXIT_FAILURE);
+        }
+        close(fd);
+    }
+    if (options->output_file)
+    {
+        int fd = open(options->output_file, output_flags(options), 0644);
+        if (fd == -1 || dup2(fd, STDOUT_FILENO) == -1)
+        {
+            perror("Output file open failed");
+            _exit(EXIT_FAILURE);
+        }
+        close(fd);
+    }
+    if (options->error_file)
+    {
+        int fd = open(options->error_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd == -1 || dup2(fd, STDERR_FILENO) == -1)
+        {
+            perror("Error file open failed");
+            _exit(EXIT_FAILURE);
+        }
+        close(fd);
+    }
+    execv(path, argv);
+    perror("execv failed");
+    _exit(EXIT_FAILURE);
+}
+
+pid_t fork_shell(void)
+{
+    pid_t pid = fork();
+    if (pid > 0)
+    {
+        STATS_COUNT(STATS_FORKS);
+    }
+    return pid;
+}
@@ -0,0 +1,172 @@
+/**
+ * @file stats.c
+ * @brief Implementation of the shell's latency histograms and counters.
+ */
+#include "stats.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * @struct Histogram
+ * @brief Log-linear histogram of durations in nanoseconds.
+ */
+typedef struct
+{
+    uint64_t buckets[STATS_BUCKETS]; /**< Number of durations per bucket. */
+    uint64_t samples;                /**< Number of durations recorded. */
+    uint64_t total;                  /**< Sum of the durations, for the mean. */
+    uint64_t max;                    /**< Longest duration. */
+} Histogram;
+
+static Histogram histograms[STATS_PHASE_COUNT];
+static uint64_t counters[STATS_COUNTER_COUNT];
+
+static const char* const phase_names[STATS_PHASE_COUNT] = {"parse", "builtin", "redirect", "spawn", "job"};
+static const char* const counter_names[STATS_COUNTER_COUNT] = {"forks",        "spawns",        "execs",
+                                                               "path lookups", "path searches", "jobs reaped"};
+
+uint64_t stats_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+/**
+ * @brief Returns the bucket of a duration: exact below STATS_SUB_BUCKETS, then STATS_SUB_BUCKETS per power of two.
+ */
+static size_t bucket_index(uint64_t value)
+{
+    if (value < STATS_SUB_BUCKETS)
+    {
+        return (size_t)value;
+    }
+    int exponent = 63 - __builtin_clzll(value);
+    if (exponent > STATS_MAX_EXPONENT)
+    {
+        return STATS_BUCKETS - 1;
+    }
+    size_t sub = (size_t)(value >> (exponent - STATS_SUB_BUCKET_BITS)) - STATS_SUB_BUCKETS;
+    return (size_t)(exponent - STATS_SUB_BUCKET_BITS + 1) * STATS_SUB_BUCKETS + sub;
+}
+
+/**
+ * @brief Returns the largest duration that falls in a bucket.
+ */
+static uint64_t bucket_upper_bound(size_t index)
+{
+    if (index < STATS_SUB_BUCKETS)
+    {
+        return index;
+    }
+    int shift = (int)(index / STATS_SUB_BUCKETS) - 1;
+    uint64_t lower = (uint64_t)(STATS_SUB_BUCKETS + index % STATS_SUB_BUCKETS) << shift;
+    return lower + ((uint64_t)1 << shift) - 1;
+}
+
+void stats_record(StatsPhase phase, uint64_t nanoseconds)
+{
+    Histogram* histogram = &histograms[phase];
+    histogram->buckets[bucket_index(nanoseconds)]++;
+    histogram->samples++;
+    histogram->total += nanoseconds;
+    if (nanoseconds > histogram->max)
+    {
+        histogram->max = nanoseconds;
+    }
+}
+
+void stats_count(StatsCounter counter)
+{
+    counters[counter]++;
+}
+
+uint64_t stats_counter(StatsCounter counter)
+{
+    return counters[counter];
+}
+
+uint64_t stats_samples(StatsPhase phase)
+{
+    return histograms[phase].samples;
+}
+
+uint64_t stats_percentile(StatsPhase phase, double percentile)
+{
+    const Histogram* histogram = &histograms[phase];
+    if (histogram->samples == 0)
+    {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(percentile / 100.0 * (double)histogram->samples + 0.5);
+    rank = rank == 0 ? 1 : rank;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < STATS_BUCKETS; i++)
+    {
+        seen += histogram->buckets[i];
+        if (seen >= rank)
+        {
+            uint64_t bound = bucket_upper_bound(i);
+            return bound < histogram->max ? bound : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+/**
+ * @brief Formats a duration in nanoseconds with a unit that keeps it short.
+ */
+static const char* format_duration(char* buffer, size_t size, uint64_t nanoseconds)
+{
+    if (nanoseconds < 1000)
+    {
+        snprintf(buffer, size, "%llu ns", (unsigned long long)nanoseconds);
+    }
+    else if (nanoseconds < 1000000)
+    {
+        snprintf(buffer, size, "%.2f us", (double)nanoseconds / 1e3);
+    }
+    else if (nanoseconds < 1000000000)
+    {
+        snprintf(buffer, size, "%.2f ms", (double)nanoseconds / 1e6);
+    }
+    else
+    {
+        snprintf(buffer, size, "%.2f s", (double)nanoseconds / 1e9);
+    }
+    return buffer;
+}
+
+void stats_print(void)
+{
+    if (!STATS_ENABLED)
+    {
+        printf("Statistics were compiled out (SHELL_NO_STATS).\n");
+        return;
+    }
+    printf("%-10s %8s %10s %10s %10s %10s %10s\n", "PHASE", "SAMPLES", "MEAN", "P50", "P90", "P99", "MAX");
+    for (int phase = 0; phase < STATS_PHASE_COUNT; phase++)
+    {
+        const Histogram* histogram = &histograms[phase];
+        char mean[16], p50[16], p90[16], p99[16], max[16];
+        uint64_t average = histogram->samples ? histogram->total / histogram->samples : 0;
+        printf("%-10s %8llu %10s %10s %10s %10s %10s\n", phase_names[phase], (unsigned long long)histogram->samples,
+               format_duration(mean, sizeof(mean), average),
+               format_duration(p50, sizeof(p50), stats_percentile((StatsPhase)phase, 50)),
+               format_duration(p90, sizeof(p90), stats_percentile((StatsPhase)phase, 90)),
+               format_duration(p99, sizeof(p99), stats_percentile((StatsPhase)phase, 99)),
+               format_duration(max, sizeof(max), histogram->max));
+    }
+    printf("\n");
+    for (int counter = 0; counter < STATS_COUNTER_COUNT; counter++)
+    {
+        printf("%-14s %llu\n", counter_names[counter], (unsigned long long)counters[counter]);
+    }
+}
+
+void stats_reset(void)
+{
+    memset(histograms, 0, sizeof(histograms));
+    memset(counters, 0, sizeof(counters));
+}
@@ -1,86 +1,471 @@
 #include "utils.h"
+#include "builtins.h"
+#include "placement.h"
+#include "stats.h"
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/signalfd.h>
 
-void setup_signal_handlers(void)
+#define COPY_CHUNK_SIZE (1 << 20)   /**< Bytes requested per in-kernel copy call. */
+#define COPY_BUFFER_SIZE (1 << 17)  /**< Buffer size of the read/write fallback. */
+
+int setup_signal_handlers(void)
 {
-    struct sigaction sa;
-    sa.sa_handler = handle_signal;
-    sigemptyset(&sa.sa_mask);
-    sa.sa_flags = SA_RESTART;
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTSTP);
+    sigaddset(&mask, SIGQUIT);
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) == -1)
+    {
+        perror("sigprocmask failed");
+        return -1;
+    }
+    int fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd == -1)
+    {
+        perror("signalfd failed");
+    }
+    return fd;
+}
+
+void forward_signal(int sig)
+{
+    if (sig == SIGINT)
+    {
+        interrupt_count++;
+    }
+    if (foreground_pgid > 0)
+    {
+        killpg(foreground_pgid, sig);
+    }
+}
 
-    sigaction(SIGINT, &sa, NULL);
-    sigaction(SIGTSTP, &sa, NULL);
-    sigaction(SIGQUIT, &sa, NULL);
+void job_control_signals(sigset_t* set)
+{
+    sigemptyset(set);
+    sigaddset(set, SIGTTIN);
+    sigaddset(set, SIGTTOU);
 }
 
-void handle_signal(int sig)
+void reset_signal_mask(void)
 {
-    if (foreground_pid > 0)
+    sigset_t signals;
+    job_control_signals(&signals);
+    for (int sig = 1; sig < NSIG; sig++)
     {
-        kill(foreground_pid, sig);
+        if (sigismember(&signals, sig) == 1)
+        {
+            signal(sig, SIG_DFL);
+        }
     }
+    sigemptyset(&signals);
+    sigprocmask(SIG_SETMASK, &signals, NULL);
 }
 
-void parse_input(char* input, ParsedCommand* parsed_cmd)
+int exit_status_from_wait(int status)
 {
-    memset(parsed_cmd, 0, sizeof(ParsedCommand));
-    parsed_cmd->is_background = (input[strlen(input) - 1] == '&');
-    if (parsed_cmd->is_background)
+    if (WIFEXITED(status))
     {
-        input[strlen(input) - 1] = '\0';
+        return WEXITSTATUS(status);
     }
-    char* input_redirect = strchr(input, '<');
-    char* output_redirect = strchr(input, '>');
-    if (input_redirect)
+    if (WIFSIGNALED(status))
     {
-        *input_redirect = '\0';
-        parsed_cmd->input_file = strtok(input_redirect + 1, " \t");
+        return 128 + WTERMSIG(status);
     }
-    if (output_redirect)
+    if (WIFSTOPPED(status))
     {
-        *output_redirect = '\0';
-        parsed_cmd->output_file = strtok(output_redirect + 1, " \t");
+        return 128 + WSTOPSIG(status);
     }
-    char* token = strtok(input, "|");
-    int num_commands = 0;
-    while (token && num_commands < MAX_PIPES)
+    return EXIT_FAILURE;
+}
+
+/**
+ * @brief Kinds of tokens produced by the lexer.
+ */
+typedef enum
+{
+    TOKEN_WORD,      /**< A word, with quoting already removed. */
+    TOKEN_PIPE,      /**< '|' */
+    TOKEN_INPUT,     /**< '<' */
+    TOKEN_OUTPUT,    /**< '>' */
+    TOKEN_APPEND,    /**< '>>' */
+    TOKEN_ERROR,     /**< '2>' */
+    TOKEN_BACKGROUND /**< '&' */
+} TokenType;
+
+/**
+ * @struct Token
+ * @brief A lexical token of the command line.
+ */
+typedef struct
+{
+    TokenType type; /**< Token kind. */
+    char* text;     /**< Word text, NULL for operators. */
+} Token;
+
+static Arena line_arena; /**< Arena backing parse_input; a zeroed Arena is a valid empty one. */
+
+static const char* token_name(const Token* token)
+{
+    switch (token->type)
     {
-        parsed_cmd->pipes[num_commands++] = strdup(token);
-        token = strtok(NULL, "|");
+    case TOKEN_PIPE:
+        return "|";
+    case TOKEN_INPUT:
+        return "<";
+    case TOKEN_OUTPUT:
+        return ">";
+    case TOKEN_APPEND:
+        return ">>";
+    case TOKEN_ERROR:
+        return "2>";
+    case TOKEN_BACKGROUND:
+        return "&";
+    default:
+        return token->text;
     }
-    parsed_cmd->is_piped = (num_commands > 1);
-    parsed_cmd->num_pipes = num_commands - 1;
-    if (parsed_cmd->is_piped)
+}
+
+/**
+ * @brief Splits a line into tokens in a single pass, removing quotes and escapes from words.
+ *
+ * Word text is written into one arena buffer as large as the line, which always fits since every word
+ * is followed by an operator, a blank or the end of the line.
+ */
+static Token* tokenize(Arena* arena, const char* input, size_t* num_tokens)
+{
+    size_t capacity = 16;
+    size_t count = 0;
+    Token* tokens = arena_alloc(arena, capacity * sizeof(Token));
+    char* out = arena_alloc(arena, strlen(input) + 1);
+    if (tokens == NULL || out == NULL)
     {
-        return;
+        return NULL;
     }
-    parsed_cmd->command = parsed_cmd->pipes[0];
-    int i = 0;
-    token = strtok(parsed_cmd->pipes[0], " ");
-    while (token && i < MAX_ARGS - 1)
+    const char* p = input;
+    while (1)
     {
-        parsed_cmd->args[i++] = token;
-        token = strtok(NULL, " ");
+        while (*p == ' ' || *p == '\t')
+        {
+            p++;
+        }
+        if (*p == '\0')
+        {
+            break;
+        }
+        if (count == capacity)
+        {
+            Token* grown = arena_alloc(arena, 2 * capacity * sizeof(Token));
+            if (grown == NULL)
+            {
+                return NULL;
+            }
+            memcpy(grown, tokens, count * sizeof(Token));
+            tokens = grown;
+            capacity *= 2;
+        }
+        Token* token = &tokens[count++];
+        token->text = NULL;
+        switch (*p)
+        {
+        case '|':
+            token->type = TOKEN_PIPE;
+            p++;
+            continue;
+        case '<':
+            token->type = TOKEN_INPUT;
+            p++;
+            continue;
+        case '>':
+            token->type = p[1] == '>' ? TOKEN_APPEND : TOKEN_OUTPUT;
+            p += token->type == TOKEN_APPEND ? 2 : 1;
+            continue;
+        case '2':
+            if (p[1] == '>')
+            {
+                token->type = TOKEN_ERROR;
+                p += 2;
+                continue;
+            }
+            break;
+        case '&':
+            token->type = TOKEN_BACKGROUND;
+            p++;
+            continue;
+        default:
+            break;
+        }
+
+        token->type = TOKEN_WORD;
+        token->text = out;
+        while (*p && !strchr(" \t|<>&", *p))
+        {
+            if (*p == '\'')
+            {
+                const char* end = strchr(p + 1, '\'');
+                if (end == NULL)
+                {
+                    fprintf(stderr, "syntax error: unterminated quote\n");
+                    return NULL;
+                }
+                memcpy(out, p + 1, (size_t)(end - p - 1));
+                out += end - p - 1;
+                p = end + 1;
+            }
+            else if (*p == '"')
+            {
+                p++;
+                while (*p && *p != '"')
+                {
+                    if (*p == '\\' && p[1] && strchr("\"\\$`", p[1]))
+                    {
+                        p++;
+                    }
+                    *out++ = *p++;
+                }
+                if (*p != '"')
+                {
+                    fprintf(stderr, "syntax error: unterminated quote\n");
+                    return NULL;
+                }
+                p++;
+            }
+            else if (*p == '\\' && p[1])
+            {
+                *out++ = p[1];
+                p += 2;
+            }
+            else
+            {
+                *out++ = *p++;
+            }
+        }
+        *out++ = '\0';
     }
-    parsed_cmd->args[i] = NULL;
-    parsed_cmd->is_internal = is_internal_command(parsed_cmd->args[0]);
+    *num_tokens = count;
+    return tokens;
 }
 
-int is_internal_command(const char* command)
+/**
+ * @brief Fills one pipeline stage from the tokens up to the next '|'.
+ *
+ * @return The index of the first token after the stage, or -1 on a syntax error.
+ */
+static long parse_stage(Arena* arena, const Token* tokens, size_t num_tokens, size_t start, CommandStage* stage)
+{
+    size_t end = start;
+    int argc = 0;
+    while (end < num_tokens && tokens[end].type != TOKEN_PIPE && tokens[end].type != TOKEN_BACKGROUND)
+    {
+        if (tokens[end].type == TOKEN_WORD)
+        {
+            argc++;
+            end++;
+            continue;
+        }
+        if (end + 1 >= num_tokens || tokens[end + 1].type != TOKEN_WORD)
+        {
+            fprintf(stderr, "syntax error: missing file name after '%s'\n", token_name(&tokens[end]));
+            return -1;
+        }
+        if (tokens[end].type == TOKEN_INPUT)
+        {
+            stage->input_file = tokens[end + 1].text;
+        }
+        else if (tokens[end].type == TOKEN_ERROR)
+        {
+            stage->error_file = tokens[end + 1].text;
+        }
+        else
+        {
+            stage->output_file = tokens[end + 1].text;
+            stage->append_output = tokens[end].type == TOKEN_APPEND;
+        }
+        end += 2;
+    }
+    if (argc == 0)
+    {
+        const char* near = end < num_tokens ? token_name(&tokens[end]) : "newline";
+        fprintf(stderr, "syntax error near unexpected token '%s'\n", near);
+        return -1;
+    }
+
+    stage->args = arena_alloc(arena, (size_t)(argc + 1) * sizeof(char*));
+    if (stage->args == NULL)
+    {
+        return -1;
+    }
+    stage->argc = 0;
+    for (size_t i = start; i < end; i++)
+    {
+        if (tokens[i].type == TOKEN_WORD)
+        {
+            stage->args[stage->argc++] = tokens[i].text;
+        }
+        else
+        {
+            i++;
+        }
+    }
+    stage->args[argc] = NULL;
+    const CommandHandler* builtin = find_builtin(stage->args[0]);
+    stage->builtin = builtin ? builtin->handler : NULL;
+    stage->pipe_mode = builtin ? builtin->pipe_mode : BUILTIN_PIPE_FORKED;
+    stage->is_internal = builtin != NULL;
+    return (long)end;
+}
+
+int parse_input(const char* input, ParsedCommand* parsed_cmd)
 {
-    const char* internal_commands[] = {"cd",          "echo",          "clr",          "quit",           "set_interval",
-                                       "set_metrics", "start_monitor", "stop_monitor", "status_monitor", "man",
-                                       NULL};
+    STATS_START(start);
+    int result = parse_command_line(input, parsed_cmd, &line_arena);
+    STATS_STOP(STATS_PARSE, start);
+    return result;
+}
+
+int parse_command_line(const char* input, ParsedCommand* parsed_cmd, Arena* arena)
+{
+    memset(parsed_cmd, 0, sizeof(ParsedCommand));
+    parsed_cmd->arena = arena;
+
+    size_t num_tokens = 0;
+    Token* tokens = tokenize(arena, input, &num_tokens);
+    if (tokens == NULL || num_tokens == 0)
+    {
+        return -1;
+    }
+    if (tokens[num_tokens - 1].type == TOKEN_BACKGROUND)
+    {
+        parsed_cmd->is_background = 1;
+        num_tokens--;
+    }
+    // Only leading keywords, so "echo time" is left alone; the job keeps the prefixes in its text.
+    while (num_tokens > 1 && tokens[0].type == TOKEN_WORD)
+    {
+        if (strcmp(tokens[0].text, "time") == 0 && !parsed_cmd->is_timed)
+        {
+            parsed_cmd->is_timed = 1;
+            tokens++;
+            num_tokens--;
+        }
+        else if (strcmp(tokens[0].text, "prio") == 0 && !parsed_cmd->has_priority && num_tokens > 2 &&
+                 tokens[1].type == TOKEN_WORD)
+        {
+            char* end;
+            long nice = strtol(tokens[1].text, &end, 10);
+            if (*end != '\0' || end == tokens[1].text || nice < -20 || nice > 19)
+            {
+                fprintf(stderr, "prio: %s: nice value must be between -20 and 19\n", tokens[1].text);
+                return -1;
+            }
+            parsed_cmd->has_priority = 1;
+            parsed_cmd->priority = (int)nice;
+            tokens += 2;
+            num_tokens -= 2;
+        }
+        else if (strcmp(tokens[0].text, "pin") == 0 && parsed_cmd->placement == NULL && num_tokens > 2 &&
+                 tokens[1].type == TOKEN_WORD)
+        {
+            Placement* placement = arena_alloc(arena, sizeof(Placement));
+            if (placement == NULL || placement_parse(tokens[1].text, placement) == -1)
+            {
+                return -1;
+            }
+            parsed_cmd->placement = placement;
+            tokens += 2;
+            num_tokens -= 2;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    int num_stages = 1;
+    for (size_t i = 0; i < num_tokens; i++)
+    {
+        if (tokens[i].type == TOKEN_PIPE)
+        {
+            num_stages++;
+        }
+    }
+    parsed_cmd->stages = arena_alloc(arena, (size_t)num_stages * sizeof(CommandStage));
+    if (parsed_cmd->stages == NULL)
+    {
+        return -1;
+    }
+    memset(parsed_cmd->stages, 0, (size_t)num_stages * sizeof(CommandStage));
+
+    size_t next = 0;
+    for (int i = 0; i < num_stages; i++)
+    {
+        long end = parse_stage(arena, tokens, num_tokens, next, &parsed_cmd->stages[i]);
+        if (end < 0)
+        {
+            return -1;
+        }
+        if ((size_t)end < num_tokens && tokens[end].type == TOKEN_BACKGROUND)
+        {
+            fprintf(stderr, "syntax error near unexpected token '&'\n");
+            return -1;
+        }
+        if (num_stages > 1 && parsed_cmd->stages[i].builtin && parsed_cmd->stages[i].pipe_mode == BUILTIN_PIPE_REFUSED)
+        {
+            fprintf(stderr, "%s: cannot be used in a pipeline\n", parsed_cmd->stages[i].args[0]);
+            return -1;
+        }
+        next = (size_t)end + 1;
+    }
 
-    for (int i = 0; internal_commands[i] != NULL; i++)
+    // Keep the line as typed for job listings, minus surrounding blanks and the '&'.
+    const char* text_start = input + strspn(input, " \t");
+    const char* text_end = text_start + strlen(text_start);
+    while (text_end > text_start && strchr(" \t", text_end[-1]))
     {
-        if (strcmp(command, internal_commands[i]) == 0)
+        text_end--;
+    }
+    if (parsed_cmd->is_background)
+    {
+        text_end--;
+        while (text_end > text_start && strchr(" \t", text_end[-1]))
         {
-            return 1;
+            text_end--;
         }
     }
+    parsed_cmd->text = arena_strndup(arena, text_start, (size_t)(text_end - text_start));
+
+    CommandStage* first = &parsed_cmd->stages[0];
+    parsed_cmd->num_pipes = num_stages - 1;
+    parsed_cmd->is_piped = (num_stages > 1);
+    parsed_cmd->command = first->args[0];
+    parsed_cmd->args = first->args;
+    parsed_cmd->input_file = first->input_file;
+    parsed_cmd->output_file = parsed_cmd->stages[parsed_cmd->num_pipes].output_file;
+    parsed_cmd->append_output = parsed_cmd->stages[parsed_cmd->num_pipes].append_output;
+    parsed_cmd->error_file = first->error_file;
+    parsed_cmd->is_internal = !parsed_cmd->is_piped && first->is_internal;
+    parsed_cmd->builtin = parsed_cmd->is_internal ? first->builtin : NULL;
     return 0;
 }
 
+int is_internal_command(const char* command)
+{
+    return find_builtin(command) != NULL;
+}
+
+uint32_t hash_string(const char* str)
+{
+    uint32_t hash = 2166136261u;
+    for (const unsigned char* p = (const unsigned char*)str; *p; p++)
+    {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
 int create_fifo(const char* path, mode_t mode)
 {
     if (mkfifo(path, mode) == -1)
@@ -94,6 +479,111 @@ int create_fifo(const char* path, mode_t mode)
     return 0;
 }
 
+/**
+ * @brief In-kernel copy primitives, in the order copy_fd tries them.
+ */
+typedef enum
+{
+    COPY_SPLICE,
+    COPY_FILE_RANGE,
+    COPY_SENDFILE
+} CopyMethod;
+
+static ssize_t copy_chunk(CopyMethod method, int in_fd, int out_fd)
+{
+    switch (method)
+    {
+    case COPY_SPLICE:
+        return splice(in_fd, NULL, out_fd, NULL, COPY_CHUNK_SIZE, SPLICE_F_MOVE);
+    case COPY_FILE_RANGE:
+        return copy_file_range(in_fd, NULL, out_fd, NULL, COPY_CHUNK_SIZE, 0);
+    default:
+        return sendfile(out_fd, in_fd, NULL, COPY_CHUNK_SIZE);
+    }
+}
+
+ssize_t copy_fd(int in_fd, int out_fd)
+{
+    struct stat in_stat;
+    struct stat out_stat;
+    if (fstat(in_fd, &in_stat) == -1 || fstat(out_fd, &out_stat) == -1)
+    {
+        perror("fstat failed");
+        return -1;
+    }
+    bool appending = (fcntl(out_fd, F_GETFL) & O_APPEND) != 0;
+    CopyMethod methods[3];
+    int num_methods = 0;
+    if (S_ISFIFO(in_stat.st_mode) || S_ISFIFO(out_stat.st_mode))
+    {
+        methods[num_methods++] = COPY_SPLICE;
+    }
+    // Both refuse O_APPEND outputs.
+    if (S_ISREG(in_stat.st_mode) && S_ISREG(out_stat.st_mode) && !appending)
+    {
+        methods[num_methods++] = COPY_FILE_RANGE;
+    }
+    if (S_ISREG(in_stat.st_mode) && !appending)
+    {
+        methods[num_methods++] = COPY_SENDFILE;
+    }
+
+    ssize_t total = 0;
+    for (int i = 0; i < num_methods; i++)
+    {
+        ssize_t bytes;
+        while ((bytes = copy_chunk(methods[i], in_fd, out_fd)) > 0 || (bytes == -1 && errno == EINTR))
+        {
+            total += bytes > 0 ? bytes : 0;
+        }
+        if (bytes == 0)
+        {
+            return total;
+        }
+        // Unsupported pairings fail before moving any data; try the next primitive from the same offsets.
+        if (errno != EINVAL && errno != EXDEV && errno != ENOSYS && errno != EOPNOTSUPP && errno != EBADF)
+        {
+            perror("copy failed");
+            return -1;
+        }
+    }
+
+    char* buffer = malloc(COPY_BUFFER_SIZE);
+    if (buffer == NULL)
+    {
+        perror("malloc failed");
+        return -1;
+    }
+    ssize_t bytes;
+    while ((bytes = read(in_fd, buffer, COPY_BUFFER_SIZE)) != 0)
+    {
+        if (bytes == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("read failed");
+            total = -1;
+            break;
+        }
+        for (ssize_t written = 0; written < bytes;)
+        {
+            ssize_t result = write(out_fd, buffer + written, (size_t)(bytes - written));
+            if (result == -1 && errno != EINTR)
+            {
+                perror("write failed");
+                free(buffer);
+                return -1;
+            }
+            written += result > 0 ? result : 0;
+        }
+        total += bytes;
+    }
+    free(buffer);
+    return total;
+}
+
 void display_prompt(void)
 {
     char cwd[MAX_PATH];
@@ -110,9 +600,9 @@ void display_prompt(void)
 
 void cleanup_parsed_command(ParsedCommand* parsed_cmd)
 {
-    for (int i = 0; i < parsed_cmd->num_pipes + 1; i++)
+    if (parsed_cmd->arena)
     {
-        free(parsed_cmd->pipes[i]);
+        arena_reset(parsed_cmd->arena);
     }
     memset(parsed_cmd, 0, sizeof(ParsedCommand));
 }
@@ -131,6 +621,122 @@ void display_start_screen(void)
     printf("\033[1;31mCaution:\033[0m Ensure you are prepared for your mission before proceeding.\n\n");
 }
 
+void line_reader_init(LineReader* reader, int fd)
+{
+    memset(reader, 0, sizeof(*reader));
+    reader->fd = fd;
+    struct stat info;
+    if (fstat(fd, &info) == -1 || !S_ISREG(info.st_mode) || info.st_size == 0)
+    {
+        return;
+    }
+    // Private and writable, so newlines can be overwritten with NULs; only the pages touched get copied.
+    void* map = mmap(NULL, (size_t)info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        return; // Read it instead.
+    }
+    madvise(map, (size_t)info.st_size, MADV_SEQUENTIAL);
+    reader->buffer = map;
+    reader->length = (size_t)info.st_size;
+    reader->mapped = true;
+    reader->eof = true;
+}
+
+void line_reader_free(LineReader* reader)
+{
+    if (reader->mapped)
+    {
+        munmap(reader->buffer, reader->length);
+    }
+    else
+    {
+        free(reader->buffer);
+    }
+    free(reader->tail);
+    memset(reader, 0, sizeof(*reader));
+    reader->fd = -1;
+}
+
+int line_reader_fill(LineReader* reader)
+{
+    if (reader->mapped)
+    {
+        return 0;
+    }
+    if (reader->start > 0)
+    {
+        memmove(reader->buffer, reader->buffer + reader->start, reader->length - reader->start);
+        reader->length -= reader->start;
+        reader->start = 0;
+    }
+    if (reader->length + 1 >= reader->capacity)
+    {
+        size_t new_capacity = reader->capacity ? reader->capacity * 2 : INPUT_BUFFER_SIZE;
+        char* new_buffer = realloc(reader->buffer, new_capacity);
+        if (new_buffer == NULL)
+        {
+            perror("realloc failed");
+            reader->eof = true;
+            return -1;
+        }
+        reader->buffer = new_buffer;
+        reader->capacity = new_capacity;
+    }
+    ssize_t bytes = read(reader->fd, reader->buffer + reader->length, reader->capacity - 1 - reader->length);
+    if (bytes == -1)
+    {
+        if (errno == EINTR || errno == EAGAIN)
+        {
+            return 0;
+        }
+        perror("read failed");
+        reader->eof = true;
+        return -1;
+    }
+    if (bytes == 0)
+    {
+        reader->eof = true;
+    }
+    reader->length += (size_t)bytes;
+    return (int)bytes;
+}
+
+char* line_reader_next(LineReader* reader)
+{
+    if (reader->buffer == NULL)
+    {
+        return NULL;
+    }
+    char* line = reader->buffer + reader->start;
+    size_t available = reader->length - reader->start;
+    char* newline = memchr(line, '\n', available);
+    if (newline)
+    {
+        *newline = '\0';
+        reader->start += (size_t)(newline - line) + 1;
+        return line;
+    }
+    if (available == 0 || !reader->eof)
+    {
+        return NULL;
+    }
+    // Last line without a newline.
+    reader->start = reader->length;
+    if (!reader->mapped)
+    {
+        line[available] = '\0'; // Reads always leave room for it.
+        return line;
+    }
+    free(reader->tail);
+    reader->tail = strndup(line, available);
+    if (reader->tail == NULL)
+    {
+        perror("strndup failed");
+    }
+    return reader->tail;
+}
+
 bool clean_and_check_input(char* str)
 {
     str[strcspn(str, "\n")] = '\0'; // Remove the newline character
@@ -0,0 +1,127 @@
+/**
+ * @file stub_monitor.c
+ * @brief Stand-in for the monitor that only speaks the control protocol, for tests without the submodule.
+ */
+#include "metrics_shm.h"
+#include "monitor_protocol.h"
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define STUB_FIFO_PATH "/tmp/monitor_fifo" /**< Where the shell queues the initial metric list. */
+
+static void reply(int fd, uint32_t type, const char* payload)
+{
+    MonitorMessage message = {.type = type};
+    snprintf(message.payload, sizeof(message.payload), "%s", payload);
+    send(fd, &message, offsetof(MonitorMessage, payload) + strlen(message.payload) + 1, MSG_NOSIGNAL);
+}
+
+/**
+ * @brief Publishes one synthetic sample per metric: the number of samples taken so far, offset by the id.
+ */
+static void publish_samples(MetricsRing* ring, unsigned long tick)
+{
+    MetricRecord records[METRICS_MAX_NAMES];
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    uint32_t count = ring->num_names;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        records[i].timestamp_ns = (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+        records[i].metric_id = i;
+        records[i].reserved = 0;
+        records[i].value = (double)tick + i;
+    }
+    metrics_ring_publish(ring, records, count);
+}
+
+int main(void)
+{
+    const char* fd_string = getenv(MONITOR_CONTROL_ENV);
+    if (fd_string == NULL)
+    {
+        fprintf(stderr, "stub_monitor: %s is not set\n", MONITOR_CONTROL_ENV);
+        return EXIT_FAILURE;
+    }
+    int fd = atoi(fd_string);
+    unsigned int interval = 1;
+    char metrics[MONITOR_PAYLOAD_SIZE] = "";
+    unsigned long requests = 0;
+    unsigned long ticks = 0;
+
+    const char* ring_fd_string = getenv(METRICS_SHM_ENV);
+    MetricsRing* ring = ring_fd_string ? metrics_ring_attach(atoi(ring_fd_string)) : NULL;
+    int fifo_fd = open(STUB_FIFO_PATH, O_RDONLY | O_NONBLOCK);
+    if (fifo_fd != -1)
+    {
+        ssize_t length = read(fifo_fd, metrics, sizeof(metrics) - 1);
+        metrics[length > 0 ? length : 0] = '\0';
+        close(fifo_fd);
+    }
+    if (ring)
+    {
+        metrics_ring_set_names(ring, metrics);
+    }
+
+    MonitorMessage message;
+    ssize_t received;
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+    while (1)
+    {
+        int ready = poll(&pfd, 1, (int)interval * 1000);
+        if (ready == 0)
+        {
+            if (ring)
+            {
+                publish_samples(ring, ++ticks);
+            }
+            continue;
+        }
+        if (ready == -1 || (received = recv(fd, &message, sizeof(message), 0)) <= 0)
+        {
+            break;
+        }
+        message.payload[sizeof(message.payload) - 1] = '\0';
+        requests++;
+        switch (message.type)
+        {
+        case MONITOR_MSG_SET_INTERVAL:
+            if (message.value == 0)
+            {
+                reply(fd, MONITOR_MSG_ERROR, "interval must be positive");
+                break;
+            }
+            interval = message.value;
+            reply(fd, MONITOR_MSG_ACK, "");
+            break;
+        case MONITOR_MSG_SET_METRICS:
+            snprintf(metrics, sizeof(metrics), "%s", message.payload);
+            if (ring)
+            {
+                metrics_ring_set_names(ring, metrics);
+            }
+            reply(fd, MONITOR_MSG_ACK, "");
+            break;
+        case MONITOR_MSG_SNAPSHOT: {
+            char snapshot[MONITOR_PAYLOAD_SIZE];
+            snprintf(snapshot, sizeof(snapshot), "interval: %u\nmetrics: %.4000s\nrequests: %lu\n", interval, metrics,
+                     requests);
+            reply(fd, MONITOR_MSG_SNAPSHOT, snapshot);
+            break;
+        }
+        case MONITOR_MSG_STOP:
+            reply(fd, MONITOR_MSG_ACK, "");
+            return EXIT_SUCCESS;
+        default:
+            reply(fd, MONITOR_MSG_ERROR, "unknown request");
+            break;
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -1,6 +1,23 @@
+#include "batch.h"
+#include "builtins.h"
+#include "command_hash.h"
+#include "config.h"
 #include "execution.h"
 #include "jobs.h"
+#include "metrics_shm.h"
+#include "monitor.h"
+#include "placement.h"
+#include "sampler.h"
+#include "scheduler.h"
+#include "series.h"
+#include "server.h"
+#include "server_protocol.h"
+#include "spawner.h"
+#include "stats.h"
 #include "utils.h"
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <unity/unity.h>
 #define TEST_BUFFER 256
 
@@ -23,6 +40,143 @@ void test_add_job(void)
     TEST_ASSERT_EQUAL_STRING(command, jobs[0].command);
 }
 
+void test_job_table_reuses_slots(void)
+{
+    pid_t pipeline[] = {4001, 4002, 4003};
+    Job* first = create_job(pipeline, 3, "a | b | c", true);
+    TEST_ASSERT_NOT_NULL(first);
+    int first_id = first->job_id;
+    TEST_ASSERT_EQUAL_PTR(first, find_job_by_pid(4002));
+
+    Job* second = add_job(4100, "a | b | c");
+    TEST_ASSERT_EQUAL_PTR(first->command, second->command);
+
+    remove_job(first);
+    TEST_ASSERT_NULL(find_job_by_pid(4002));
+    Job* third = add_job(4200, "d");
+    TEST_ASSERT_EQUAL_INT(first_id, third->job_id);
+    remove_job(third);
+    remove_job(find_job_by_pid(4100));
+}
+
+void test_job_stop_and_continue(void)
+{
+    char* argv[] = {"sleep", "5", NULL};
+    SpawnOptions options;
+    spawn_options_init(&options);
+    options.pgid = 0;
+    pid_t pid = spawn_command(argv, &options);
+    TEST_ASSERT_TRUE(pid > 0);
+    Job* job = create_job(&pid, 1, "sleep 5", false);
+    TEST_ASSERT_NOT_NULL(job);
+    TEST_ASSERT_EQUAL_INT(pid, job->pgid);
+
+    kill(pid, SIGSTOP);
+    TEST_ASSERT_EQUAL_INT(128 + SIGSTOP, wait_for_job(job));
+    job = find_job("%+");
+    TEST_ASSERT_NOT_NULL(job);
+    TEST_ASSERT_EQUAL_INT(JOB_STOPPED, job->state);
+    TEST_ASSERT_TRUE(job->is_background);
+
+    continue_job_in_background(job);
+    TEST_ASSERT_EQUAL_INT(JOB_RUNNING, job->state);
+    TEST_ASSERT_EQUAL_INT(0, signal_job(job, SIGTERM));
+    TEST_ASSERT_EQUAL_INT(128 + SIGTERM, wait_for_job(job));
+}
+
+void test_timed_job_usage(void)
+{
+    ParsedCommand cmd;
+    char input[] = "time sh -c 'i=0; while [ $i -lt 20000 ]; do i=$((i+1)); done'";
+    TEST_ASSERT_EQUAL_INT(0, parse_input(input, &cmd));
+    TEST_ASSERT_TRUE(cmd.is_timed);
+    TEST_ASSERT_EQUAL_STRING("sh", cmd.args[0]);
+
+    SpawnOptions options;
+    spawn_options_init(&options);
+    pid_t pid = spawn_command(cmd.args, &options);
+    TEST_ASSERT_TRUE(pid > 0);
+    Job* job = create_job(&pid, 1, cmd.text, false);
+    TEST_ASSERT_NOT_NULL(job);
+    JobUsage usage;
+    TEST_ASSERT_EQUAL_INT(0, run_job_in_foreground(job, false, &usage));
+    TEST_ASSERT_TRUE(usage.wall_seconds > 0);
+    TEST_ASSERT_TRUE(usage.user_seconds + usage.system_seconds > 0);
+    TEST_ASSERT_TRUE(usage.max_rss_kb > 0);
+    TEST_ASSERT_TRUE(usage.minor_faults > 0);
+    cleanup_parsed_command(&cmd);
+}
+
+void test_stats_histogram_percentiles(void)
+{
+    stats_reset();
+    for (uint64_t i = 1; i <= 1000; i++)
+    {
+        stats_record(STATS_SPAWN, i * 1000);
+    }
+    TEST_ASSERT_EQUAL_UINT64(1000, stats_samples(STATS_SPAWN));
+    // Buckets are 1/16 of a power of two wide, so percentiles stay within about 6% of the exact value.
+    uint64_t p50 = stats_percentile(STATS_SPAWN, 50);
+    uint64_t p99 = stats_percentile(STATS_SPAWN, 99);
+    TEST_ASSERT_TRUE(p50 >= 500000 && p50 <= 532000);
+    TEST_ASSERT_TRUE(p99 >= 990000 && p99 <= 1000000);
+    TEST_ASSERT_EQUAL_UINT64(1000000, stats_percentile(STATS_SPAWN, 100));
+
+    ParsedCommand cmd;
+    uint64_t parses = stats_samples(STATS_PARSE);
+    TEST_ASSERT_EQUAL_INT(0, parse_input("echo probe", &cmd));
+    cleanup_parsed_command(&cmd);
+    TEST_ASSERT_EQUAL_UINT64(parses + STATS_ENABLED, stats_samples(STATS_PARSE));
+}
+
+void test_long_lines_and_argument_limits(void)
+{
+    // A line several times the initial buffer size with thousands of arguments, as generated batch files have.
+    int fds[2];
+    TEST_ASSERT_EQUAL_INT(0, pipe(fds));
+    size_t size = 3000 * 8 + 16;
+    char* text = malloc(size);
+    TEST_ASSERT_NOT_NULL(text);
+    size_t length = (size_t)snprintf(text, size, "echo");
+    for (int i = 0; i < 3000; i++)
+    {
+        length += (size_t)snprintf(text + length, size - length, " f%04d", i);
+    }
+    text[length++] = '\n';
+    TEST_ASSERT_EQUAL_INT((int)length, (int)write(fds[1], text, length));
+    close(fds[1]);
+
+    LineReader reader;
+    line_reader_init(&reader, fds[0]);
+    char* line = NULL;
+    while (line == NULL && line_reader_fill(&reader) > 0)
+    {
+        line = line_reader_next(&reader);
+    }
+    TEST_ASSERT_NOT_NULL(line);
+    TEST_ASSERT_EQUAL_size_t(length - 1, strlen(line));
+    ParsedCommand cmd;
+    TEST_ASSERT_EQUAL_INT(0, parse_input(line, &cmd));
+    TEST_ASSERT_EQUAL_STRING("f2999", cmd.args[3000]);
+    TEST_ASSERT_NULL(cmd.args[3001]);
+    cleanup_parsed_command(&cmd);
+    line_reader_free(&reader);
+    close(fds[0]);
+
+    // A single argument over the kernel's per-string limit is refused before anything is started.
+    size_t huge_size = (size_t)sysconf(_SC_PAGESIZE) * 32 + 2;
+    char* huge = malloc(huge_size);
+    TEST_ASSERT_NOT_NULL(huge);
+    memset(huge, 'x', huge_size - 1);
+    huge[huge_size - 1] = '\0';
+    char* argv[] = {"/bin/true", huge, NULL};
+    SpawnOptions options;
+    spawn_options_init(&options);
+    TEST_ASSERT_EQUAL_INT(-1, spawn_command(argv, &options));
+    free(huge);
+    free(text);
+}
+
 void test_parse_input(void)
 {
     ParsedCommand cmd;
@@ -35,10 +189,155 @@ void test_parse_input(void)
     TEST_ASSERT_NULL(cmd.args[3]);
 }
 
+void test_parse_input_quotes_and_stages(void)
+{
+    ParsedCommand cmd;
+    char input[] = "grep 'two words' <in.txt|sort -r >\"out file\" &";
+    TEST_ASSERT_EQUAL_INT(0, parse_input(input, &cmd));
+
+    TEST_ASSERT_EQUAL_INT(1, cmd.is_background);
+    TEST_ASSERT_EQUAL_INT(1, cmd.num_pipes);
+    TEST_ASSERT_EQUAL_STRING("two words", cmd.stages[0].args[1]);
+    TEST_ASSERT_EQUAL_STRING("in.txt", cmd.stages[0].input_file);
+    TEST_ASSERT_EQUAL_STRING("-r", cmd.stages[1].args[1]);
+    TEST_ASSERT_NULL(cmd.stages[1].args[2]);
+    TEST_ASSERT_EQUAL_STRING("out file", cmd.output_file);
+    TEST_ASSERT_EQUAL_STRING("grep 'two words' <in.txt|sort -r >\"out file\"", cmd.text);
+    cleanup_parsed_command(&cmd);
+
+    char unterminated[] = "echo \"oops";
+    TEST_ASSERT_EQUAL_INT(-1, parse_input(unterminated, &cmd));
+    cleanup_parsed_command(&cmd);
+}
+
+void test_builtin_append_and_error_redirection(void)
+{
+    char output_file[] = "append_test_output.txt";
+    char error_file[] = "append_test_error.txt";
+    unlink(output_file);
+    ParsedCommand cmd;
+    for (int i = 0; i < 2; i++)
+    {
+        char input[] = "echo again >> append_test_output.txt 2>append_test_error.txt";
+        TEST_ASSERT_EQUAL_INT(0, parse_input(input, &cmd));
+        TEST_ASSERT_EQUAL_INT(1, cmd.append_output);
+        TEST_ASSERT_EQUAL_STRING(error_file, cmd.error_file);
+        execute_command(&cmd);
+        cleanup_parsed_command(&cmd);
+    }
+
+    char buffer[TEST_BUFFER] = "";
+    int fd = open(output_file, O_RDONLY);
+    TEST_ASSERT_TRUE(fd >= 0);
+    ssize_t length = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+    unlink(output_file);
+    unlink(error_file);
+    TEST_ASSERT_EQUAL_INT(14, length);
+    TEST_ASSERT_EQUAL_STRING("again \nagain \n", buffer);
+}
+
+void test_metrics_ring_publish_and_read(void)
+{
+    int fd;
+    MetricsRing* ring = metrics_ring_create(&fd);
+    TEST_ASSERT_NOT_NULL(ring);
+    MetricsRing* writer = metrics_ring_attach(fd);
+    TEST_ASSERT_NOT_NULL(writer);
+    metrics_ring_set_names(writer, "cpu_usage, memory_usage");
+
+    MetricRecord record = {.timestamp_ns = 1};
+    for (uint32_t i = 0; i < METRICS_RING_CAPACITY + 10; i++)
+    {
+        record.metric_id = i % 2;
+        record.value = i;
+        metrics_ring_publish(writer, &record, 1);
+    }
+
+    MetricsSnapshot snapshot;
+    TEST_ASSERT_EQUAL_INT(0, metrics_ring_snapshot(ring, &snapshot));
+    TEST_ASSERT_EQUAL_INT(2, snapshot.num_names);
+    TEST_ASSERT_EQUAL_STRING("memory_usage", snapshot.names[1]);
+    TEST_ASSERT_EQUAL_INT(METRICS_RING_CAPACITY + 9, (int)snapshot.latest[1].value);
+
+    MetricRecord last[3];
+    TEST_ASSERT_EQUAL_INT(3, metrics_ring_last(ring, last, 3));
+    TEST_ASSERT_EQUAL_INT(METRICS_RING_CAPACITY + 7, (int)last[0].value);
+    TEST_ASSERT_EQUAL_INT(METRICS_RING_CAPACITY + 9, (int)last[2].value);
+
+    // A writer that died mid-write must not hang its readers.
+    atomic_fetch_add(&writer->sequence, 1);
+    TEST_ASSERT_EQUAL_INT(-1, metrics_ring_snapshot(ring, &snapshot));
+    uint64_t cursor = 0;
+    TEST_ASSERT_EQUAL_INT(-1, metrics_ring_since(ring, &cursor, last, 3));
+    TEST_ASSERT_EQUAL_UINT64(0, cursor);
+
+    metrics_ring_unmap(writer);
+    metrics_ring_unmap(ring);
+    close(fd);
+}
+
+void test_config_incremental_atomic_writes(void)
+{
+    const char* path = "/tmp/test_config.json";
+    unlink(path);
+    TEST_ASSERT_EQUAL_INT(0, config_init(path));
+    char* selected[] = {"cpu_usage", "memory_usage"};
+    config_set_interval(7);
+    config_set_metrics(selected, 2);
+    TEST_ASSERT_EQUAL_INT(0, config_flush());
+    TEST_ASSERT_EQUAL_UINT(2, config_version()); // No event loop here, so each change is written at once.
+
+    // Setting the same values again leaves the file alone.
+    config_set_interval(7);
+    config_set_metrics(selected, 2);
+    TEST_ASSERT_EQUAL_INT(0, config_flush());
+    TEST_ASSERT_EQUAL_UINT(2, config_version());
+
+    config_set_metrics(selected + 1, 1);
+    TEST_ASSERT_EQUAL_INT(0, config_flush());
+    TEST_ASSERT_EQUAL_INT(-1, access("/tmp/test_config.json.tmp", F_OK));
+
+    TEST_ASSERT_EQUAL_INT(0, config_init(path));
+    TEST_ASSERT_EQUAL_UINT(3, config_version());
+    cJSON* metrics_array = cJSON_GetObjectItem(root, "metrics");
+    TEST_ASSERT_EQUAL_INT(1, cJSON_GetArraySize(metrics_array));
+    TEST_ASSERT_EQUAL_STRING("memory_usage", cJSON_GetArrayItem(metrics_array, 0)->valuestring);
+    TEST_ASSERT_EQUAL_INT(7, cJSON_GetObjectItem(root, "interval")->valueint);
+    unlink(path);
+}
+
+void test_config_reload_skips_unchanged_files(void)
+{
+    const char* path = "/tmp/test_config.json";
+    FILE* file = fopen(path, "w");
+    TEST_ASSERT_NOT_NULL(file);
+    fputs("{\"interval\": 3, \"version\": 5}\n", file);
+    fclose(file);
+    TEST_ASSERT_EQUAL_INT(0, config_init(path));
+    TEST_ASSERT_EQUAL_INT(0, config_reload());
+
+    // Same contents with a new modification time.
+    struct timespec times[2] = {{.tv_nsec = UTIME_NOW}, {.tv_sec = 1}};
+    TEST_ASSERT_EQUAL_INT(0, utimensat(AT_FDCWD, path, times, 0));
+    TEST_ASSERT_EQUAL_INT(0, config_reload());
+
+    file = fopen(path, "w");
+    TEST_ASSERT_NOT_NULL(file);
+    fputs("{\"interval\": 8, \"version\": 6}\n", file);
+    fclose(file);
+    TEST_ASSERT_EQUAL_INT(1, config_reload());
+    TEST_ASSERT_EQUAL_UINT(6, config_version());
+    TEST_ASSERT_EQUAL_INT(8, cJSON_GetObjectItem(root, "interval")->valueint);
+    TEST_ASSERT_TRUE(config_loaded_at() != 0);
+    unlink(path);
+}
+
 void test_handle_cd_valid_path(void)
 {
     ParsedCommand cmd;
-    cmd.args[1] = "/tmp";
+    char* args[] = {"cd", "/tmp", NULL};
+    cmd.args = args;
 
     handle_cd(&cmd);
 
@@ -58,12 +357,373 @@ void test_execute_command(void)
     TEST_ASSERT_MESSAGE(cmd.is_internal == 0, "Should identify invalid_command as not internal");
 }
 
+void test_spawn_command_output_redirection(void)
+{
+    char output_file[] = "spawn_test_output.txt";
+    char* argv[] = {"echo", "spawned", NULL};
+    SpawnOptions options;
+    spawn_options_init(&options);
+    options.output_file = output_file;
+
+    pid_t pid = spawn_command(argv, &options);
+    TEST_ASSERT_TRUE(pid > 0);
+    waitpid(pid, NULL, 0);
+
+    char buffer[TEST_BUFFER] = "";
+    FILE* file = fopen(output_file, "r");
+    TEST_ASSERT_NOT_NULL(file);
+    TEST_ASSERT_NOT_NULL(fgets(buffer, sizeof(buffer), file));
+    fclose(file);
+    unlink(output_file);
+
+    TEST_ASSERT_EQUAL_STRING("spawned\n", buffer);
+}
+
+void test_builtin_table_resolves_every_entry(void)
+{
+    const char* names[] = {
+#define BUILTIN(name, pipe_mode) #name,
+#include "builtins.def"
+#undef BUILTIN
+    };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+    {
+        const CommandHandler* builtin = find_builtin(names[i]);
+        TEST_ASSERT_NOT_NULL(builtin);
+        TEST_ASSERT_EQUAL_STRING(names[i], builtin->command);
+    }
+    TEST_ASSERT_NULL(find_builtin("ls"));
+    TEST_ASSERT_NULL(find_builtin("cdx"));
+    TEST_ASSERT_NULL(find_builtin(""));
+
+    ParsedCommand cmd;
+    TEST_ASSERT_EQUAL_INT(0, parse_input("cd /tmp", &cmd));
+    TEST_ASSERT_TRUE(cmd.builtin == handle_cd);
+    cleanup_parsed_command(&cmd);
+}
+
+void test_builtin_stage_in_pipeline(void)
+{
+    ParsedCommand cmd;
+    TEST_ASSERT_EQUAL_INT(0, parse_input("echo piped builtin | tr a-z A-Z > pipeline_test_output.txt", &cmd));
+    TEST_ASSERT_EQUAL_INT(0, execute_command(&cmd));
+    cleanup_parsed_command(&cmd);
+
+    char buffer[TEST_BUFFER] = "";
+    FILE* file = fopen("pipeline_test_output.txt", "r");
+    TEST_ASSERT_NOT_NULL(file);
+    TEST_ASSERT_NOT_NULL(fgets(buffer, sizeof(buffer), file));
+    fclose(file);
+    unlink("pipeline_test_output.txt");
+
+    TEST_ASSERT_EQUAL_STRING("PIPED BUILTIN \n", buffer);
+
+    // Builtins that change the shell run in a copy of it when piped.
+    char cwd[PATH_MAX];
+    TEST_ASSERT_NOT_NULL(getcwd(cwd, sizeof(cwd)));
+    TEST_ASSERT_EQUAL_INT(0, parse_input("cd / | cat", &cmd));
+    execute_command(&cmd);
+    cleanup_parsed_command(&cmd);
+    char after[PATH_MAX];
+    TEST_ASSERT_NOT_NULL(getcwd(after, sizeof(after)));
+    TEST_ASSERT_EQUAL_STRING(cwd, after);
+    TEST_ASSERT_EQUAL_INT(-1, parse_input("quit | cat", &cmd));
+    cleanup_parsed_command(&cmd);
+}
+
+void test_command_hash_lookup(void)
+{
+    command_hash_clear();
+    const char* first = command_hash_lookup("sh");
+    TEST_ASSERT_NOT_NULL(first);
+    TEST_ASSERT_EQUAL_INT('/', first[0]);
+
+    const char* second = command_hash_lookup("sh");
+    TEST_ASSERT_EQUAL_PTR(first, second);
+    TEST_ASSERT_EQUAL_STRING("./relative/tool", command_hash_lookup("./relative/tool"));
+    TEST_ASSERT_NULL(command_hash_lookup("surely_not_a_real_command"));
+}
+
+void test_run_batch_parallel_keeps_order(void)
+{
+    char batch_file[] = "batch_test_input.txt";
+    char output_file[] = "batch_test_output.txt";
+    FILE* file = fopen(batch_file, "w");
+    TEST_ASSERT_NOT_NULL(file);
+    fputs("sh -c 'sleep 0.2; echo first'\necho_missing_command\n  barrier \nsh -c 'echo second'\n", file);
+    fputs("quit\nsh -c 'echo never'\n", file);
+    fclose(file);
+
+    int input_fd = open(batch_file, O_RDONLY);
+    int output_fd = open(output_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    TEST_ASSERT_TRUE(input_fd >= 0 && output_fd >= 0);
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    dup2(output_fd, STDOUT_FILENO);
+    int result = run_batch_parallel(input_fd, 4);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+    close(output_fd);
+    close(input_fd);
+
+    char buffer[TEST_BUFFER] = "";
+    file = fopen(output_file, "r");
+    TEST_ASSERT_NOT_NULL(file);
+    size_t length = fread(buffer, 1, sizeof(buffer) - 1, file);
+    buffer[length] = '\0';
+    fclose(file);
+    unlink(batch_file);
+    unlink(output_file);
+
+    TEST_ASSERT_EQUAL_INT(1, result);
+    TEST_ASSERT_EQUAL_STRING("first\necho_missing_command: command not found\nsecond\n", buffer);
+}
+
+void test_monitor_control_channel(void)
+{
+    monitor_path = "./ShellProject_stub_monitor";
+    TEST_ASSERT_EQUAL_INT(0, monitor_start(monitor_path));
+    TEST_ASSERT_TRUE(monitor_running());
+
+    TEST_ASSERT_EQUAL_INT(0, monitor_request(MONITOR_MSG_SET_INTERVAL, 7, NULL, NULL));
+    TEST_ASSERT_EQUAL_INT(-1, monitor_request(MONITOR_MSG_SET_INTERVAL, 0, NULL, NULL));
+    TEST_ASSERT_EQUAL_INT(0, monitor_request(MONITOR_MSG_SET_METRICS, 2, "cpu_usage,memory_usage", NULL));
+    MonitorMessage snapshot;
+    TEST_ASSERT_EQUAL_INT(0, monitor_request(MONITOR_MSG_SNAPSHOT, 0, NULL, &snapshot));
+    TEST_ASSERT_EQUAL_INT(MONITOR_MSG_SNAPSHOT, snapshot.type);
+    TEST_ASSERT_NOT_NULL(strstr(snapshot.payload, "interval: 7\nmetrics: cpu_usage,memory_usage\n"));
+
+    TEST_ASSERT_EQUAL_INT(0, monitor_stop());
+    TEST_ASSERT_FALSE(monitor_running());
+    monitor_path = MONITOR_PATH;
+}
+
+void test_builtin_sampler_fallback(void)
+{
+    TEST_ASSERT_EQUAL_INT(0, monitor_start("./missing_monitor"));
+    TEST_ASSERT_TRUE(monitor_is_builtin());
+    TEST_ASSERT_EQUAL_INT(-1, monitor_request(MONITOR_MSG_SET_METRICS, 1, "no_such_metric", NULL));
+    TEST_ASSERT_EQUAL_INT(0, monitor_request(MONITOR_MSG_SET_METRICS, 3, "cpu_usage, memory_usage, net_rx_kb", NULL));
+    usleep(20000);
+    TEST_ASSERT_EQUAL_INT(3, sampler_sample());
+    TEST_ASSERT_EQUAL_INT(-1, monitor_request(MONITOR_MSG_SET_INTERVAL, SAMPLER_MAX_INTERVAL + 1u, NULL, NULL));
+
+    MetricsSnapshot snapshot;
+    TEST_ASSERT_EQUAL_INT(0, metrics_ring_snapshot(monitor_metrics(), &snapshot));
+    TEST_ASSERT_EQUAL_INT(3, snapshot.num_names);
+    TEST_ASSERT_EQUAL_STRING("memory_usage", snapshot.names[1]);
+    TEST_ASSERT_TRUE(snapshot.latest[1].timestamp_ns != 0);
+    TEST_ASSERT_TRUE(snapshot.latest[1].value > 0 && snapshot.latest[1].value <= 100);
+    MonitorMessage reply;
+    TEST_ASSERT_EQUAL_INT(0, monitor_request(MONITOR_MSG_SNAPSHOT, 0, NULL, &reply));
+    TEST_ASSERT_NOT_NULL(strstr(reply.payload, "net_rx_kb: "));
+
+    TEST_ASSERT_EQUAL_INT(0, monitor_stop());
+    TEST_ASSERT_FALSE(monitor_running());
+}
+
+void test_series_rollups_and_persistence(void)
+{
+    // Two hours at one sample per second, so the raw ring has wrapped and both rollup tiers have buckets.
+    const uint64_t second = 1000000000ull;
+    const uint64_t base = 1699999200ull * second;
+    series_clear();
+    for (uint64_t i = 0; i < 7200; i++)
+    {
+        TEST_ASSERT_EQUAL_INT(0, series_add("cpu_usage", base + i * second, (double)(i % 60)));
+    }
+    TEST_ASSERT_EQUAL_INT(-1, series_add("cpu_usage", base, 1.0));
+
+    static SeriesBucket buckets[SERIES_RAW_CAPACITY];
+    SeriesTier tier;
+    TEST_ASSERT_EQUAL_INT(601, series_query("cpu_usage", base + 6599 * second, &tier, buckets, SERIES_RAW_CAPACITY));
+    TEST_ASSERT_EQUAL_INT(SERIES_RAW, tier);
+    TEST_ASSERT_EQUAL_INT(120, series_query("cpu_usage", base, &tier, buckets, SERIES_RAW_CAPACITY));
+    TEST_ASSERT_EQUAL_INT(SERIES_MINUTE, tier);
+    TEST_ASSERT_EQUAL_INT(60, buckets[0].count);
+    TEST_ASSERT_EQUAL_INT(59, (int)buckets[0].max);
+    TEST_ASSERT_EQUAL_INT(1770, (int)buckets[0].sum);
+    TEST_ASSERT_EQUAL_INT(2, series_query("cpu_usage", 0, &tier, buckets, SERIES_RAW_CAPACITY));
+    TEST_ASSERT_EQUAL_INT(SERIES_HOUR, tier);
+    TEST_ASSERT_EQUAL_INT(3600, buckets[1].count);
+    TEST_ASSERT_EQUAL_INT(-1, series_query("memory_usage", 0, &tier, buckets, SERIES_RAW_CAPACITY));
+
+    const char* path = "/tmp/test_metrics_history";
+    TEST_ASSERT_EQUAL_INT(0, series_save(path));
+    series_clear();
+    TEST_ASSERT_EQUAL_INT(0, series_load(path));
+    TEST_ASSERT_EQUAL_INT(1, series_count());
+    TEST_ASSERT_EQUAL_INT(601, series_query("cpu_usage", base + 6599 * second, &tier, buckets, SERIES_RAW_CAPACITY));
+    TEST_ASSERT_EQUAL_INT(120, series_query("cpu_usage", base, &tier, buckets, SERIES_RAW_CAPACITY));
+    TEST_ASSERT_EQUAL_INT(0, series_add("cpu_usage", base + 7200 * second, 1.0));
+
+    FILE* file = fopen(path, "w");
+    fputs("not a history file", file);
+    fclose(file);
+    TEST_ASSERT_EQUAL_INT(-1, series_load(path));
+    TEST_ASSERT_EQUAL_INT(0, series_count());
+    unlink(path);
+}
+
+void test_command_server_runs_requests(void)
+{
+    const char* path = "/tmp/test_shell_server.sock";
+    TEST_ASSERT_EQUAL_INT(0, server_start(path));
+
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", path);
+    int client = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    TEST_ASSERT_EQUAL_INT(0, connect(client, (struct sockaddr*)&address, sizeof(address)));
+    int output = open("/tmp/test_server_output", O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    int null = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    int fds[SERVER_FD_COUNT] = {null, output, output};
+    ServerMessage request = {.type = SERVER_MSG_RUN};
+    snprintf(request.payload, sizeof(request.payload), "echo served\nsh -c 'exit 3'\nquit\necho never");
+    union
+    {
+        char buffer[CMSG_SPACE(sizeof(fds))];
+        struct cmsghdr align;
+    } control = {0};
+    struct iovec iov = {.iov_base = &request, .iov_len = sizeof(request)};
+    struct msghdr message = {
+        .msg_iov = &iov, .msg_iovlen = 1, .msg_control = control.buffer, .msg_controllen = sizeof(control.buffer)};
+    struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(header), fds, sizeof(fds));
+    TEST_ASSERT_TRUE(sendmsg(client, &message, 0) > 0);
+
+    TEST_ASSERT_EQUAL_INT(0, server_serve());
+    ServerMessage reply;
+    TEST_ASSERT_TRUE(recv(client, &reply, sizeof(reply), 0) > 0);
+    TEST_ASSERT_EQUAL_INT(SERVER_MSG_STATUS, reply.type);
+    TEST_ASSERT_EQUAL_INT(3, reply.value);
+    char buffer[64] = {0};
+    TEST_ASSERT_TRUE(pread(output, buffer, sizeof(buffer) - 1, 0) > 0);
+    TEST_ASSERT_EQUAL_STRING("served \n", buffer);
+
+    close(client);
+    close(output);
+    close(null);
+    TEST_ASSERT_EQUAL_INT(-1, server_start(path));
+    server_stop();
+    TEST_ASSERT_EQUAL_INT(-1, access(path, F_OK));
+    unlink("/tmp/test_server_output");
+}
+
+static bool scheduler_idle(void* arg)
+{
+    return scheduler_running() == 0 && scheduler_queued() == 0;
+}
+
+void test_scheduler_queues_background_jobs(void)
+{
+    scheduler_set_limit(1);
+    ParsedCommand cmd;
+    TEST_ASSERT_EQUAL_INT(0, parse_input("prio 5 sleep 0.2 &", &cmd));
+    TEST_ASSERT_EQUAL_INT(5, cmd.priority);
+    TEST_ASSERT_EQUAL_INT(0, execute_command(&cmd));
+    cleanup_parsed_command(&cmd);
+    Job* first = find_job("%+");
+    TEST_ASSERT_NOT_NULL(first);
+    TEST_ASSERT_EQUAL_INT(JOB_RUNNING, first->state);
+    TEST_ASSERT_EQUAL_INT(5, getpriority(PRIO_PROCESS, (id_t)first->pid));
+    int first_id = first->job_id;
+
+    TEST_ASSERT_EQUAL_INT(0, parse_input("echo queued > scheduler_test_output.txt &", &cmd));
+    TEST_ASSERT_EQUAL_INT(0, execute_command(&cmd));
+    cleanup_parsed_command(&cmd);
+    Job* second = find_job("%+");
+    TEST_ASSERT_NOT_NULL(second);
+    TEST_ASSERT_EQUAL_INT(JOB_QUEUED, second->state);
+    TEST_ASSERT_EQUAL_STRING("Queued", job_state_name(second));
+    TEST_ASSERT_EQUAL_INT(1, (int)scheduler_queued());
+
+    // The queued line was copied, so it still runs once the first job's slot frees up.
+    int second_id = second->job_id;
+    wait_for_jobs_until(scheduler_idle, NULL);
+    TEST_ASSERT_EQUAL_INT(JOB_DONE, jobs[first_id - 1].state);
+    TEST_ASSERT_EQUAL_INT(JOB_DONE, jobs[second_id - 1].state);
+    TEST_ASSERT_EQUAL_INT(2, reap_completed_jobs());
+    scheduler_set_limit(0);
+
+    char buffer[TEST_BUFFER] = "";
+    FILE* file = fopen("scheduler_test_output.txt", "r");
+    TEST_ASSERT_NOT_NULL(file);
+    TEST_ASSERT_NOT_NULL(fgets(buffer, sizeof(buffer), file));
+    fclose(file);
+    unlink("scheduler_test_output.txt");
+    TEST_ASSERT_EQUAL_STRING("queued \n", buffer);
+}
+
+void test_pinned_and_spread_placement(void)
+{
+    ParsedCommand cmd;
+    TEST_ASSERT_EQUAL_INT(-1, parse_input("pin 4096 true", &cmd));
+    cleanup_parsed_command(&cmd);
+    TEST_ASSERT_EQUAL_INT(-1, parse_input("pin 0-x true", &cmd));
+    cleanup_parsed_command(&cmd);
+    TEST_ASSERT_EQUAL_INT(-1, parse_input("pin 1000-1023 true", &cmd));
+    cleanup_parsed_command(&cmd);
+    // The label shows the CPUs left after dropping those the shell may not use.
+    TEST_ASSERT_EQUAL_INT(0, parse_input("pin 0,1000-1023 true", &cmd));
+    TEST_ASSERT_EQUAL_STRING("cpus 0", cmd.placement->label);
+    cleanup_parsed_command(&cmd);
+
+    TEST_ASSERT_EQUAL_INT(
+        0, parse_input("pin 0 grep Cpus_allowed_list: /proc/self/status > placement_test_output.txt", &cmd));
+    TEST_ASSERT_NOT_NULL(cmd.placement);
+    TEST_ASSERT_EQUAL_STRING("cpus 0", cmd.placement->label);
+    TEST_ASSERT_EQUAL_INT(0, execute_command(&cmd));
+    cleanup_parsed_command(&cmd);
+    char buffer[TEST_BUFFER] = "";
+    FILE* file = fopen("placement_test_output.txt", "r");
+    TEST_ASSERT_NOT_NULL(file);
+    TEST_ASSERT_NOT_NULL(fgets(buffer, sizeof(buffer), file));
+    fclose(file);
+    unlink("placement_test_output.txt");
+    TEST_ASSERT_EQUAL_STRING("Cpus_allowed_list:\t0\n", buffer);
+
+    // Background jobs the scheduler spreads show the CPU they got.
+    scheduler_set_spread(PLACEMENT_SPREAD_CORES);
+    TEST_ASSERT_EQUAL_INT(0, parse_input("sleep 0.1 &", &cmd));
+    TEST_ASSERT_EQUAL_INT(0, execute_command(&cmd));
+    cleanup_parsed_command(&cmd);
+    scheduler_set_spread(PLACEMENT_SPREAD_OFF);
+    Job* job = find_job("%+");
+    TEST_ASSERT_NOT_NULL(job);
+    TEST_ASSERT_EQUAL_INT(0, strncmp(job->placement, "cpu ", 4));
+    TEST_ASSERT_EQUAL_INT(0, wait_for_job(job));
+}
+
 int main(void)
 {
     UNITY_BEGIN();
     RUN_TEST(test_add_job);
+    RUN_TEST(test_job_table_reuses_slots);
+    RUN_TEST(test_job_stop_and_continue);
+    RUN_TEST(test_scheduler_queues_background_jobs);
+    RUN_TEST(test_pinned_and_spread_placement);
+    RUN_TEST(test_timed_job_usage);
+    RUN_TEST(test_stats_histogram_percentiles);
+    RUN_TEST(test_long_lines_and_argument_limits);
     RUN_TEST(test_parse_input);
+    RUN_TEST(test_parse_input_quotes_and_stages);
+    RUN_TEST(test_builtin_append_and_error_redirection);
+    RUN_TEST(test_monitor_control_channel);
+    RUN_TEST(test_builtin_sampler_fallback);
+    RUN_TEST(test_series_rollups_and_persistence);
+    RUN_TEST(test_command_server_runs_requests);
+    RUN_TEST(test_metrics_ring_publish_and_read);
+    RUN_TEST(test_config_incremental_atomic_writes);
+    RUN_TEST(test_config_reload_skips_unchanged_files);
     RUN_TEST(test_handle_cd_valid_path);
     RUN_TEST(test_execute_command);
+    RUN_TEST(test_spawn_command_output_redirection);
+    RUN_TEST(test_builtin_stage_in_pipeline);
+    RUN_TEST(test_command_hash_lookup);
+    RUN_TEST(test_builtin_table_resolves_every_entry);
+    RUN_TEST(test_run_batch_parallel_keeps_order);
     return UNITY_END();
 }
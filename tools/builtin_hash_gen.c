@@ -0,0 +1,104 @@
+/**
+ * @file builtin_hash_gen.c
+ * @brief Build-time generator of the perfect hash table the shell resolves builtins with.
+ *
+ * Reads the builtin names from builtins.def, finds the smallest power-of-two table and a seed for which
+ * perfect_hash() gives every name its own slot, and writes the seed and slot table as a C header.
+ */
+#include "perfect_hash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char* names[] = {
+#define BUILTIN(name, pipe_mode) #name,
+#include "builtins.def"
+#undef BUILTIN
+};
+
+#define NUM_BUILTINS (sizeof(names) / sizeof(names[0]))
+#define MAX_SEEDS 1000000u /**< Seeds tried per table size before the table is doubled. */
+
+/**
+ * @brief Fills slots with the index of the name each slot holds, and fails on the first collision.
+ */
+static int place_names(uint32_t seed, size_t size, int* slots)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        slots[i] = -1;
+    }
+    for (size_t i = 0; i < NUM_BUILTINS; i++)
+    {
+        size_t slot = perfect_hash(names[i], seed) & (size - 1);
+        if (slots[slot] != -1)
+        {
+            return -1;
+        }
+        slots[slot] = (int)i;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: %s <output_header>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (NUM_BUILTINS > 127)
+    {
+        fprintf(stderr, "Too many builtins for an int8_t slot table\n");
+        return EXIT_FAILURE;
+    }
+    size_t size = 1;
+    while (size < NUM_BUILTINS)
+    {
+        size *= 2;
+    }
+    int slots[1024];
+    uint32_t seed = 0;
+    while (size <= sizeof(slots) / sizeof(slots[0]))
+    {
+        seed = 0;
+        while (seed < MAX_SEEDS && place_names(seed, size, slots) == -1)
+        {
+            seed++;
+        }
+        if (seed < MAX_SEEDS)
+        {
+            break;
+        }
+        size *= 2;
+    }
+    if (size > sizeof(slots) / sizeof(slots[0]))
+    {
+        fprintf(stderr, "No perfect hash found for %zu builtins\n", NUM_BUILTINS);
+        return EXIT_FAILURE;
+    }
+
+    FILE* out = fopen(argv[1], "w");
+    if (out == NULL)
+    {
+        perror("fopen");
+        return EXIT_FAILURE;
+    }
+    fprintf(out, "/* Generated by tools/builtin_hash_gen.c from include/builtins.def. Do not edit. */\n");
+    fprintf(out, "#ifndef BUILTIN_HASH_H\n#define BUILTIN_HASH_H\n\n#include <stdint.h>\n\n");
+    fprintf(out, "#define BUILTIN_HASH_SEED %uu\n", seed);
+    fprintf(out, "#define BUILTIN_HASH_MASK %zuu\n\n", size - 1);
+    fprintf(out, "/* Index in builtins.def of the builtin in each slot, -1 for empty slots. */\n");
+    fprintf(out, "static const int8_t builtin_slots[%zu] = {", size);
+    for (size_t i = 0; i < size; i++)
+    {
+        fprintf(out, "%s%d", i ? ", " : "", slots[i]);
+    }
+    fprintf(out, "};\n\n#endif\n");
+    if (fclose(out) != 0)
+    {
+        perror("fclose");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}